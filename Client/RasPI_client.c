@@ -7,7 +7,9 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <signal.h>
+#include <sys/time.h>
 //#include <wiringPi.h>
+#include "../src/protocol.h"
 
 #define NUM_OF_LED 4
 #define LED1 4 //GPIO.23
@@ -24,11 +26,16 @@ int sock;
 char name[BUFSIZE];
 char message[BUFSIZE];
 int sleep_time;
+int proto = 1; //1: 기존 프로토콜, 2: STLC v2
+uint32_t light_id;
+uint32_t seq;
 
 void connection(int sock);
 void send_message(int sock, char* message, int msg_size);
 int recv_message(int sock, char* message);
 int send_image(int sock, char* message);
+int send_image_v2(int sock, int isOn[NUM_OF_LED]);
+int recv_all(int sock, void* buf, int size);
 void* sig_handler(int signo);
 void error_handler(char * message);
 void set_red();
@@ -37,8 +44,8 @@ int main(int argc, char **argv) {
     int i;
     struct sockaddr_in serv_addr;
 
-    if (argc != 4) {
-        printf("Usage : %s <ip> <port> <name>\n", argv[0]);
+    if (argc != 4 && argc != 5) {
+        printf("Usage : %s <ip> <port> <[intersection/]name> [v2]\n", argv[0]);
         exit(1);
     }
 
@@ -66,11 +73,21 @@ int main(int argc, char **argv) {
 
     // Set picture name
     strcpy(name, argv[3]);
-	send_message(sock, name, strlen(name));
+	if (argc == 5 && strcmp(argv[4], STLC_HELLO_V2) == 0)
+		sprintf(message, "%s %s", name, STLC_HELLO_V2);
+	else
+		strcpy(message, name);
+	send_message(sock, message, strlen(message));
 
 	if (recv_message(sock, message) == 0)
 		return 0;
-	sscanf(message, "%d", &sleep_time);
+	{
+		char version[BUFSIZE] = "";
+		sscanf(message, "%d %s %u", &sleep_time, version, &light_id);
+		// v2를 모르는 서버는 숫자만 보내므로 기존 프로토콜을 사용한다
+		if (strcmp(version, STLC_HELLO_V2) == 0)
+			proto = 2;
+	}
 
 	// process message
 	connection(sock);
@@ -103,19 +120,25 @@ void connection(int sock) {
 		}
 #endif //PI
 		
-		// send image
-		send_message(sock, "/send_image", 11); //trans seq:1 (start)
-		if (recv_message(sock, message) == 0)
-			break;
-		if (strstr(message, "NOK") != NULL) //trans seq:2
-			break;
-		send_image(sock, message);
-		
-		// request led setting
-		send_message(sock, "/get_led", 8);
-		if (recv_message(sock, message) == 0)
-			break;
-		sscanf(message, "%d %d %d %d", &isOn[0], &isOn[1], &isOn[2], &isOn[3]);
+		if (proto == 2) {
+			// send image, 응답으로 led setting을 받는다
+			if (send_image_v2(sock, isOn) == -1)
+				break;
+		} else {
+			// send image
+			send_message(sock, "/send_image", 11); //trans seq:1 (start)
+			if (recv_message(sock, message) == 0)
+				break;
+			if (strstr(message, "NOK") != NULL) //trans seq:2
+				break;
+			send_image(sock, message);
+			
+			// request led setting
+			send_message(sock, "/get_led", 8);
+			if (recv_message(sock, message) == 0)
+				break;
+			sscanf(message, "%d %d %d %d", &isOn[0], &isOn[1], &isOn[2], &isOn[3]);
+		}
 		for(i = 0; i < NUM_OF_LED; i++) {
 #ifdef PI
 			digitalWrite(leds[i], isOn[i]);
@@ -205,9 +228,84 @@ int send_image(int sock, char* message) {
 	return 0;
 }
 
+int recv_all(int sock, void* buf, int size) {
+	int recvsum = 0, msg_size;
+	while (recvsum < size) {
+		if ((msg_size = recv(sock, (char*) buf + recvsum, size - recvsum, 0)) <= 0)
+			return -1;
+		recvsum += msg_size;
+	}
+	return 0;
+}
+
+// v2 : 헤더와 이미지 전체를 한 번에 보내고 MSG_LED 응답을 기다린다
+int send_image_v2(int sock, int isOn[NUM_OF_LED]) {
+	FILE *fp;
+	char filename[BUFSIZE];
+	unsigned char header[STLC_HEADER_SIZE], leds[NUM_OF_LED];
+	char* data;
+	int i, filesize, sendsum = 0, msg_size;
+	FrameHeader h;
+	struct timeval tv;
+
+	sprintf(filename, "%s.jpg", name);
+	if ((fp = fopen(filename, "rb")) == NULL) {
+		printf("%s File open error\n", filename);
+		return -1;
+	}
+	fseek(fp, 0, SEEK_END);
+	filesize = ftell(fp);
+	rewind(fp);
+	// 헤더와 이미지를 한 버퍼에 담아 한 번에 보낸다 (Nagle 지연 방지)
+	data = malloc(STLC_HEADER_SIZE + filesize);
+	filesize = fread(data + STLC_HEADER_SIZE, 1, filesize, fp);
+	fclose(fp);
+
+	gettimeofday(&tv, NULL);
+	h.magic = STLC_MAGIC;
+	h.version = STLC_VERSION;
+	h.type = MSG_FRAME;
+	h.light_id = light_id;
+	h.seq = seq++;
+	h.timestamp = (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	h.payload_len = filesize;
+	pack_frame_header((unsigned char*) data, &h);
+
+	printf("upload %s ... %d bytes\n", filename, filesize);
+	filesize += STLC_HEADER_SIZE;
+	while (sendsum < filesize) {
+		if ((msg_size = send(sock, data + sendsum, filesize - sendsum, 0)) <= 0) {
+			free(data);
+			return -1;
+		}
+		sendsum += msg_size;
+	}
+	free(data);
+
+	// recv led setting
+	if (recv_all(sock, header, STLC_HEADER_SIZE) == -1
+			|| unpack_frame_header(header, &h) == -1 || h.type != MSG_LED
+			|| recv_all(sock, leds, NUM_OF_LED) == -1)
+		return -1;
+	for (i = 0; i < NUM_OF_LED; i++)
+		isOn[i] = leds[i];
+
+	return 0;
+}
+
 void* sig_handler(int signo) {
     switch (signo) {
         case SIGINT:
+			if (proto == 2) {
+				unsigned char header[STLC_HEADER_SIZE];
+				FrameHeader h = { STLC_MAGIC, STLC_VERSION, MSG_EXIT, light_id, seq, 0, 0 };
+				pack_frame_header(header, &h);
+				send_message(sock, (char*) header, STLC_HEADER_SIZE);
+				close(sock);
+				printf("\nconnection off\n");
+				set_red();
+				exit(0);
+			}
 			send_message(sock, "/exit", 5);
 			if (recv_message(sock, message) == 0 || strstr(message, "OK")) {
 				close(sock);
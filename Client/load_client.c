@@ -0,0 +1,276 @@
+/* STLC 서버 부하 발생기
+ * N개의 가상 라즈베리파이 클라이언트가 서버에 동시에 접속하여
+ * RasPI_client와 같은 순서로 이미지를 올리고 LED 상태를 받아간다.
+ * 프레임 하나의 지연시간은 "/send_image" 전송부터 LED 응답 수신까지로 잰다.
+ * -proto 2 이면 STLC v2 프로토콜(src/protocol.h)로 MSG_FRAME 전송부터 MSG_LED 수신까지를 잰다.
+ *
+ * -intersections n 이면 이름 앞에 교차로 id를 붙여 n개 교차로에 나눠 접속한다 ("<k>/east", k = 0..n-1).
+ *
+ * 사용법: ./load_client <ip> <port> <clients> <image.jpg> [-frames n] [-interval ms] [-names a,b,..] [-intersections n] [-proto 1|2]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "../src/protocol.h"
+
+#define BUFSIZE 513 //메세지 버퍼크기
+#define MTUSIZE 512 //메세지 전송단위
+#define MAX_NAMES 64
+
+typedef struct {
+	int id;
+	uint32_t light_id;
+	char name[BUFSIZE];
+	int connected;
+	int frames;
+	int failed;
+	double* latency; // ms
+} SimClient;
+
+struct sockaddr_in serv_addr;
+char* image;
+int image_size;
+int num_frames = 10;
+int interval_ms = 3000;
+int proto = 1;
+
+double now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+int recv_message(int sock, char* message) {
+	int msg_size = recv(sock, message, MTUSIZE, 0);
+	if (msg_size < 0)
+		msg_size = 0;
+	message[msg_size] = 0;
+	return msg_size;
+}
+
+int send_image(int sock, char* message) {
+	int sendsum = 0;
+
+	sprintf(message, "OK %d", image_size);
+	send(sock, message, strlen(message), 0); //trans seq:3
+	if (recv_message(sock, message) == 0 || strstr(message, "NOK")) //trans seq:4
+		return -1;
+
+	while (sendsum < image_size) {
+		int send_size = image_size - sendsum;
+		if (send_size > MTUSIZE)
+			send_size = MTUSIZE;
+
+		send(sock, image + sendsum, send_size, 0); //trans seq:5
+		if (recv_message(sock, message) == 0) //trans seq:6
+			return -1;
+		if (strstr(message, "NOK") != NULL)
+			continue;
+		sendsum += send_size;
+	}
+	return 0;
+}
+
+int recv_all(int sock, void* buf, int size) {
+	int recvsum = 0, msg_size;
+	while (recvsum < size) {
+		if ((msg_size = recv(sock, (char*) buf + recvsum, size - recvsum, 0)) <= 0)
+			return -1;
+		recvsum += msg_size;
+	}
+	return 0;
+}
+
+// frame은 STLC_HEADER_SIZE + image_size 크기. 헤더와 이미지를 한 번에 보내야 Nagle 지연이 없다
+int send_image_v2(SimClient* sc, int sock, uint32_t seq, char* frame) {
+	unsigned char header[STLC_HEADER_SIZE], leds[STLC_HEADER_SIZE];
+	FrameHeader h = { STLC_MAGIC, STLC_VERSION, MSG_FRAME, sc->light_id, seq, 0, image_size };
+	int sendsum = 0, msg_size, frame_size = STLC_HEADER_SIZE + image_size;
+
+	pack_frame_header((unsigned char*) frame, &h);
+	while (sendsum < frame_size) {
+		if ((msg_size = send(sock, frame + sendsum, frame_size - sendsum, 0)) <= 0)
+			return -1;
+		sendsum += msg_size;
+	}
+	if (recv_all(sock, header, STLC_HEADER_SIZE) == -1
+			|| unpack_frame_header(header, &h) == -1 || h.type != MSG_LED
+			|| h.payload_len > sizeof (leds)
+			|| recv_all(sock, leds, h.payload_len) == -1)
+		return -1;
+	return 0;
+}
+
+void* sim_client(void* arg) {
+	SimClient* sc = (SimClient*) arg;
+	char message[BUFSIZE];
+	char* frame = NULL;
+	int sock, i;
+
+	if ((sock = socket(PF_INET, SOCK_STREAM, 0)) == -1)
+		return 0;
+	if (connect(sock, (struct sockaddr*) &serv_addr, sizeof (serv_addr)) == -1) {
+		close(sock);
+		return 0;
+	}
+
+	if (proto == 2)
+		sprintf(message, "%s %s", sc->name, STLC_HELLO_V2);
+	else
+		strcpy(message, sc->name);
+	send(sock, message, strlen(message), 0);
+	if (recv_message(sock, message) == 0) {
+		close(sock);
+		return 0;
+	}
+	if (proto == 2 && sscanf(message, "%*d %*s %u", &sc->light_id) != 1) {
+		close(sock);
+		return 0;
+	}
+	sc->connected = 1;
+	if (proto == 2) {
+		frame = malloc(STLC_HEADER_SIZE + image_size);
+		memcpy(frame + STLC_HEADER_SIZE, image, image_size);
+	}
+
+	for (i = 0; i < num_frames; i++) {
+		double start = now_ms(), next;
+
+		if (proto == 2) {
+			if (send_image_v2(sc, sock, i, frame) == -1) {
+				sc->failed++;
+				break;
+			}
+			sc->latency[sc->frames++] = now_ms() - start;
+			next = start + interval_ms - now_ms();
+			if (next > 0)
+				usleep(next * 1000);
+			continue;
+		}
+
+		send(sock, "/send_image", 11, 0); //trans seq:1 (start)
+		if (recv_message(sock, message) == 0 || strstr(message, "NOK")) //trans seq:2
+			break;
+		if (send_image(sock, message) == -1) {
+			sc->failed++;
+			break;
+		}
+		send(sock, "/get_led", 8, 0);
+		if (recv_message(sock, message) == 0)
+			break;
+		sc->latency[sc->frames++] = now_ms() - start;
+
+		next = start + interval_ms - now_ms();
+		if (next > 0)
+			usleep(next * 1000);
+	}
+
+	if (proto == 2) {
+		unsigned char header[STLC_HEADER_SIZE];
+		FrameHeader h = { STLC_MAGIC, STLC_VERSION, MSG_EXIT, sc->light_id, i, 0, 0 };
+		pack_frame_header(header, &h);
+		send(sock, header, STLC_HEADER_SIZE, 0);
+	} else {
+		send(sock, "/exit", 5, 0);
+		recv_message(sock, message);
+	}
+	close(sock);
+	free(frame);
+	return 0;
+}
+
+int compare_double(const void* a, const void* b) {
+	double d = *(double*) a - *(double*) b;
+	return (d > 0) - (d < 0);
+}
+
+int load_image_file(char* filename) {
+	FILE* fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return -1;
+	fseek(fp, 0, SEEK_END);
+	image_size = ftell(fp);
+	rewind(fp);
+	image = malloc(image_size);
+	image_size = fread(image, 1, image_size, fp);
+	fclose(fp);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int i, num_clients, num_names = 0, num_intersections = 0, connected = 0, failed = 0, total = 0;
+	char* names[MAX_NAMES];
+	char* name_list = "east,west,south,north";
+	double* all, start, elapsed;
+	SimClient* clients;
+	pthread_t* threads;
+
+	if (argc < 5) {
+		printf("Usage : %s <ip> <port> <clients> <image.jpg> [-frames n] [-interval ms] [-names a,b,..] [-intersections n] [-proto 1|2]\n", argv[0]);
+		exit(1);
+	}
+	for (i = 5; i < argc - 1; i++) {
+		if (strcmp(argv[i], "-frames") == 0)
+			num_frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-interval") == 0)
+			interval_ms = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-names") == 0)
+			name_list = argv[++i];
+		else if (strcmp(argv[i], "-intersections") == 0)
+			num_intersections = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-proto") == 0)
+			proto = atoi(argv[++i]);
+	}
+	num_clients = atoi(argv[3]);
+	if (load_image_file(argv[4]) == -1) {
+		printf("%s File open error\n", argv[4]);
+		exit(1);
+	}
+	for (names[num_names] = strtok(strdup(name_list), ","); names[num_names] && num_names < MAX_NAMES - 1;)
+		names[++num_names] = strtok(NULL, ",");
+
+	memset(&serv_addr, 0, sizeof (serv_addr));
+	serv_addr.sin_family = AF_INET;
+	serv_addr.sin_addr.s_addr = inet_addr(argv[1]);
+	serv_addr.sin_port = htons(atoi(argv[2]));
+
+	clients = calloc(num_clients, sizeof (SimClient));
+	threads = calloc(num_clients, sizeof (pthread_t));
+	start = now_ms();
+	for (i = 0; i < num_clients; i++) {
+		clients[i].id = i;
+		if (num_intersections > 0)
+			sprintf(clients[i].name, "%d/%s", (i / num_names) % num_intersections, names[i % num_names]);
+		else
+			strcpy(clients[i].name, names[i % num_names]);
+		clients[i].latency = calloc(num_frames, sizeof (double));
+		pthread_create(&threads[i], NULL, sim_client, &clients[i]);
+	}
+	for (i = 0; i < num_clients; i++)
+		pthread_join(threads[i], NULL);
+	elapsed = (now_ms() - start) / 1000.0;
+
+	all = calloc((size_t) num_clients * num_frames + 1, sizeof (double));
+	for (i = 0; i < num_clients; i++) {
+		connected += clients[i].connected;
+		failed += clients[i].failed;
+		memcpy(all + total, clients[i].latency, clients[i].frames * sizeof (double));
+		total += clients[i].frames;
+	}
+	qsort(all, total, sizeof (double), compare_double);
+
+	printf("protocol  : v%d\n", proto);
+	printf("clients   : %d requested, %d connected\n", num_clients, connected);
+	printf("frames    : %d ok, %d failed, %d bytes each\n", total, failed, image_size);
+	printf("elapsed   : %.2f s (%.1f frames/s)\n", elapsed, total / elapsed);
+	if (total > 0)
+		printf("latency ms: p50 %.2f  p95 %.2f  p99 %.2f  max %.2f\n",
+				all[total / 2], all[total * 95 / 100], all[total * 99 / 100], all[total - 1]);
+	return 0;
+}
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+# STLC 결과 업로드 테스트용 HTTP 수신기
+# 서버를 -upload_url http://127.0.0.1:8080/STLC/upload 로 띄우면 웹 서버 대신 업로드를 받는다.
+# keep-alive(HTTP/1.1)를 지원하고, 초당 업로드 수와 새로 맺은 연결 수를 출력한다.
+#
+# 사용법: python3 upload_stub.py [port] [-fail ratio] [-delay ms] [-save dir]
+#   -fail  : 일부 요청에 503을 돌려준다 (재시도 확인용, 0~1)
+#   -delay : 응답 전에 기다리는 시간 (느린 웹 서버 흉내)
+#   -save  : 받은 파일을 dir에 저장
+
+import os
+import random
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+fail_ratio = 0.0
+delay = 0.0
+save_dir = None
+
+lock = threading.Lock()
+stats = {'uploads': 0, 'bytes': 0, 'failed': 0, 'connections': 0}
+
+
+def parse_filename(body):
+    # multipart 본문에서 filename="..." 만 뽑는다
+    start = body.find(b'filename="')
+    if start < 0:
+        return None
+    start += len('filename="')
+    end = body.find(b'"', start)
+    return body[start:end].decode(errors='replace')
+
+
+def parse_file_data(body):
+    head_end = body.find(b'\r\n\r\n')
+    boundary_end = body.rfind(b'\r\n--')
+    if head_end < 0 or boundary_end < head_end:
+        return b''
+    return body[head_end + 4:boundary_end]
+
+
+class UploadHandler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def setup(self):
+        super().setup()
+        with lock:
+            stats['connections'] += 1
+
+    def read_body(self):
+        if self.headers.get('Transfer-Encoding', '').lower() != 'chunked':
+            return self.rfile.read(int(self.headers.get('Content-Length', 0)))
+        body = b''
+        while True:
+            size = int(self.rfile.readline().split(b';')[0], 16)
+            chunk = self.rfile.read(size + 2)
+            if size == 0:
+                return body
+            body += chunk[:-2]
+
+    def do_POST(self):
+        body = self.read_body()
+        length = len(body)
+        if delay > 0:
+            time.sleep(delay)
+
+        if random.random() < fail_ratio:
+            with lock:
+                stats['failed'] += 1
+            self.reply(503, b'FAIL')
+            return
+
+        name = parse_filename(body)
+        if save_dir and name:
+            with open(os.path.join(save_dir, os.path.basename(name)), 'wb') as f:
+                f.write(parse_file_data(body))
+        with lock:
+            stats['uploads'] += 1
+            stats['bytes'] += length
+        self.reply(200, b'OK')
+
+    def reply(self, code, body):
+        self.send_response(code)
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, fmt, *args):
+        pass
+
+
+def report():
+    last = dict(stats)
+    while True:
+        time.sleep(1)
+        with lock:
+            now = dict(stats)
+        if now != last:
+            print('uploads/s %4d  bytes/s %8d  503 %3d  new connections %3d  (total uploads %d)' % (
+                now['uploads'] - last['uploads'], now['bytes'] - last['bytes'],
+                now['failed'] - last['failed'], now['connections'] - last['connections'],
+                now['uploads']), flush=True)
+        last = now
+
+
+def main():
+    global fail_ratio, delay, save_dir
+    port = 8080
+    args = sys.argv[1:]
+    i = 0
+    while i < len(args):
+        if args[i] == '-fail':
+            fail_ratio = float(args[i + 1])
+            i += 1
+        elif args[i] == '-delay':
+            delay = float(args[i + 1]) / 1000
+            i += 1
+        elif args[i] == '-save':
+            save_dir = args[i + 1]
+            os.makedirs(save_dir, exist_ok=True)
+            i += 1
+        else:
+            port = int(args[i])
+        i += 1
+
+    threading.Thread(target=report, daemon=True).start()
+    server = ThreadingHTTPServer(('0.0.0.0', port), UploadHandler)
+    print('upload stub listening on port %d' % port, flush=True)
+    server.serve_forever()
+
+
+if __name__ == '__main__':
+    main()
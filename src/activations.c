@@ -1,4 +1,5 @@
 #include "activations.h"
+#include "thread_pool.h"
 
 #include <math.h>
 #include <stdio.h>
@@ -92,14 +93,27 @@ float activate(float x, ACTIVATION a)
     return 0;
 }
 
-void activate_array(float *x, const int n, const ACTIVATION a)
+typedef struct {
+    float *x;
+    ACTIVATION a;
+} activate_args;
+
+static void activate_range(void *arg, int begin, int end)
 {
+    activate_args *p = (activate_args *)arg;
     int i;
-    for(i = 0; i < n; ++i){
-        x[i] = activate(x[i], a);
+    for(i = begin; i < end; ++i){
+        p->x[i] = activate(p->x[i], p->a);
     }
 }
 
+void activate_array(float *x, const int n, const ACTIVATION a)
+{
+    activate_args args = {x, a};
+    if(a == LINEAR) return;
+    parallel_for(n, PARALLEL_MIN_WORK, activate_range, &args);
+}
+
 float gradient(float x, ACTIVATION a)
 {
     switch(a){
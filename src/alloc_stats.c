@@ -0,0 +1,83 @@
+#include "alloc_stats.h"
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef __GLIBC__
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+extern void __libc_free(void* p);
+extern void* __libc_memalign(size_t align, size_t size);
+
+// malloc 안에서 쓰므로 TLS 접근에 함수 호출이 없는 모델로
+static __thread AllocStats counters __attribute__((tls_model("initial-exec")));
+
+static void count_alloc(size_t size) {
+    counters.allocs++;
+    counters.bytes += size;
+}
+
+void* malloc(size_t size) {
+    count_alloc(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    count_alloc(n * size);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) {
+    count_alloc(size);
+    return __libc_realloc(p, size);
+}
+
+void free(void* p) {
+    if (p != NULL)
+        counters.frees++;
+    __libc_free(p);
+}
+
+void* memalign(size_t align, size_t size) {
+    count_alloc(size);
+    return __libc_memalign(align, size);
+}
+
+void* aligned_alloc(size_t align, size_t size) {
+    count_alloc(size);
+    return __libc_memalign(align, size);
+}
+
+int posix_memalign(void** p, size_t align, size_t size) {
+    void* m;
+    if (align < sizeof (void*) || (align & (align - 1)) != 0)
+        return EINVAL;
+    count_alloc(size);
+    m = __libc_memalign(align, size);
+    if (m == NULL)
+        return ENOMEM;
+    *p = m;
+    return 0;
+}
+
+int alloc_stats_enabled() {
+    return 1;
+}
+
+AllocStats alloc_stats() {
+    return counters;
+}
+
+#else
+
+int alloc_stats_enabled() {
+    return 0;
+}
+
+AllocStats alloc_stats() {
+    AllocStats s = {0, 0, 0};
+    return s;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <stddef.h>
+
+/* 쓰레드별 heap 할당 카운터.
+ * glibc에서는 malloc, calloc, realloc, free, posix_memalign, aligned_alloc, memalign을 실행 파일에서 가로채
+ * (__libc_* 로 넘긴다) 부른 쓰레드의 카운터를 올린다. 그 밖의 libc에서는 항상 0 */
+typedef struct {
+    size_t allocs;      // malloc, calloc, realloc, memalign 호출 수
+    size_t frees;
+    size_t bytes;       // 요청한 바이트 합
+} AllocStats;
+
+int alloc_stats_enabled();
+/* 호출한 쓰레드의 누적 카운터 */
+AllocStats alloc_stats();
+
+#endif /* ALLOC_STATS_H */
@@ -0,0 +1,78 @@
+#include "archiver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct {
+    char filename[256];
+    FrameBuf* frame;
+} ArchiveJob;
+
+static ArchiveJob queue[ARCHIVE_QUEUE_SIZE];
+static int head, tail, count;
+static int enabled = 0;
+static int dropped = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+static void* archive_thread(void* arg) {
+    ArchiveJob job;
+    FILE* fp;
+
+    while (1) {
+        pthread_mutex_lock(&mutex);
+        while (count == 0)
+            pthread_cond_wait(&cond, &mutex);
+        job = queue[head];
+        head = (head + 1) % ARCHIVE_QUEUE_SIZE;
+        count--;
+        pthread_mutex_unlock(&mutex);
+
+        if ((fp = fopen(job.filename, "wb")) == NULL) {
+            printf("[ARCHIVE] 파일 쓰기 실패 (%s)\n", job.filename);
+        } else {
+            fwrite(job.frame->data, 1, job.frame->size, fp);
+            fclose(fp);
+        }
+        frame_release(job.frame);
+    }
+    return 0;
+}
+
+void archiver_start() {
+    pthread_t thread;
+
+    if (enabled)
+        return;
+    if (pthread_create(&thread, NULL, archive_thread, NULL)) {
+        printf("[ARCHIVE] 보관 쓰레드 생성 실패\n");
+        return;
+    }
+    pthread_detach(thread);
+    enabled = 1;
+}
+
+int archiver_enabled() {
+    return enabled;
+}
+
+void archive_frame(const char* filename, FrameBuf* f) {
+    if (!enabled)
+        return;
+
+    pthread_mutex_lock(&mutex);
+    if (count == ARCHIVE_QUEUE_SIZE) {
+        dropped++;
+        pthread_mutex_unlock(&mutex);
+        printf("[ARCHIVE] 큐가 가득 차 보관을 건너뜁니다. (누적 %d)\n", dropped);
+        return;
+    }
+    frame_retain(f);
+    strncpy(queue[tail].filename, filename, sizeof (queue[tail].filename) - 1);
+    queue[tail].frame = f;
+    tail = (tail + 1) % ARCHIVE_QUEUE_SIZE;
+    count++;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+}
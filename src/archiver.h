@@ -0,0 +1,15 @@
+#ifndef ARCHIVER_H
+#define ARCHIVER_H
+
+#include "frame_pool.h"
+
+#define ARCHIVE_QUEUE_SIZE 32
+
+/* 수신한 원본 이미지를 디스크에 보관하는 비동기 sink (-archive 옵션)
+ * 분석은 메모리 버퍼로 하므로 디스크 쓰기는 별도 쓰레드에서 처리하고,
+ * 큐가 가득 차면 보관을 건너뛴다. */
+void archiver_start();
+int archiver_enabled();
+void archive_frame(const char* filename, FrameBuf* f);
+
+#endif /* ARCHIVER_H */
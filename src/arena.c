@@ -0,0 +1,111 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_MIN_BLOCK (1 << 20)
+
+struct __ArenaBlock {
+    struct __ArenaBlock* next;
+    size_t size;
+    size_t used;
+    size_t pad;             // data를 16 byte에 맞춘다
+    unsigned char data[];
+};
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+}
+
+static ArenaBlock* new_block(size_t size) {
+    ArenaBlock* b = malloc(sizeof (ArenaBlock) + size);
+    if (b == NULL)
+        return NULL;
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+void* arena_alloc(Arena* a, size_t size) {
+    ArenaBlock* b = a->head;
+    void* p;
+
+    size = align_up(size ? size : 1);
+    if (b == NULL || b->size - b->used < size) {
+        size_t want = a->peak > ARENA_MIN_BLOCK ? a->peak : ARENA_MIN_BLOCK;
+        ArenaBlock* n = new_block(size > want ? size : want);
+        if (n == NULL)
+            return NULL;
+        n->next = b;
+        a->head = b = n;
+    }
+    p = b->data + b->used;
+    b->used += size;
+    a->used += size;
+    if (a->used > a->peak)
+        a->peak = a->used;
+    a->last = p;
+    return p;
+}
+
+void* arena_realloc(Arena* a, void* p, size_t old_size, size_t size) {
+    ArenaBlock* b = a->head;
+    void* n;
+
+    if (p == NULL)
+        return arena_alloc(a, size);
+    // 마지막 할당이고 블록에 자리가 있으면 끝만 옮긴다
+    if (p == a->last) {
+        size_t used = (unsigned char*) p - b->data;
+        size_t grow = align_up(size ? size : 1);
+        if (used + grow <= b->size) {
+            a->used = a->used - (b->used - used) + grow;
+            b->used = used + grow;
+            if (a->used > a->peak)
+                a->peak = a->used;
+            return p;
+        }
+    }
+    n = arena_alloc(a, size);
+    if (n != NULL)
+        memcpy(n, p, old_size < size ? old_size : size);
+    return n;
+}
+
+int arena_owns(Arena* a, const void* p) {
+    ArenaBlock* b;
+    for (b = a->head; b != NULL; b = b->next) {
+        const unsigned char* c = p;
+        if (c >= b->data && c < b->data + b->size)
+            return 1;
+    }
+    return 0;
+}
+
+void arena_reset(Arena* a) {
+    ArenaBlock* b = a->head;
+
+    // 블록이 여러 개였으면 최대 사용량 하나로 합친다
+    if (b != NULL && b->next != NULL) {
+        arena_free(a);
+        a->head = new_block(align_up(a->peak));
+        return;
+    }
+    if (b != NULL)
+        b->used = 0;
+    a->used = 0;
+    a->last = NULL;
+}
+
+void arena_free(Arena* a) {
+    ArenaBlock* b = a->head;
+    while (b != NULL) {
+        ArenaBlock* next = b->next;
+        free(b);
+        b = next;
+    }
+    a->head = NULL;
+    a->last = NULL;
+    a->used = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* 한 주기 동안만 쓰는 메모리를 앞에서부터 잘라 주는 bump allocator.
+ * arena_reset으로 한 번에 비우고 블록은 그대로 다시 쓴다. 한 주기가 블록 하나를 넘치면 블록을 더 달고,
+ * 다음 reset에서 그동안의 최대 사용량만큼 한 블록으로 합친다 (이후 같은 크기의 주기는 할당 없음) */
+typedef struct __ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock* head;       // 지금 잘라 쓰는 블록 (앞쪽 블록은 next로)
+    void* last;             // 마지막으로 준 포인터 (realloc을 제자리에서 늘릴 수 있게)
+    size_t used;            // 이번 주기에 쓴 바이트 (모든 블록 합)
+    size_t peak;
+} Arena;
+
+void* arena_alloc(Arena* a, size_t size);
+/* old_size는 p를 받을 때 요청한 크기. 마지막 할당이면 제자리에서 늘린다 */
+void* arena_realloc(Arena* a, void* p, size_t old_size, size_t size);
+int arena_owns(Arena* a, const void* p);
+void arena_reset(Arena* a);
+void arena_free(Arena* a);
+
+#endif /* ARENA_H */
@@ -1,4 +1,5 @@
 #include "blas.h"
+#include "thread_pool.h"
 
 #include <math.h>
 #include <assert.h>
@@ -6,48 +7,71 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-void reorg_cpu(float *x, int out_w, int out_h, int out_c, int batch, int stride, int forward, float *out)
+typedef struct {
+    float *x;
+    int out_w, out_h, out_c, stride, forward;
+    float *out;
+} reorg_args;
+
+/* (batch, 채널) 쌍 [begin, end). 쌍마다 쓰는 자리가 겹치지 않는다 */
+static void reorg_range(void *arg, int begin, int end)
 {
-    int b,i,j,k;
+    reorg_args *p = (reorg_args *)arg;
+    float *x = p->x, *out = p->out;
+    int out_w = p->out_w, out_h = p->out_h, out_c = p->out_c, stride = p->stride, forward = p->forward;
+    int bk,b,i,j,k;
     int in_c = out_c/(stride*stride);
 
-	//printf("\n out_c = %d, out_w = %d, out_h = %d, stride = %d, forward = %d \n", out_c, out_w, out_h, stride, forward);
-	//printf("  in_c = %d,  in_w = %d,  in_h = %d \n", in_c, out_w*stride, out_h*stride);
-
-    for(b = 0; b < batch; ++b){
-        for(k = 0; k < out_c; ++k){
-            for(j = 0; j < out_h; ++j){
-                for(i = 0; i < out_w; ++i){
-                    int in_index  = i + out_w*(j + out_h*(k + out_c*b));
-                    int c2 = k % in_c;
-                    int offset = k / in_c;
-                    int w2 = i*stride + offset % stride;
-                    int h2 = j*stride + offset / stride;
-                    int out_index = w2 + out_w*stride*(h2 + out_h*stride*(c2 + in_c*b));
-                    if(forward) out[out_index] = x[in_index];	// used by default for forward (i.e. forward = 0)
-                    else out[in_index] = x[out_index];
-                }
+    for(bk = begin; bk < end; ++bk){
+        b = bk / out_c;
+        k = bk % out_c;
+        for(j = 0; j < out_h; ++j){
+            for(i = 0; i < out_w; ++i){
+                int in_index  = i + out_w*(j + out_h*(k + out_c*b));
+                int c2 = k % in_c;
+                int offset = k / in_c;
+                int w2 = i*stride + offset % stride;
+                int h2 = j*stride + offset / stride;
+                int out_index = w2 + out_w*stride*(h2 + out_h*stride*(c2 + in_c*b));
+                if(forward) out[out_index] = x[in_index];	// used by default for forward (i.e. forward = 0)
+                else out[in_index] = x[out_index];
             }
         }
     }
 }
 
+void reorg_cpu(float *x, int out_w, int out_h, int out_c, int batch, int stride, int forward, float *out)
+{
+    reorg_args args = {x, out_w, out_h, out_c, stride, forward, out};
+
+	//printf("\n out_c = %d, out_w = %d, out_h = %d, stride = %d, forward = %d \n", out_c, out_w, out_h, stride, forward);
+	//printf("  in_c = %d,  in_w = %d,  in_h = %d \n", in_c, out_w*stride, out_h*stride);
+
+    parallel_for(batch*out_c, PARALLEL_GRAIN(out_w*out_h), reorg_range, &args);
+}
+
 void flatten(float *x, int size, int layers, int batch, int forward)
 {
     float *swap = calloc(size*layers*batch, sizeof(float));
+    flatten_into(x, size, layers, batch, forward, swap);
+    memcpy(x, swap, size*layers*batch*sizeof(float));
+    free(swap);
+}
+
+/* flatten과 같고 결과를 out에 쓴다 (x와 out은 겹치면 안 된다) */
+void flatten_into(float *x, int size, int layers, int batch, int forward, float *out)
+{
     int i,c,b;
     for(b = 0; b < batch; ++b){
         for(c = 0; c < layers; ++c){
             for(i = 0; i < size; ++i){
                 int i1 = b*layers*size + c*size + i;
                 int i2 = b*layers*size + i*layers + c;
-                if (forward) swap[i2] = x[i1];
-                else swap[i1] = x[i2];
+                if (forward) out[i2] = x[i1];
+                else out[i1] = x[i2];
             }
         }
     }
-    memcpy(x, swap, size*layers*batch*sizeof(float));
-    free(swap);
 }
 
 void weighted_sum_cpu(float *a, float *b, float *s, int n, float *c)
@@ -126,19 +150,30 @@ void variance_cpu(float *x, float *mean, int batch, int filters, int spatial, fl
     }
 }
 
-void normalize_cpu(float *x, float *mean, float *variance, int batch, int filters, int spatial)
+typedef struct {
+    float *x, *mean, *variance;
+    int filters, spatial;
+} normalize_args;
+
+static void normalize_range(void *arg, int begin, int end)
 {
-    int b, f, i;
-    for(b = 0; b < batch; ++b){
-        for(f = 0; f < filters; ++f){
-            for(i = 0; i < spatial; ++i){
-                int index = b*filters*spatial + f*spatial + i;
-                x[index] = (x[index] - mean[f])/(sqrt(variance[f]) + .000001f);
-            }
+    normalize_args *p = (normalize_args *)arg;
+    int bf, i;
+    for(bf = begin; bf < end; ++bf){
+        int f = bf % p->filters;
+        float *x = p->x + (size_t)bf*p->spatial;
+        for(i = 0; i < p->spatial; ++i){
+            x[i] = (x[i] - p->mean[f])/(sqrt(p->variance[f]) + .000001f);
         }
     }
 }
 
+void normalize_cpu(float *x, float *mean, float *variance, int batch, int filters, int spatial)
+{
+    normalize_args args = {x, mean, variance, filters, spatial};
+    parallel_for(batch*filters, PARALLEL_GRAIN(spatial), normalize_range, &args);
+}
+
 void const_cpu(int N, float ALPHA, float *X, int INCX)
 {
     int i;
@@ -205,9 +240,24 @@ void inter_cpu(int NX, float *X, int NY, float *Y, int B, float *OUT)
     }
 }
 
+typedef struct {
+    float *X, *Y;
+} copy_args;
+
+static void copy_range(void *arg, int begin, int end)
+{
+    copy_args *p = (copy_args *)arg;
+    memcpy(p->Y + begin, p->X + begin, (end - begin)*sizeof(float));
+}
+
 void copy_cpu(int N, float *X, int INCX, float *Y, int INCY)
 {
     int i;
+    if(INCX == 1 && INCY == 1){
+        copy_args args = {X, Y};
+        parallel_for(N, PARALLEL_MIN_WORK*4, copy_range, &args);
+        return;
+    }
     for(i = 0; i < N; ++i) Y[i*INCY] = X[i*INCX];
 }
 
@@ -1,6 +1,7 @@
 #ifndef BLAS_H
 #define BLAS_H
 void flatten(float *x, int size, int layers, int batch, int forward);
+void flatten_into(float *x, int size, int layers, int batch, int forward, float *out);
 void pm(int M, int N, float *A);
 float *random_matrix(int rows, int cols);
 void time_random_matrix(int TA, int TB, int m, int k, int n);
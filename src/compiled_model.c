@@ -0,0 +1,363 @@
+#include "compiled_model.h"
+#include "convolutional_layer.h"
+#include "winograd.h"
+#include "xnor_gemm.h"
+#include "quantize.h"
+#include "parser.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef enum {
+    SECTION_BIASES, SECTION_WEIGHTS, SECTION_SCALES, SECTION_ROLLING_MEAN, SECTION_ROLLING_VARIANCE,
+    SECTION_WINOGRAD, SECTION_XNOR_WEIGHTS, SECTION_XNOR_ALPHA, SECTION_XNOR_TAP_POP,
+    SECTION_INT8_WEIGHTS, SECTION_INT8_WEIGHT_SCALES, SECTION_INT8_WEIGHT_SUMS, SECTION_INT8_INPUT_SCALES,
+    SECTION_KINDS
+} SECTION_KIND;
+
+typedef struct {
+    int magic;
+    int version;
+    int n;          // cfg의 레이어 수
+    int layers;     // 레이어 표 크기 (conv 레이어 수)
+    int sections;
+    int reserved;
+    uint64_t seen;
+} model_header;
+
+typedef struct {
+    int index;
+    int n, c, size, stride;
+    int conv_algo;
+    int fused;
+    int quantized;
+} model_layer;
+
+typedef struct {
+    int layer;
+    int kind;
+    uint64_t offset;
+    uint64_t bytes;
+} model_section;
+
+/* section이 들어가는 레이어 필드 */
+static void **section_field(layer *l, int kind)
+{
+    switch(kind){
+        case SECTION_BIASES:             return (void**)&l->biases;
+        case SECTION_WEIGHTS:            return (void**)&l->weights;
+        case SECTION_SCALES:             return (void**)&l->scales;
+        case SECTION_ROLLING_MEAN:       return (void**)&l->rolling_mean;
+        case SECTION_ROLLING_VARIANCE:   return (void**)&l->rolling_variance;
+        case SECTION_WINOGRAD:           return (void**)&l->winograd_weights;
+        case SECTION_XNOR_WEIGHTS:       return (void**)&l->xnor_weights;
+        case SECTION_XNOR_ALPHA:         return (void**)&l->xnor_alpha;
+        case SECTION_XNOR_TAP_POP:       return (void**)&l->xnor_tap_pop;
+        case SECTION_INT8_WEIGHTS:       return (void**)&l->weights_int8;
+        case SECTION_INT8_WEIGHT_SCALES: return (void**)&l->weight_scales;
+        case SECTION_INT8_WEIGHT_SUMS:   return (void**)&l->weight_sums;
+        case SECTION_INT8_INPUT_SCALES:  return (void**)&l->input_scales;
+    }
+    return 0;
+}
+
+static size_t section_bytes(layer *l, int kind)
+{
+    size_t k = (size_t)l->size*l->size*l->c;
+    switch(kind){
+        case SECTION_BIASES:
+        case SECTION_SCALES:
+        case SECTION_ROLLING_MEAN:
+        case SECTION_ROLLING_VARIANCE:
+        case SECTION_XNOR_ALPHA:
+        case SECTION_INT8_WEIGHT_SCALES: return l->n*sizeof(float);
+        case SECTION_INT8_WEIGHT_SUMS:   return l->n*sizeof(int);
+        case SECTION_WEIGHTS:            return l->n*k*sizeof(float);
+        case SECTION_WINOGRAD:           return winograd_weights_size(l->n, l->c)*sizeof(float);
+        case SECTION_XNOR_WEIGHTS:       return xnor_weights_size(l->n, l->c, l->size)*sizeof(uint64_t);
+        case SECTION_XNOR_TAP_POP:       return (size_t)l->n*l->size*l->size*sizeof(int);
+        case SECTION_INT8_WEIGHTS:       return packed_weights_int8_size(l->n, k);
+        case SECTION_INT8_INPUT_SCALES:  return l->c*sizeof(float);
+    }
+    return 0;
+}
+
+/* forward가 실제로 읽는 배열만 저장한다 (Winograd, XNOR 레이어는 변환한 weight만) */
+static int section_needed(layer *l, int kind)
+{
+    int bn = l->batch_normalize && !l->fused;
+    switch(kind){
+        case SECTION_BIASES:             return 1;
+        case SECTION_WEIGHTS:            return l->conv_algo != CONV_WINOGRAD && l->conv_algo != CONV_XNOR;
+        case SECTION_SCALES:
+        case SECTION_ROLLING_MEAN:
+        case SECTION_ROLLING_VARIANCE:   return bn;
+        case SECTION_WINOGRAD:           return l->winograd_weights != 0;
+        case SECTION_XNOR_WEIGHTS:
+        case SECTION_XNOR_ALPHA:
+        case SECTION_XNOR_TAP_POP:       return l->xnor_weights != 0;
+        case SECTION_INT8_WEIGHTS:
+        case SECTION_INT8_WEIGHT_SCALES:
+        case SECTION_INT8_WEIGHT_SUMS:
+        case SECTION_INT8_INPUT_SCALES:  return l->quantized;
+    }
+    return 0;
+}
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + MODEL_ALIGN - 1) & ~(uint64_t)(MODEL_ALIGN - 1);
+}
+
+int save_compiled_model(network net, char *filename)
+{
+    FILE *fp = fopen(filename, "wb");
+    model_header header = {MODEL_MAGIC, MODEL_VERSION, net.n, 0, 0, 0, *net.seen};
+    model_layer *layers = calloc(net.n, sizeof(model_layer));
+    model_section *sections = calloc((size_t)net.n*SECTION_KINDS, sizeof(model_section));
+    uint64_t offset;
+    int i, k;
+    static const char zeros[MODEL_ALIGN] = {0};
+    if(!fp) file_error(filename);
+
+    for(i = 0; i < net.n; ++i){
+        layer *l = net.layers + i;
+        model_layer *r = layers + header.layers;
+        if(l->type != CONVOLUTIONAL) continue;
+        r->index = i;
+        r->n = l->n;
+        r->c = l->c;
+        r->size = l->size;
+        r->stride = l->stride;
+        r->conv_algo = l->conv_algo;
+        r->fused = l->fused;
+        r->quantized = l->quantized;
+        ++header.layers;
+        for(k = 0; k < SECTION_KINDS; ++k){
+            if(!section_needed(l, k)) continue;
+            sections[header.sections].layer = i;
+            sections[header.sections].kind = k;
+            sections[header.sections].bytes = section_bytes(l, k);
+            ++header.sections;
+        }
+    }
+    offset = sizeof(model_header) + header.layers*sizeof(model_layer) + header.sections*sizeof(model_section);
+    for(i = 0; i < header.sections; ++i){
+        offset = align_offset(offset);
+        sections[i].offset = offset;
+        offset += sections[i].bytes;
+    }
+
+    fwrite(&header, sizeof(model_header), 1, fp);
+    fwrite(layers, sizeof(model_layer), header.layers, fp);
+    fwrite(sections, sizeof(model_section), header.sections, fp);
+    offset = sizeof(model_header) + header.layers*sizeof(model_layer) + header.sections*sizeof(model_section);
+    for(i = 0; i < header.sections; ++i){
+        layer *l = net.layers + sections[i].layer;
+        fwrite(zeros, 1, sections[i].offset - offset, fp);
+        fwrite(*section_field(l, sections[i].kind), 1, sections[i].bytes, fp);
+        offset = sections[i].offset + sections[i].bytes;
+    }
+    fclose(fp);
+    free(layers);
+    free(sections);
+    return header.layers;
+}
+
+int is_compiled_model(char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    int magic = 0;
+    if(!fp) return 0;
+    if(fread(&magic, sizeof(int), 1, fp) != 1) magic = 0;
+    fclose(fp);
+    return magic == MODEL_MAGIC;
+}
+
+/* 레이어 표 한 줄이 cfg의 레이어와 같은 모양인지 */
+static int layer_matches(network *net, model_layer *r)
+{
+    layer *l;
+    if(r->index < 0 || r->index >= net->n) return 0;
+    l = net->layers + r->index;
+    return l->type == CONVOLUTIONAL && l->n == r->n && l->c == r->c && l->size == r->size
+        && l->stride == r->stride && l->conv_algo == r->conv_algo;
+}
+
+/* 레이어 표가 cfg의 conv 레이어를 한 번씩 빠짐없이 담고 있는지 (layer_matches를 통과한 표) */
+static int covers_conv_layers(network *net, model_layer *layers, int n)
+{
+    char *found = calloc(net->n, 1);
+    int i, ok = 1;
+    for(i = 0; i < n && ok; ++i){
+        if(found[layers[i].index]) ok = 0;
+        found[layers[i].index] = 1;
+    }
+    for(i = 0; i < net->n && ok; ++i){
+        if(net->layers[i].type == CONVOLUTIONAL && !found[i]) ok = 0;
+    }
+    free(found);
+    return ok;
+}
+
+int load_compiled_model(network *net, char *filename, int int8)
+{
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    char *base;
+    model_header *header;
+    model_layer *layers;
+    model_section *sections;
+    size_t table;
+    int i;
+    if(fd < 0) return -1;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(model_header)){
+        close(fd);
+        return -1;
+    }
+    // 쓰기는 copy-on-write로 (파일에는 반영되지 않는다). 읽기만 하면 페이지 캐시를 그대로 쓴다
+    base = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) return -1;
+
+    header = (model_header*)base;
+    layers = (model_layer*)(header + 1);
+    sections = (model_section*)(layers + header->layers);
+    table = sizeof(model_header) + (size_t)header->layers*sizeof(model_layer) + (size_t)header->sections*sizeof(model_section);
+    if(header->magic != MODEL_MAGIC || header->version != MODEL_VERSION || header->n != net->n
+            || header->layers < 0 || header->sections < 0 || table > (size_t)st.st_size){
+        fprintf(stderr, "%s: 이 cfg의 컴파일된 모델이 아닙니다.\n", filename);
+        munmap(base, st.st_size);
+        return -1;
+    }
+    // 포인터를 바꾸기 전에 전부 확인한다
+    for(i = 0; i < header->layers; ++i){
+        if(!layer_matches(net, layers + i)){
+            fprintf(stderr, "%s: 레이어 %d의 모양이 cfg와 다릅니다.\n", filename, layers[i].index);
+            munmap(base, st.st_size);
+            return -1;
+        }
+    }
+    // 표에 빠진 conv 레이어는 parse_network_cfg_inference가 잡은 0 weight로 돌게 된다
+    if(!covers_conv_layers(net, layers, header->layers)){
+        fprintf(stderr, "%s: 레이어 표가 cfg의 conv 레이어와 맞지 않습니다.\n", filename);
+        munmap(base, st.st_size);
+        return -1;
+    }
+    for(i = 0; i < header->sections; ++i){
+        model_section *s = sections + i;
+        if(s->layer < 0 || s->layer >= net->n || net->layers[s->layer].type != CONVOLUTIONAL
+                || s->kind < 0 || s->kind >= SECTION_KINDS || s->offset % MODEL_ALIGN
+                || s->offset + s->bytes > (uint64_t)st.st_size
+                || s->bytes != section_bytes(net->layers + s->layer, s->kind)){
+            fprintf(stderr, "%s: section %d이 잘못되었습니다.\n", filename, i);
+            munmap(base, st.st_size);
+            return -1;
+        }
+    }
+
+    for(i = 0; i < header->layers; ++i){
+        layer *l = net->layers + layers[i].index;
+        l->fused = layers[i].fused;
+        l->quantized = int8 && layers[i].quantized;
+    }
+    for(i = 0; i < header->sections; ++i){
+        layer *l = net->layers + sections[i].layer;
+        void **field = section_field(l, sections[i].kind);
+        if(sections[i].kind >= SECTION_INT8_WEIGHTS && !l->quantized) continue;
+        free(*field);
+        *field = base + sections[i].offset;
+    }
+    *net->seen = header->seen;
+    net->model_map = base;
+    net->model_size = st.st_size;
+    return header->layers;
+}
+
+void free_compiled_model(network *net)
+{
+    char *base = net->model_map;
+    int i, k;
+    if(!base) return;
+    for(i = 0; i < net->n; ++i){
+        layer *l = net->layers + i;
+        if(l->type != CONVOLUTIONAL) continue;
+        for(k = 0; k < SECTION_KINDS; ++k){
+            void **field = section_field(l, k);
+            char *p = *field;
+            if(p >= base && p < base + net->model_size) *field = 0;
+        }
+    }
+    munmap(base, net->model_size);
+    net->model_map = 0;
+    net->model_size = 0;
+}
+
+typedef struct {
+    int mode;       // 0: 학습용 빌드 + .weights, 1: 추론 전용 + .weights, 2: 추론 전용 + 컴파일된 모델
+    char *cfgfile, *weightfile, *modelfile;
+    int iters;
+} StartupRun;
+
+/* 자식 프로세스: 네트워크를 만들고 forward해서 [시작 ms, 첫 forward ms, 이후 forward ms]를 잰다 */
+static void startup_child(void *arg, double *t)
+{
+    StartupRun *r = arg;
+    double start = what_time_is_it_now();
+    network net;
+    float *X;
+    int i;
+
+    if(r->mode == 0){
+        net = parse_network_cfg_custom(r->cfgfile, 1);
+        load_weights(&net, r->weightfile);
+        fuse_network(&net);
+    }else if(r->mode == 1){
+        net = parse_network_cfg_inference(r->cfgfile, 1);
+        load_weights(&net, r->weightfile);
+        fuse_network(&net);
+    }else{
+        net = parse_network_cfg_inference(r->cfgfile, 1);
+        if(load_compiled_model(&net, r->modelfile, 0) < 0) _exit(1);
+        fuse_network(&net);
+    }
+    t[0] = what_time_is_it_now() - start;
+
+    X = calloc(net.w*net.h*net.c, sizeof(float));
+    for(i = 0; i < net.w*net.h*net.c; ++i) X[i] = rand_uniform(0, 1);
+    start = what_time_is_it_now();
+    network_predict(net, X);
+    t[1] = what_time_is_it_now() - start;
+    start = what_time_is_it_now();
+    for(i = 0; i < r->iters; ++i) network_predict(net, X);
+    t[2] = (what_time_is_it_now() - start)/r->iters;
+    t[0] *= 1000; t[1] *= 1000; t[2] *= 1000;
+}
+
+void test_model_startup(char *cfgfile, char *weightfile, char *modelfile, int iters)
+{
+    char *names[] = {"train build + .weights", "inference + .weights", "compiled model (mmap)"};
+    int mode;
+    if(iters < 1) iters = 1;
+    if(!is_compiled_model(modelfile)){
+        printf("%s 는 컴파일된 모델이 아닙니다. (./darknet compile %s)\n", modelfile, weightfile);
+        return;
+    }
+    printf("\n%s, %s -> %s (forward %d번 평균)\n", cfgfile, weightfile, modelfile, iters);
+    printf("load                     | startup ms | 1st forward ms | forward ms | peak RSS MB\n");
+    for(mode = 0; mode < 3; ++mode){
+        StartupRun r = {mode, cfgfile, weightfile, modelfile, iters};
+        double t[3], peak;
+        if(!run_in_child(startup_child, &r, t, 3, &peak)){
+            printf("%-24s | 실패\n", names[mode]);
+        }else{
+            printf("%-24s | %10.1f | %14.1f | %10.1f | %11.1f\n", names[mode], t[0], t[1], t[2], peak/1048576.);
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef COMPILED_MODEL_H
+#define COMPILED_MODEL_H
+
+#include "network.h"
+
+#define MODEL_MAGIC 0x4d434e44   // "DNCM"
+#define MODEL_VERSION 1
+#define MODEL_ALIGN 64
+
+/* 컴파일된 모델 (추론 전용, CPU)
+ * load_weights + fuse_network (+ load_int8_weights)를 마친 conv 레이어의 배열을 forward가 쓰는 모양 그대로 저장한다.
+ *   batchnorm을 접은 weight/bias, Winograd 변환 weight, XNOR bit pack, pack된 int8 weight
+ * 파일: header | 레이어 표 (conv 레이어마다 모양) | section 표 | 64 byte 정렬 section 데이터 ...
+ * 읽을 때는 파일을 mmap하고 레이어 포인터가 section을 바로 가리키게 한다 (복사, 변환 없음. 페이지는 처음 쓸 때 읽힌다).
+ * cfg는 따로 읽는다 (parse_network_cfg_inference). 레이어 모양이 cfg와 다르면 읽지 않는다 */
+
+int save_compiled_model(network net, char *filename);
+/* 파일 앞부분이 컴파일된 모델 header인지 */
+int is_compiled_model(char *filename);
+/* 읽은 conv 레이어 수, 파일이 없거나 cfg와 다르면 -1 (네트워크는 그대로).
+ * int8이 0이면 INT8 section은 쓰지 않고 FP32로 분석한다 */
+int load_compiled_model(network *net, char *filename, int int8);
+/* free_network가 부른다: mmap을 가리키는 레이어 포인터를 지우고 unmap */
+void free_compiled_model(network *net);
+
+/* 기존 로드 (학습용 빌드 + load_weights + fuse), 추론 전용 빌드 + load_weights + fuse, 컴파일된 모델의
+ * 시작 시간, 첫 forward, 이후 forward, peak RSS 비교 */
+void test_model_startup(char *cfgfile, char *weightfile, char *modelfile, int iters);
+
+#endif
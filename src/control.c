@@ -0,0 +1,158 @@
+#include "control.h"
+#include "controller.h"
+#include "server.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+extern Reactor* reactor;
+extern pthread_mutex_t conn_mutex;
+
+typedef struct __ControlConn {
+    ReactorHandler handler;
+    char line[CONTROL_LINE_SIZE];
+    int len;
+} ControlConn;
+
+static ReactorHandler listener;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static double stats_wall = 0, stats_cpu = 0;
+
+static double cpu_time() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+static void control_close(ControlConn* c) {
+    reactor_del(reactor, &c->handler);
+    close(c->handler.fd);
+    free(c);
+}
+
+/* 명령 한 줄을 처리하고 답을 reply에 쓴다 */
+static void control_command(char* line, char* reply, int size) {
+    char cmd[32] = "", arg[32] = "";
+
+    sscanf(line, "%31s %31s", cmd, arg);
+    if (strcmp(cmd, "mode") == 0) {
+        if (arg[0] == 0) {
+            snprintf(reply, size, "OK %s\n", controller_mode() == CONTROLLER_NIGHT ? "night" : "normal");
+        } else if (strcmp(arg, "normal") == 0 || strcmp(arg, "night") == 0) {
+            controller_set_mode(arg[1] == 'i' ? CONTROLLER_NIGHT : CONTROLLER_NORMAL);
+            printf("[SERVER] 제어 소켓: %s모드로 변경되었습니다.\n", arg[1] == 'i' ? "야간" : "주간");
+            snprintf(reply, size, "OK %s\n", arg);
+        } else {
+            snprintf(reply, size, "ERR mode normal|night\n");
+        }
+    } else if (strcmp(cmd, "reload") == 0) {
+        kill(getpid(), SIGHUP);
+        snprintf(reply, size, "OK reload\n");
+    } else if (strcmp(cmd, "stats") == 0) {
+        double wall = what_time_is_it_now(), cpu = cpu_time();
+        TrafficLight** lights = NULL;
+        int cap = 0, intersections, connected;
+
+        pthread_mutex_lock(&conn_mutex);
+        intersections = registry_size();
+        connected = registry_connected(&lights, &cap);
+        pthread_mutex_unlock(&conn_mutex);
+        free(lights);
+
+        pthread_mutex_lock(&stats_mutex);
+        snprintf(reply, size, "OK intersections %d lights %d cpu %.2f%% (%.1f s)\n", intersections, connected,
+                100 * (cpu - stats_cpu) / (wall - stats_wall), wall - stats_wall);
+        stats_wall = wall;
+        stats_cpu = cpu;
+        pthread_mutex_unlock(&stats_mutex);
+    } else {
+        snprintf(reply, size, "ERR unknown command (mode, reload, stats)\n");
+    }
+}
+
+static void control_connection(ReactorHandler* h, unsigned int events) {
+    ControlConn* c = (ControlConn*) h;
+    char reply[CONTROL_LINE_SIZE];
+    char* end;
+    int n;
+
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        control_close(c);
+        return;
+    }
+    n = recv(h->fd, c->line + c->len, sizeof (c->line) - 1 - c->len, 0);
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    if (n <= 0) {
+        control_close(c);
+        return;
+    }
+    c->len += n;
+    c->line[c->len] = 0;
+
+    while ((end = strchr(c->line, '\n')) != NULL) {
+        *end = 0;
+        control_command(c->line, reply, sizeof (reply));
+        // 답은 한 줄이라 소켓 버퍼에 바로 들어간다
+        send(h->fd, reply, strlen(reply), MSG_NOSIGNAL);
+        c->len -= end + 1 - c->line;
+        memmove(c->line, end + 1, c->len + 1);
+    }
+    if (c->len == sizeof (c->line) - 1)
+        control_close(c);
+}
+
+static void control_accept(ReactorHandler* h, unsigned int events) {
+    ControlConn* c;
+    int sock;
+
+    while ((sock = accept(h->fd, NULL, NULL)) != -1) {
+        set_nonblocking(sock);
+        c = calloc(1, sizeof (ControlConn));
+        c->handler.fd = sock;
+        c->handler.on_event = control_connection;
+        if (reactor_add(reactor, &c->handler, EPOLLIN | EPOLLRDHUP) == -1) {
+            close(sock);
+            free(c);
+        }
+    }
+}
+
+void control_start(const char* path) {
+    struct sockaddr_un addr;
+    int sock;
+
+    memset(&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof (addr.sun_path))
+        error_handler("제어 소켓 경로가 너무 깁니다");
+    strcpy(addr.sun_path, path);
+
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+        error_handler("control socket() error");
+    unlink(path); // 지난 실행이 남긴 소켓 파일
+    if (bind(sock, (struct sockaddr*) &addr, sizeof (addr)) == -1)
+        error_handler("control bind() error");
+    // 신호 모드를 바꾸고 모델을 다시 읽는 소켓이므로 서버를 띄운 사용자만 (listen 전이라 그 사이 접속은 없다)
+    if (chmod(path, 0600) == -1)
+        error_handler("control chmod() error");
+    if (listen(sock, 8) == -1)
+        error_handler("control listen() error");
+    set_nonblocking(sock);
+
+    stats_wall = what_time_is_it_now();
+    stats_cpu = cpu_time();
+    listener.fd = sock;
+    listener.on_event = control_accept;
+    if (reactor_add(reactor, &listener, EPOLLIN) == -1)
+        error_handler("control reactor_add() error");
+    printf("[SERVER] 제어 소켓 %s\n", path);
+}
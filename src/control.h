@@ -0,0 +1,17 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#define CONTROL_SOCKET "stlc.sock"  // 기본 제어 소켓 경로 (-control로 변경)
+#define CONTROL_LINE_SIZE 256
+
+/* 운영용 제어 소켓 (unix domain stream)
+ * 한 줄에 명령 하나를 보내면 "OK ..." 또는 "ERR ..." 한 줄로 답한다. I/O 쓰레드의 reactor에서 처리하므로
+ * 분석 루프는 키보드를 확인하려고 깨어날 필요가 없다.
+ *   mode                    지금 신호 모드
+ *   mode normal|night       주간/야간 전환 (모든 교차로를 처음 신호부터)
+ *   reload                  모델 교체 (SIGHUP과 같다)
+ *   stats                   교차로, 연결된 신호등 수, 지난 stats 뒤로의 CPU 사용률
+ * 예: echo "mode night" | nc -U stlc.sock */
+void control_start(const char* path);
+
+#endif /* CONTROL_H */
@@ -0,0 +1,392 @@
+#include "controller.h"
+#include "publisher.h"
+#include "scheduler.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+extern pthread_mutex_t conn_mutex;
+
+double traffic_normal_mode(Intersection* x, int default_time, int default_orange) {
+    TrafficController* c = &x->ctl;
+    int EW_Max = x->lights[EAST].front + x->lights[WEST].front;
+    int NS_Max = x->lights[NORTH].front + x->lights[SOUTH].front;
+
+    if (c->myswitch == 4) {
+        // orange
+        orange_light(&x->lights[EAST]);
+        orange_light(&x->lights[WEST]);
+        orange_light(&x->lights[SOUTH]);
+        orange_light(&x->lights[NORTH]);
+
+        c->myswitch = c->old_switch;
+        return default_orange;
+    }
+
+    switch (c->myswitch) {
+        case 0:
+            //North South Green
+            //East West Red
+            c->calc_time = 3 * (NS_Max - EW_Max);
+
+            green_light(&x->lights[NORTH]);
+            green_light(&x->lights[SOUTH]);
+            red_light(&x->lights[EAST]);
+            red_light(&x->lights[WEST]);
+            break;
+
+        case 1:
+            //North South Left Green
+            //East West Red
+            c->calc_time = 3 * (NS_Max - EW_Max);
+
+            green_left_light(&x->lights[NORTH]);
+            green_left_light(&x->lights[SOUTH]);
+            red_light(&x->lights[EAST]);
+            red_light(&x->lights[WEST]);
+            break;
+
+        case 2:
+            //North South Red
+            //East West Green
+            c->calc_time = 3 * (EW_Max - NS_Max);
+
+            red_light(&x->lights[NORTH]);
+            red_light(&x->lights[SOUTH]);
+            green_light(&x->lights[EAST]);
+            green_light(&x->lights[WEST]);
+            break;
+
+        case 3:
+            //North South Red
+            //East West Left Green
+            c->calc_time = 3 * (EW_Max - NS_Max);
+
+            red_light(&x->lights[NORTH]);
+            red_light(&x->lights[SOUTH]);
+            green_left_light(&x->lights[EAST]);
+            green_left_light(&x->lights[WEST]);
+            break;
+    }
+    // 이 신호 다음은 주황불, 그 다음은 old_switch
+    c->old_switch = (c->myswitch + 1) % 4;
+    c->myswitch = 4;
+
+    if (c->calc_time < -5)
+        c->calc_time = -5;
+    else if (c->calc_time > 10)
+        c->calc_time = 10;
+    return default_time + c->calc_time;
+}
+
+double traffic_night_mode(Intersection* x, int side_time, int default_orange) {
+    TrafficController* c = &x->ctl;
+    int EW_Max = x->lights[EAST].front + x->lights[WEST].front;
+
+    switch (c->myswitch) {
+        case 1:
+            //North South Red
+            //East West Green (없는쪽 신호시간)
+            red_light(&x->lights[NORTH]);
+            red_light(&x->lights[SOUTH]);
+            green_light(&x->lights[EAST]);
+            green_light(&x->lights[WEST]);
+
+            c->old_switch = 0;
+            c->myswitch = 2;
+            return side_time;
+
+        case 2:
+            // orange
+            orange_light(&x->lights[EAST]);
+            orange_light(&x->lights[WEST]);
+            orange_light(&x->lights[SOUTH]);
+            orange_light(&x->lights[NORTH]);
+
+            c->myswitch = c->old_switch;
+            return default_orange;
+
+        default:
+            //North South Green
+            //East West Red, 동서에 차가 모이면 다음 확인 때 주황불로
+            green_light(&x->lights[NORTH]);
+            green_light(&x->lights[SOUTH]);
+            red_light(&x->lights[EAST]);
+            red_light(&x->lights[WEST]);
+
+            if (EW_Max >= 2) {
+                c->old_switch = 1;
+                c->myswitch = 2;
+            }
+            return NIGHT_CHECK_TIME;
+    }
+}
+
+void publish_cycle(Intersection* x) {
+    StatusSnapshot status;
+    double remain;
+
+    pthread_mutex_lock(&conn_mutex);
+    remain = x->ctl.phase_end - what_time_is_it_now();
+    status_snapshot(&status, x, remain > 0 ? (int) ceil(remain) : 0, (int) ceil(x->ctl.phase_time));
+    pthread_mutex_unlock(&conn_mutex);
+
+    publish_status(&status);
+    publish_global(x->id, status.accident, status.remain_time, status.total_time);
+}
+
+static Scheduler sched;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond;
+static int mode = CONTROLLER_NORMAL;
+static int mode_changed = 0;
+static int woken = 0;
+static int started = 0;
+
+static Intersection** xs = NULL;  // 예약한 교차로 (registry에 만든 순서)
+static int xs_cap = 0;
+static int scheduled = 0;
+
+static double next_phase(Intersection* x, int m) {
+    if (m == CONTROLLER_NORMAL)
+        return traffic_normal_mode(x, DAY_SIGNAL_TIME, DAY_ORANGE_TIME);
+    return traffic_night_mode(x, NIGHT_SIDE_TIME, NIGHT_ORANGE_TIME);
+}
+
+/* 시각 due에 예약된 전환. 다음 전환은 now가 아니라 due 기준으로 잡아서 늦게 깬 만큼 신호가 밀리지 않게 한다 */
+static void fire(Intersection* x, double due, int m) {
+    TrafficController* c = &x->ctl;
+    double length, now = what_time_is_it_now();
+    int i;
+
+    pthread_mutex_lock(&conn_mutex);
+    length = next_phase(x, m);
+    // 멈춰 있었던 경우 (SIGSTOP 등) 밀린 전환을 몰아서 하지 않는다
+    if (due + length < now)
+        due = now;
+    c->phase_time = length;
+    c->phase_end = due + length;
+    for (i = 0; i < NUM_OF_APPROACH; i++)
+        if (x->lights[i].connected)
+            publish_light(&x->lights[i], 0);
+    pthread_mutex_unlock(&conn_mutex);
+
+    schedule_at(&sched, &c->timer, c->phase_end);
+    publish_cycle(x);
+    printf("[SIGNAL] %s : 다음 신호까지 %.1f 초\n", x->id, length);
+}
+
+/* 처음 신호부터 바로 시작 */
+static void restart(Intersection* x, double now) {
+    TrafficController* c = &x->ctl;
+
+    c->myswitch = 0;
+    c->old_switch = 0;
+    c->calc_time = 0;
+    c->phase_end = now;
+    c->phase_time = 0;
+    schedule_at(&sched, &c->timer, now);
+}
+
+/* when까지 (when < 0이면 깨울 때까지) 잔다. cond는 CLOCK_MONOTONIC 기준이므로 what_time_is_it_now와 같은 시계다 */
+static void wait_until(double when) {
+    struct timespec ts;
+
+    ts.tv_sec = (time_t) when;
+    ts.tv_nsec = (long) ((when - (time_t) when) * 1e9);
+    while (!mode_changed && !woken) {
+        if (when < 0)
+            pthread_cond_wait(&cond, &mutex);
+        else if (what_time_is_it_now() >= when || pthread_cond_timedwait(&cond, &mutex, &ts) == ETIMEDOUT)
+            break;
+    }
+}
+
+static void* controller_main(void* arg) {
+    for (;;) {
+        Timer* t = scheduler_next(&sched);
+        double now;
+        int m, changed, n, i;
+
+        pthread_mutex_lock(&mutex);
+        wait_until(t ? t->when : -1);
+        changed = mode_changed;
+        mode_changed = 0;
+        woken = 0;
+        m = mode;
+        pthread_mutex_unlock(&mutex);
+
+        // 새로 생긴 교차로를 예약한다 (교차로는 지워지지 않으므로 복사한 포인터를 밖에서 써도 된다)
+        pthread_mutex_lock(&conn_mutex);
+        n = registry_size() > scheduled ? registry_intersections(&xs, &xs_cap) : scheduled;
+        now = what_time_is_it_now();
+        if (changed)
+            for (i = 0; i < scheduled; i++)
+                restart(xs[i], now);
+        for (i = scheduled; i < n; i++)
+            restart(xs[i], now);
+        pthread_mutex_unlock(&conn_mutex);
+        scheduled = n;
+
+        now = what_time_is_it_now();
+        while ((t = scheduler_pop(&sched, now)) != NULL)
+            fire(t->data, t->when, m);
+    }
+    return 0;
+}
+
+void controller_start(int m) {
+    pthread_condattr_t attr;
+    pthread_t thread;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_lock(&mutex);
+    mode = m;
+    mode_changed = 1;       // 첫 대기 없이 있는 교차로부터 예약
+    started = 1;
+    pthread_mutex_unlock(&mutex);
+
+    if (pthread_create(&thread, NULL, controller_main, NULL) != 0) {
+        printf("[SIGNAL] 신호 제어 쓰레드 생성에 실패했습니다.\n");
+        exit(0);
+    }
+    pthread_detach(thread);
+}
+
+void controller_wake() {
+    pthread_mutex_lock(&mutex);
+    woken = 1;
+    if (started)
+        pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+int controller_mode() {
+    int m;
+    pthread_mutex_lock(&mutex);
+    m = mode;
+    pthread_mutex_unlock(&mutex);
+    return m;
+}
+
+void controller_set_mode(int m) {
+    pthread_mutex_lock(&mutex);
+    mode = m;
+    mode_changed = 1;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+#define SIM_POLL_FAST 0.0003    // 예전 polling 루프의 usleep(300)
+
+static double cpu_seconds() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+static void sleep_until(double when) {
+    struct timespec ts;
+    ts.tv_sec = (time_t) when;
+    ts.tv_nsec = (long) ((when - (time_t) when) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static int double_comparator(const void* pa, const void* pb) {
+    double a = *(const double*) pa, b = *(const double*) pb;
+    return (a > b) - (a < b);
+}
+
+/* 전환 하나: 차량 수를 새로 뽑고 (분석 결과 대신) 다음 신호 길이를 돌려준다. 늦은 시간을 기록한다 */
+static double sim_fire(Intersection* x, double due, double* late, int* n, int cap) {
+    int i;
+    if (*n < cap)
+        late[(*n)++] = what_time_is_it_now() - due;
+    for (i = 0; i < NUM_OF_APPROACH; i++)
+        x->lights[i].front = rand() % 8;
+    return traffic_normal_mode(x, DAY_SIGNAL_TIME, DAY_ORANGE_TIME);
+}
+
+/* 교차로 전환 시각을 신호 한 주기 안에 고르게 흩어 둔다 */
+static void sim_reset(Intersection* xs, int n, double start) {
+    int i;
+    srand(0);
+    for (i = 0; i < n; i++) {
+        memset(&xs[i].ctl, 0, sizeof (TrafficController));
+        xs[i].ctl.timer.data = &xs[i];
+        xs[i].ctl.phase_end = start + rand_uniform(0, DAY_SIGNAL_TIME);
+    }
+}
+
+static void sim_report(const char* method, double* late, int n, double cpu, double wall) {
+    qsort(late, n, sizeof (double), double_comparator);
+    printf("%-11s %11d %9.3f %9.3f %9.3f %7.2f%%\n", method, n,
+            n ? 1000 * late[n / 2] : 0, n ? 1000 * late[(int) (n * .99)] : 0, n ? 1000 * late[n - 1] : 0,
+            100 * cpu / wall);
+}
+
+void test_controller(int num, double seconds) {
+    Intersection* xs = calloc(num, sizeof (Intersection));
+    double polls[] = {SIM_POLL_FAST, 1.0};
+    int cap = num * (int) (seconds + 1), n, i, p;
+    double* late = calloc(cap, sizeof (double));
+    double start, end, cpu;
+    Scheduler s = {0};
+    Timer* t;
+    char method[32];
+
+    for (i = 0; i < num; i++) {
+        sprintf(xs[i].id, "sim%d", i);
+        xs[i].index = i;
+    }
+    printf("신호 제어 시뮬레이션: 교차로 %d개, %.0f초씩, 주간 신호 (%d초 + 차량 수, 주황불 %d초)\n",
+            num, seconds, DAY_SIGNAL_TIME, DAY_ORANGE_TIME);
+    printf("%-11s %11s %9s %9s %9s %8s\n", "method", "transitions", "p50 ms", "p99 ms", "max ms", "CPU");
+
+    // scheduler: 가장 이른 전환 시각까지 잔다
+    start = what_time_is_it_now();
+    end = start + seconds;
+    sim_reset(xs, num, start);
+    for (i = 0; i < num; i++)
+        schedule_at(&s, &xs[i].ctl.timer, xs[i].ctl.phase_end);
+    n = 0;
+    cpu = cpu_seconds();
+    while ((t = scheduler_next(&s)) != NULL && t->when < end) {
+        sleep_until(t->when);
+        while ((t = scheduler_pop(&s, what_time_is_it_now())) != NULL)
+            schedule_at(&s, t, t->when + sim_fire(t->data, t->when, late, &n, cap));
+    }
+    sleep_until(end);
+    sim_report("min-heap", late, n, cpu_seconds() - cpu, what_time_is_it_now() - start);
+    scheduler_free(&s);
+
+    // 기존 방식: 주기마다 모든 교차로의 시간을 확인한다
+    for (p = 0; p < sizeof (polls) / sizeof (polls[0]); p++) {
+        start = what_time_is_it_now();
+        end = start + seconds;
+        sim_reset(xs, num, start);
+        n = 0;
+        cpu = cpu_seconds();
+        while (what_time_is_it_now() < end) {
+            sleep_until(what_time_is_it_now() + polls[p]);
+            for (i = 0; i < num; i++) {
+                TrafficController* c = &xs[i].ctl;
+                if (what_time_is_it_now() >= c->phase_end)
+                    c->phase_end += sim_fire(&xs[i], c->phase_end, late, &n, cap);
+            }
+        }
+        sprintf(method, "poll %gms", 1000 * polls[p]);
+        sim_report(method, late, n, cpu_seconds() - cpu, what_time_is_it_now() - start);
+    }
+    free(late);
+    free(xs);
+}
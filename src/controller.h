@@ -0,0 +1,35 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include "registry.h"
+
+enum { CONTROLLER_NORMAL, CONTROLLER_NIGHT };
+
+#define DAY_SIGNAL_TIME 20      // 주간 기본 신호 시간 (초), 차량 수에 따라 -5..+10초
+#define DAY_ORANGE_TIME 5
+#define NIGHT_SIDE_TIME 10      // 야간 동서 신호 시간 (초)
+#define NIGHT_ORANGE_TIME 3
+#define NIGHT_CHECK_TIME 1.0    // 야간 남북 신호 중 동서 차량을 다시 보는 주기 (초)
+
+/* 교차로 x의 신호를 한 단계 넘기고 (LED 변경) 새 신호를 유지할 시간(초)을 돌려준다.
+ * 신호 상태는 x->ctl에 있다. conn_mutex를 잡고 호출 */
+double traffic_normal_mode(Intersection* x, int default_time, int default_orange);
+double traffic_night_mode(Intersection* x, int side_time, int default_orange);
+
+/* 교차로 상태를 올린다. 상태는 status.json 하나로, -txt_sink이면 global.txt도 */
+void publish_cycle(Intersection* x);
+
+/* 신호 제어 쓰레드
+ * 교차로마다 다음 신호 전환 시각을 min-heap(scheduler.h)에 걸어 두고, 가장 이른 시각까지 잠들었다가
+ * 그 교차로만 넘긴다. 분석 주기와 상관없이 ms 단위로 전환하고, 교차로 수가 늘어도 깨어나는 횟수는 전환 횟수뿐이다 */
+void controller_start(int mode);
+/* 주간/야간 전환. 모든 교차로를 처음 신호부터 다시 시작한다 */
+void controller_set_mode(int mode);
+int controller_mode();
+/* 새 교차로가 생겼을 수 있다 (신호등 연결 시). 예약할 전환이 없으면 쓰레드는 이것을 기다린다 */
+void controller_wake();
+
+/* 교차로 n개 (차량 수는 난수) 시뮬레이션: scheduler와 기존 polling의 전환 지연(jitter)과 CPU 사용률 비교 */
+void test_controller(int intersections, double seconds);
+
+#endif /* CONTROLLER_H */
@@ -5,6 +5,10 @@
 #include "col2im.h"
 #include "blas.h"
 #include "gemm.h"
+#include "winograd.h"
+#include "quantize.h"
+#include "xnor_gemm.h"
+#include "parser.h"
 #include <stdio.h>
 #include <time.h>
 
@@ -132,7 +136,48 @@ size_t get_workspace_size(layer l){
         return most;
     }
     #endif
-    return (size_t)l.out_h*l.out_w*l.size*l.size*l.c*sizeof(float);
+    size_t s = (size_t)l.out_h*l.out_w*l.size*l.size*l.c*sizeof(float);
+    if(l.conv_algo == CONV_WINOGRAD){
+        size_t w = winograd_workspace_size(l.h, l.w, l.c, l.n, l.pad);
+        if(w > s) s = w;
+    }
+    if(l.conv_algo == CONV_XNOR){
+        size_t w = xnor_workspace_size(l.h, l.w, l.c, l.size, l.out_h, l.out_w);
+        if(w > s) s = w;
+    }
+    // INT8 경로 (quantize.c): u8 입력 뒤에 u8 im2col. quantized는 레이어를 만든 뒤에 정해지므로 항상 잡아 둔다
+    // (1x1 stride 2 등 출력이 입력보다 작으면 float im2col보다 크다)
+    {
+        size_t q = (size_t)l.c*l.h*l.w + (size_t)l.size*l.size*l.c*l.out_h*l.out_w;
+        if(q > s) s = q;
+    }
+    return s;
+}
+
+/* 추론 경로 선택 (bench_conv로 레이어별 비교)
+ * 1x1 stride 1은 im2col 결과가 입력과 같으므로 입력에 바로 gemm,
+ * 3x3 stride 1은 Winograd F(2x2,3x3). 단 채널이 너무 적으면 gemm이 얇아서 im2col이 빠르고,
+ * 출력이 작으면 (13x13 등) 타일 위치 16개마다 weight를 다시 pack하는 비용 때문에 이득이 거의 없는데
+ * 변환된 weight(원래의 16/9배)는 채널이 많은 이 레이어들에서 가장 크다.
+ * xnor 레이어는 bit로 pack해서 XNOR + popcount gemm (bench_xnor로 float gemm과 비교) */
+CONV_ALGO select_conv_algo(convolutional_layer l)
+{
+    if(l.xnor) return CONV_XNOR;
+    if(l.binary) return CONV_IM2COL;
+    if(l.size == 1 && l.stride == 1 && l.pad == 0) return CONV_1X1;
+    if(l.size == 3 && l.stride == 1 && l.c >= 16 && l.out_h*l.out_w >= 400) return CONV_WINOGRAD;
+    return CONV_IM2COL;
+}
+
+/* weight가 바뀐 뒤 (로드, 초기화) 호출. Winograd 레이어는 변환된 weight를, xnor 레이어는 bit weight를 다시 만든다 */
+void transform_convolutional_weights(convolutional_layer l)
+{
+    if(l.winograd_weights){
+        winograd_transform_weights(l.weights, l.n, l.c, l.winograd_weights);
+    }
+    if(l.xnor_weights){
+        xnor_pack_weights(l.weights, l.n, l.c, l.size, l.xnor_weights, l.xnor_alpha, l.xnor_tap_pop);
+    }
 }
 
 #ifdef GPU
@@ -217,7 +262,7 @@ void cudnn_convolutional_setup(layer *l, int cudnn_preference)
 #endif
 #endif
 
-convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int n, int size, int stride, int padding, ACTIVATION activation, int batch_normalize, int binary, int xnor, int adam)
+convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int n, int size, int stride, int padding, ACTIVATION activation, int batch_normalize, int binary, int xnor, int adam, int train)
 {
     int i;
     convolutional_layer l = {0};
@@ -236,14 +281,19 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
     l.batch_normalize = batch_normalize;
 
     l.weights = calloc(c*n*size*size, sizeof(float));
-    l.weight_updates = calloc(c*n*size*size, sizeof(float));
-
     l.biases = calloc(n, sizeof(float));
-    l.bias_updates = calloc(n, sizeof(float));
+    // 추론 전용(train = 0)이면 delta, *_updates, x, x_norm 같은 학습용 버퍼는 만들지 않는다
+    if(train){
+        l.weight_updates = calloc(c*n*size*size, sizeof(float));
+        l.bias_updates = calloc(n, sizeof(float));
+    }
 
-    // float scale = 1./sqrt(size*size*c);
-    float scale = sqrt(2./(size*size*c));
-    for(i = 0; i < c*n*size*size; ++i) l.weights[i] = scale*rand_uniform(-1, 1);
+    // 추론 전용이면 weight는 load_weights나 컴파일된 모델에서 채우므로 (Winograd, XNOR 변환도 그때 한다) 난수로 초기화하지 않는다
+    if(train){
+        // float scale = 1./sqrt(size*size*c);
+        float scale = sqrt(2./(size*size*c));
+        for(i = 0; i < c*n*size*size; ++i) l.weights[i] = scale*rand_uniform(-1, 1);
+    }
     int out_h = convolutional_out_height(l);
     int out_w = convolutional_out_width(l);
     l.out_h = out_h;
@@ -253,7 +303,7 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
     l.inputs = l.w * l.h * l.c;
 
     l.output = calloc(l.batch*l.outputs, sizeof(float));
-    l.delta  = calloc(l.batch*l.outputs, sizeof(float));
+    if(train) l.delta = calloc(l.batch*l.outputs, sizeof(float));
 
     l.forward = forward_convolutional_layer;
     l.backward = backward_convolutional_layer;
@@ -270,7 +320,6 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
 
     if(batch_normalize){
         l.scales = calloc(n, sizeof(float));
-        l.scale_updates = calloc(n, sizeof(float));
         for(i = 0; i < n; ++i){
             l.scales[i] = 1;
         }
@@ -278,15 +327,17 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
         l.mean = calloc(n, sizeof(float));
         l.variance = calloc(n, sizeof(float));
 
-        l.mean_delta = calloc(n, sizeof(float));
-        l.variance_delta = calloc(n, sizeof(float));
-
         l.rolling_mean = calloc(n, sizeof(float));
         l.rolling_variance = calloc(n, sizeof(float));
-        l.x = calloc(l.batch*l.outputs, sizeof(float));
-        l.x_norm = calloc(l.batch*l.outputs, sizeof(float));
+        if(train){
+            l.scale_updates = calloc(n, sizeof(float));
+            l.mean_delta = calloc(n, sizeof(float));
+            l.variance_delta = calloc(n, sizeof(float));
+            l.x = calloc(l.batch*l.outputs, sizeof(float));
+            l.x_norm = calloc(l.batch*l.outputs, sizeof(float));
+        }
     }
-    if(adam){
+    if(adam && train){
         l.adam = 1;
         l.m = calloc(c*n*size*size, sizeof(float));
         l.v = calloc(c*n*size*size, sizeof(float));
@@ -313,7 +364,7 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
         l.biases_gpu = cuda_make_array(l.biases, n);
         l.bias_updates_gpu = cuda_make_array(l.bias_updates, n);
 
-        l.delta_gpu = cuda_make_array(l.delta, l.batch*out_h*out_w*n);
+        if(train) l.delta_gpu = cuda_make_array(l.delta, l.batch*out_h*out_w*n);
         l.output_gpu = cuda_make_array(l.output, l.batch*out_h*out_w*n);
 
         if(binary){
@@ -352,6 +403,16 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
 #endif
     }
 #endif
+    l.conv_algo = select_conv_algo(l);
+    if(l.conv_algo == CONV_WINOGRAD){
+        l.winograd_weights = calloc(winograd_weights_size(n, c), sizeof(float));
+    }
+    if(l.conv_algo == CONV_XNOR){
+        l.xnor_weights = calloc(xnor_weights_size(n, c, size), sizeof(uint64_t));
+        l.xnor_alpha = calloc(n, sizeof(float));
+        l.xnor_tap_pop = calloc(n*size*size, sizeof(int));
+    }
+    if(train) transform_convolutional_weights(l);
     l.workspace_size = get_workspace_size(l);
     l.activation = activation;
 
@@ -360,6 +421,29 @@ convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int
     return l;
 }
 
+/* 추론 전용 (로드 직후 한 번): batchnorm의 rolling_mean, rolling_variance, scales를 weight와 bias에 접고
+ * forward에서 bias와 activation을 gemm 출력 단계에서 적용하게 한다.
+ * 접은 뒤에는 학습하거나 weight를 저장하면 안 된다. activation이 LINEAR, LEAKY가 아니면 그대로 둔다 */
+void fuse_convolutional_layer(convolutional_layer *l)
+{
+    int i, j;
+    int size = l->c*l->size*l->size;
+    if(l->fused || l->binary || l->xnor) return;
+    if(l->activation != LINEAR && l->activation != LEAKY) return;
+    if(l->batch_normalize){
+        for(i = 0; i < l->n; ++i){
+            // normalize_cpu와 같은 식: (x - mean)/(sqrt(var) + .000001f) * scale + bias
+            float s = l->scales[i]/(sqrt(l->rolling_variance[i]) + .000001f);
+            for(j = 0; j < size; ++j){
+                l->weights[i*size + j] *= s;
+            }
+            l->biases[i] -= l->rolling_mean[i]*s;
+        }
+    }
+    l->fused = 1;
+    transform_convolutional_weights(*l);
+}
+
 void denormalize_convolutional_layer(convolutional_layer l)
 {
     int i, j;
@@ -377,7 +461,7 @@ void denormalize_convolutional_layer(convolutional_layer l)
 
 void test_convolutional_layer()
 {
-    convolutional_layer l = make_convolutional_layer(1, 5, 5, 3, 2, 5, 2, 1, LEAKY, 1, 0, 0, 0);
+    convolutional_layer l = make_convolutional_layer(1, 5, 5, 3, 2, 5, 2, 1, LEAKY, 1, 0, 0, 0, 1);
     l.batch_normalize = 1;
     float data[] = {1,1,1,1,1,
         1,1,1,1,1,
@@ -456,30 +540,46 @@ void resize_convolutional_layer(convolutional_layer *l, int w, int h)
 #endif
 }
 
-void add_bias(float *output, float *biases, int batch, int n, int size)
+typedef struct {
+    float *output, *values;
+    int n, size;
+} bias_args;
+
+/* (batch, 필터) 쌍 [begin, end) */
+static void add_bias_range(void *arg, int begin, int end)
 {
-    int i,j,b;
-    for(b = 0; b < batch; ++b){
-        for(i = 0; i < n; ++i){
-            for(j = 0; j < size; ++j){
-                output[(b*n + i)*size + j] += biases[i];
-            }
-        }
+    bias_args *p = (bias_args *)arg;
+    int bi, j;
+    for(bi = begin; bi < end; ++bi){
+        float *out = p->output + (size_t)bi*p->size;
+        float v = p->values[bi % p->n];
+        for(j = 0; j < p->size; ++j) out[j] += v;
     }
 }
 
-void scale_bias(float *output, float *scales, int batch, int n, int size)
+static void scale_bias_range(void *arg, int begin, int end)
 {
-    int i,j,b;
-    for(b = 0; b < batch; ++b){
-        for(i = 0; i < n; ++i){
-            for(j = 0; j < size; ++j){
-                output[(b*n + i)*size + j] *= scales[i];
-            }
-        }
+    bias_args *p = (bias_args *)arg;
+    int bi, j;
+    for(bi = begin; bi < end; ++bi){
+        float *out = p->output + (size_t)bi*p->size;
+        float v = p->values[bi % p->n];
+        for(j = 0; j < p->size; ++j) out[j] *= v;
     }
 }
 
+void add_bias(float *output, float *biases, int batch, int n, int size)
+{
+    bias_args args = {output, biases, n, size};
+    parallel_for(batch*n, PARALLEL_GRAIN(size), add_bias_range, &args);
+}
+
+void scale_bias(float *output, float *scales, int batch, int n, int size)
+{
+    bias_args args = {output, scales, n, size};
+    parallel_for(batch*n, PARALLEL_GRAIN(size), scale_bias_range, &args);
+}
+
 void backward_bias(float *bias_updates, float *delta, int batch, int n, int size)
 {
     int i,b;
@@ -495,10 +595,19 @@ void forward_convolutional_layer(convolutional_layer l, network_state state)
     int out_h = convolutional_out_height(l);
     int out_w = convolutional_out_width(l);
     int i;
+    // batchnorm이 접힌 레이어는 gemm(또는 Winograd 출력 변환)이 출력을 덮어쓰면서 bias, activation까지 적용
+    int fused = l.fused && !state.train;
+    // 추론에서는 로드할 때 pack한 bit weight로 XNOR + popcount gemm (학습 중에는 weight가 바뀌므로 float)
+    int xnor_packed = l.conv_algo == CONV_XNOR && !state.train && l.xnor_weights;
+
+    if(l.quantized && fused){
+        forward_convolutional_layer_int8(l, state);
+        return;
+    }
 
-    fill_cpu(l.outputs*l.batch, 0, l.output, 1);
+    if(!fused && !xnor_packed) fill_cpu(l.outputs*l.batch, 0, l.output, 1);
 
-    if(l.xnor){
+    if(l.xnor && !xnor_packed){
         binarize_weights(l.weights, l.n, l.c*l.size*l.size, l.binary_weights);
         swap_binary(&l);
         binarize_cpu(state.input, l.c*l.h*l.w*l.batch, l.binary_input);
@@ -515,12 +624,27 @@ void forward_convolutional_layer(convolutional_layer l, network_state state)
     float *c = l.output;
 
     for(i = 0; i < l.batch; ++i){
-        im2col_cpu(state.input, l.c, l.h, l.w, 
-                l.size, l.stride, l.pad, b);
-        gemm(0,0,m,n,k,1,a,k,b,n,1,c,n);
+        if(xnor_packed){
+            xnor_convolve(state.input, l.c, l.h, l.w, l.size, l.stride, l.pad,
+                    l.xnor_weights, l.xnor_alpha, l.xnor_tap_pop, l.n, c, b);
+        }else if(l.conv_algo == CONV_WINOGRAD && !state.train && l.winograd_weights){
+            // 학습 중에는 weight가 계속 바뀌므로 im2col
+            winograd_convolve(state.input, l.c, l.h, l.w, l.pad, l.winograd_weights, l.n, c, b,
+                    fused ? l.biases : 0, fused ? l.activation : LINEAR);
+        }else{
+            if(l.conv_algo == CONV_1X1){
+                b = state.input;
+            }else{
+                im2col_cpu(state.input, l.c, l.h, l.w, 
+                        l.size, l.stride, l.pad, b);
+            }
+            if(fused) gemm_nn_fused(m,n,k,a,k,b,n,c,n,l.biases,l.activation);
+            else gemm(0,0,m,n,k,1,a,k,b,n,1,c,n);
+        }
         c += n*m;
         state.input += l.c*l.h*l.w;
     }
+    if(fused) return;
 
     if(l.batch_normalize){
         forward_batchnorm_layer(l, state);
@@ -644,3 +768,139 @@ image *visualize_convolutional_layer(convolutional_layer l, char *window, image
     return single_weights;
 }
 
+
+static double time_convolutional_layer(convolutional_layer l, CONV_ALGO algo, network_state state, int iters)
+{
+    int i;
+    double start;
+    l.conv_algo = algo;
+    start = what_time_is_it_now();
+    for(i = 0; i < iters; ++i){
+        forward_convolutional_layer(l, state);
+    }
+    return (what_time_is_it_now() - start) / iters;
+}
+
+/* cfg의 convolutional 레이어마다 im2col+gemm과 1x1 direct / Winograd 경로의 시간과 오차를 비교한다.
+ * 오차는 im2col 결과 대비 최대 상대 오차, *는 레이어를 만들 때 선택된 경로 */
+void test_convolutional_algos(char *cfgfile, int iters)
+{
+    network net = parse_network_cfg(cfgfile);
+    double sum[3] = {0}, sum_selected = 0;
+    int i;
+
+    if(iters < 1) iters = 1;
+    printf("\n%s, %d iterations\n", cfgfile, iters);
+    printf("layer  size      input        ->  output      | im2col ms |   1x1 ms  err     | winograd ms  err\n");
+    for(i = 0; i < net.n; ++i){
+        convolutional_layer l = net.layers[i];
+        network_state state = {0};
+        size_t workspace_size;
+        float *expect, *t_wino = 0;
+        double t[3];
+        float err[3] = {0};
+        int j, outputs;
+        // xnor 레이어는 bench_xnor
+        if(l.type != CONVOLUTIONAL || l.xnor) continue;
+
+        l.batch = 1;
+        outputs = l.out_h*l.out_w*l.n;
+        workspace_size = get_workspace_size(l);
+        if(winograd_workspace_size(l.h, l.w, l.c, l.n, l.pad) > workspace_size){
+            workspace_size = winograd_workspace_size(l.h, l.w, l.c, l.n, l.pad);
+        }
+        state.workspace = calloc(1, workspace_size);
+        state.input = calloc(l.inputs, sizeof(float));
+        for(j = 0; j < l.inputs; ++j) state.input[j] = rand_uniform(-1, 1);
+        expect = calloc(outputs, sizeof(float));
+        if(l.size == 3 && l.stride == 1 && !l.winograd_weights){
+            t_wino = calloc(winograd_weights_size(l.n, l.c), sizeof(float));
+            l.winograd_weights = t_wino;
+            transform_convolutional_weights(l);
+        }
+
+        for(j = 0; j < 3; ++j){
+            t[j] = -1;
+            if(j == CONV_1X1 && !(l.size == 1 && l.stride == 1 && l.pad == 0)) continue;
+            if(j == CONV_WINOGRAD && !l.winograd_weights) continue;
+            time_convolutional_layer(l, j, state, 1);
+            if(j == CONV_IM2COL) memcpy(expect, l.output, outputs*sizeof(float));
+            else err[j] = max_rel_diff(expect, l.output, outputs);
+            t[j] = time_convolutional_layer(l, j, state, iters);
+            sum[j] += t[j];
+        }
+        if(t[CONV_1X1] < 0) sum[CONV_1X1] += t[CONV_IM2COL];
+        if(t[CONV_WINOGRAD] < 0) sum[CONV_WINOGRAD] += t[CONV_IM2COL];
+        sum_selected += t[net.layers[i].conv_algo];
+
+        printf("%5d  %dx%d/%d %4d x%4d x%4d -> %4d x%4d x%4d | %9.2f |",
+                i, l.size, l.size, l.stride, l.w, l.h, l.c, l.out_w, l.out_h, l.n, t[CONV_IM2COL]*1000);
+        if(t[CONV_1X1] >= 0) printf(" %8.2f  %.1e%s |", t[CONV_1X1]*1000, err[CONV_1X1], net.layers[i].conv_algo == CONV_1X1 ? "*" : " ");
+        else printf("        -          |");
+        if(t[CONV_WINOGRAD] >= 0) printf(" %11.2f  %.1e%s\n", t[CONV_WINOGRAD]*1000, err[CONV_WINOGRAD], net.layers[i].conv_algo == CONV_WINOGRAD ? "*" : "");
+        else printf("           -\n");
+
+        free(state.workspace);
+        free(state.input);
+        free(expect);
+        if(t_wino) free(t_wino);
+    }
+    printf("total (conv layers): im2col %.2f ms, selected %.2f ms (%.2fx)\n",
+            sum[CONV_IM2COL]*1000, sum_selected*1000, sum[CONV_IM2COL]/sum_selected);
+    free_network(net);
+}
+
+/* cfg의 convolutional 레이어 모양마다 float conv (선택된 경로), 기존 xnor (binarize + float gemm),
+ * bit pack + XNOR popcount gemm의 시간을 비교한다. 오차는 기존 xnor 결과 대비 최대 상대 오차 */
+void test_xnor_convolution(char *cfgfile, int iters)
+{
+    network net = parse_network_cfg(cfgfile);
+    double sum[3] = {0};
+    int i, j;
+
+    if(iters < 1) iters = 1;
+    printf("\n%s, %d iterations\n", cfgfile, iters);
+    printf("layer  size      input        ->  output      |  float ms | xnor(float) ms | xnor(bit) ms  speedup  err\n");
+    for(i = 0; i < net.n; ++i){
+        layer *src = net.layers + i;
+        convolutional_layer f, x;
+        network_state state = {0};
+        size_t workspace_size;
+        float *expect;
+        double t[3];
+        float err;
+        if(src->type != CONVOLUTIONAL) continue;
+
+        f = make_convolutional_layer(1, src->h, src->w, src->c, src->n, src->size, src->stride, src->pad, LINEAR, 0, 0, 0, 0, 1);
+        x = make_convolutional_layer(1, src->h, src->w, src->c, src->n, src->size, src->stride, src->pad, LINEAR, 0, 0, 1, 0, 1);
+        workspace_size = get_workspace_size(f);
+        if(get_workspace_size(x) > workspace_size) workspace_size = get_workspace_size(x);
+        state.workspace = calloc(1, workspace_size);
+        state.input = calloc(f.inputs, sizeof(float));
+        for(j = 0; j < f.inputs; ++j) state.input[j] = rand_uniform(-1, 1);
+        expect = calloc(x.outputs, sizeof(float));
+
+        time_convolutional_layer(f, f.conv_algo, state, 1);
+        t[0] = time_convolutional_layer(f, f.conv_algo, state, iters);
+        time_convolutional_layer(x, CONV_IM2COL, state, 1);
+        memcpy(expect, x.output, x.outputs*sizeof(float));
+        t[1] = time_convolutional_layer(x, CONV_IM2COL, state, iters);
+        time_convolutional_layer(x, CONV_XNOR, state, 1);
+        err = max_rel_diff(expect, x.output, x.outputs);
+        t[2] = time_convolutional_layer(x, CONV_XNOR, state, iters);
+        for(j = 0; j < 3; ++j) sum[j] += t[j];
+
+        printf("%5d  %dx%d/%d %4d x%4d x%4d -> %4d x%4d x%4d | %9.2f | %14.2f | %12.2f  %6.1fx  %.1e\n",
+                i, f.size, f.size, f.stride, f.w, f.h, f.c, f.out_w, f.out_h, f.n,
+                t[0]*1000, t[1]*1000, t[2]*1000, t[0]/t[2], err);
+
+        free(state.workspace);
+        free(state.input);
+        free(expect);
+        free_layer(f);
+        free_layer(x);
+    }
+    printf("total (conv layers): float %.2f ms, xnor(float) %.2f ms, xnor(bit) %.2f ms (float 대비 %.1fx)\n",
+            sum[0]*1000, sum[1]*1000, sum[2]*1000, sum[0]/sum[2]);
+    free_network(net);
+}
@@ -25,8 +25,13 @@ void cuda_convert_f32_to_f16(float* input_f32, size_t size, float *output_f16);
 #endif
 #endif
 
-convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int n, int size, int stride, int padding, ACTIVATION activation, int batch_normalize, int binary, int xnor, int adam);
+convolutional_layer make_convolutional_layer(int batch, int h, int w, int c, int n, int size, int stride, int padding, ACTIVATION activation, int batch_normalize, int binary, int xnor, int adam, int train);
 void denormalize_convolutional_layer(convolutional_layer l);
+CONV_ALGO select_conv_algo(convolutional_layer l);
+void transform_convolutional_weights(convolutional_layer l);
+void fuse_convolutional_layer(convolutional_layer *l);
+void test_convolutional_algos(char *cfgfile, int iters);
+void test_xnor_convolution(char *cfgfile, int iters);
 void resize_convolutional_layer(convolutional_layer *layer, int w, int h);
 void forward_convolutional_layer(const convolutional_layer layer, network_state state);
 void update_convolutional_layer(convolutional_layer layer, int batch, float learning_rate, float momentum, float decay);
@@ -8,6 +8,20 @@
 #include "option_list.h"
 #include "server.h"
 #include "traffic.h"
+#include "archiver.h"
+#include "publisher.h"
+#include "preprocess.h"
+#include "postprocess.h"
+#include "alloc_stats.h"
+#include "registry.h"
+#include "roi.h"
+#include "controller.h"
+#include "control.h"
+#include "gemm.h"
+#include "convolutional_layer.h"
+#include "quantize.h"
+#include "compiled_model.h"
+#include <signal.h>
 
 #ifdef OPENCV
 #include "opencv2/highgui/highgui_c.h"
@@ -549,34 +563,33 @@ int detections_comparator(const void *pa, const void *pb) {
     return 0;
 }
 
-void validate_detector_map(char *datacfg, char *cfgfile, char *weightfile,
-        float thresh_calc_avg_iou) {
+/* validate_detector_map 본문: net으로 datacfg의 valid 목록을 평가해 mAP를 반환한다.
+ * predict_time이 있으면 이미지 한 장당 network_predict 평균 시간(초)을 넣는다 */
+static float detector_map(char *datacfg, network net, float thresh_calc_avg_iou, double *predict_time) {
     int j;
     list *options = read_data_cfg(datacfg);
     char *valid_images = option_find_str(options, "valid", "data/train.txt");
     char *difficult_valid_images = option_find_str(options, "difficult", NULL);
     char *name_list = option_find_str(options, "names", "data/names.list");
-    char **names = get_labels(name_list);
+    list *nlist = get_paths(name_list);
+    int num_names = nlist->size;
+    char **names = (char **) list_to_array(nlist);
     char *mapf = option_find_str(options, "map", 0);
     int *map = 0;
     if (mapf)
         map = read_map(mapf);
 
-    network net = parse_network_cfg_custom(cfgfile, 1);
-    if (weightfile) {
-        load_weights(&net, weightfile);
-    }
-    set_batch_network(&net, 1);
-    fprintf(stderr, "Learning Rate: %g, Momentum: %g, Decay: %g\n",
-            net.learning_rate, net.momentum, net.decay);
     srand(time(0));
 
     list *plist = get_paths(valid_images);
     char **paths = (char **) list_to_array(plist);
 
+    free_list(nlist);
+
+    list *plist_dif = NULL;
     char **paths_dif = NULL;
     if (difficult_valid_images) {
-        list *plist_dif = get_paths(difficult_valid_images);
+        plist_dif = get_paths(difficult_valid_images);
         paths_dif = (char **) list_to_array(plist_dif);
     }
 
@@ -618,6 +631,7 @@ void validate_detector_map(char *datacfg, char *cfgfile, char *weightfile,
     int unique_truth_count = 0;
 
     int *truth_classes_count = calloc(classes, sizeof (int));
+    double predict_sum = 0;
 
     for (t = 0; t < nthreads; ++t) {
         args.path = paths[i + t];
@@ -644,7 +658,9 @@ void validate_detector_map(char *datacfg, char *cfgfile, char *weightfile,
             char *path = paths[image_index];
             char *id = basecfg(path);
             float *X = val_resized[t].data;
+            double predict_start = what_time_is_it_now();
             network_predict(net, X);
+            predict_sum += what_time_is_it_now() - predict_start;
             get_region_boxes(l, 1, 1, thresh, probs, boxes, 0, map);
             if (nms)
                 do_nms_sort(boxes, probs, l.w * l.h * l.n, classes, nms);
@@ -746,6 +762,8 @@ void validate_detector_map(char *datacfg, char *cfgfile, char *weightfile,
 
             unique_truth_count += num_labels;
 
+            free(truth);
+            free(truth_dif);
             free(id);
             free_image(val[t]);
             free_image(val_resized[t]);
@@ -870,8 +888,73 @@ void validate_detector_map(char *datacfg, char *cfgfile, char *weightfile,
     free(detections);
     free(truth_classes_count);
 
+    // 한 프로세스에서 여러 번 부른다 (map_int8)
+    free(boxes);
+    free_ptrs((void **) probs, l.w * l.h * l.n);
+    free(val);
+    free(val_resized);
+    free(buf);
+    free(buf_resized);
+    free(thr);
+    free(paths);
+    free_list_contents(plist);
+    free_list(plist);
+    if (plist_dif) {
+        free(paths_dif);
+        free_list_contents(plist_dif);
+        free_list(plist_dif);
+    }
+    free_ptrs((void **) names, num_names);
+    free(map);
+
     fprintf(stderr, "Total Detection Time: %f Seconds\n",
             (double) (time(0) - start));
+    if (predict_time)
+        *predict_time = m ? predict_sum / m : 0;
+    return mean_average_precision;
+}
+
+void validate_detector_map(char *datacfg, char *cfgfile, char *weightfile,
+        float thresh_calc_avg_iou) {
+    network net = parse_network_cfg_custom(cfgfile, 1);
+    if (weightfile) {
+        load_weights(&net, weightfile);
+    }
+    set_batch_network(&net, 1);
+    fprintf(stderr, "Learning Rate: %g, Momentum: %g, Decay: %g\n",
+            net.learning_rate, net.momentum, net.decay);
+    detector_map(datacfg, net, thresh_calc_avg_iou, 0);
+}
+
+/* 같은 valid 목록으로 FP32, FP32(batchnorm 접음), INT8(<weights>.int8)의 mAP와 forward 시간을 비교한다 */
+void validate_detector_map_int8(char *datacfg, char *cfgfile, char *weightfile,
+        float thresh_calc_avg_iou) {
+    char int8file[4096];
+    double t_fp32, t_fused, t_int8;
+    float map_fp32, map_fused, map_int8;
+    int quantized;
+
+    network net = parse_network_cfg_custom(cfgfile, 1);
+    load_weights(&net, weightfile);
+    set_batch_network(&net, 1);
+    sprintf(int8file, "%s.int8", weightfile);
+
+    map_fp32 = detector_map(datacfg, net, thresh_calc_avg_iou, &t_fp32);
+    fuse_network(&net);
+    map_fused = detector_map(datacfg, net, thresh_calc_avg_iou, &t_fused);
+    if ((quantized = load_int8_weights(&net, int8file)) < 0) {
+        printf("%s 를 읽을 수 없습니다. 먼저 %s quantize 로 만드세요.\n", int8file, weightfile);
+        free_network(net);
+        return;
+    }
+    map_int8 = detector_map(datacfg, net, thresh_calc_avg_iou, &t_int8);
+
+    printf("\n               mAP      forward (ms/img)  speedup\n");
+    printf(" FP32       %6.2f %%   %9.1f          1.00x\n", map_fp32 * 100, t_fp32 * 1000);
+    printf(" FP32 fused %6.2f %%   %9.1f          %.2fx\n", map_fused * 100, t_fused * 1000, t_fp32 / t_fused);
+    printf(" INT8       %6.2f %%   %9.1f          %.2fx   (conv %d개 INT8, mAP %+.2f %%p)\n",
+            map_int8 * 100, t_int8 * 1000, t_fp32 / t_int8, quantized, (map_int8 - map_fp32) * 100);
+    free_network(net);
 }
 
 #ifdef OPENCV
@@ -1047,104 +1130,250 @@ void calc_anchors(char *datacfg, int num_of_clusters, int final_width,
 #endif // OPENCV
 
 extern char SERVER_ID[BUFSIZE];
-extern TrafficLight* tls[NUM_OF_CLI];
-extern TrafficLight east, west, south, north;
 extern pthread_mutex_t conn_mutex;
 
-void get_detect_result(TrafficLight* tl, float thresh, char** names,
-        image** alphabet, network net) {
-    int j;
-    clock_t time;
-    char buff[256];
-    char *input = buff;
-    float nms = .4;
-
-    sprintf(input, "%s/%s/%s%d.jpg", FILE_DIR, SERVER_ID, tl->name,
-            tl->name_subfix);
-    if (input[strlen(input) - 1] == 0x0d)
-        input[strlen(input) - 1] = 0;
-
-    image im = load_image_color(input, 0, 0);
-    image sized = resize_image(im, net.w, net.h);
-    layer l = net.layers[net.n - 1];
+/* 분석 쓰레드가 매 주기 다시 쓰는 버퍼. 마지막 레이어 모양과 처음 받은 프레임 크기로 한 번 잡고,
+ * 이후 주기에는 heap을 쓰지 않는다 (더 큰 프레임이나 모양이 다른 모델로 바뀔 때만 다시 잡는다) */
+typedef struct {
+    int max_batch;          // net->input에 들어가는 입력 슬롯 수 (parse_network_cfg_custom에 준 배치 크기)
+    detections dets;
+    detections merged;      // 신호등 하나의 타일별 검출을 프레임 좌표로 모은 것
+    image* labels;          // [classes*8] class 이름 label 캐시
+    int classes;
+    float* draw;            // 결과 이미지 그리기용 float 버퍼
+    size_t draw_size;
+    Arena codec;            // JPEG 디코딩, 결과 JPEG 인코딩 임시 메모리 (주기마다 reset)
+
+    // 변화 없는 프레임 건너뛰기 (-skip_diff)
+    float skip_diff;        // thumbnail 밝기 차이가 이보다 작으면 지난 결과를 그대로 쓴다 (0이면 끔)
+    int skipped;            // 이번 주기에 건너뛴 프레임 수
+    unsigned int total_skipped, total_analyzed;
+    double predict_time;    // 분석한 프레임들의 forward 시간 합 (아낀 시간 추정용)
+} DetectContext;
+
+#define SKIP_MAX_FRAMES 10  // 변화가 없어도 연속으로 이만큼 건너뛰면 한 번은 분석한다
+
+/* 지난번에 분석한 프레임과 거의 같으면 1 (front/back/side/accident와 결과 이미지는 그대로 둔다).
+ * 분석할 프레임이면 thumbnail을 기준으로 남긴다 */
+static int skip_unchanged(DetectContext* ctx, TrafficLight* tl, const unsigned char* pixels, int w, int h) {
+    unsigned char thumb[THUMB_SIZE * THUMB_SIZE];
+
+    rgb8_thumbnail(pixels, w, h, 3, thumb);
+    if (tl->thumb_valid && tl->skipped < SKIP_MAX_FRAMES && thumbnail_diff(thumb, tl->thumb) < ctx->skip_diff) {
+        tl->skipped++;
+        ctx->skipped++;
+        return 1;
+    }
+    memcpy(tl->thumb, thumb, sizeof (thumb));
+    tl->thumb_valid = 1;
+    tl->skipped = 0;
+    return 0;
+}
 
-    box *boxes = calloc(l.w * l.h * l.n, sizeof (box));
-    float **probs = calloc(l.w * l.h * l.n, sizeof (float *));
-    for (j = 0; j < l.w * l.h * l.n; ++j)
-        probs[j] = calloc(l.classes, sizeof (float *));
+static void detect_context_fit(DetectContext* ctx, layer l) {
+    int i;
 
-    float *X = sized.data;
-    time = clock();
-    network_predict(net, X);
-    printf("[DETECT] image \'%s\' predicted in %f seconds.\n", tl->name,
-            sec(clock() - time));
-    get_region_boxes(l, 1, 1, thresh, probs, boxes, 0, 0);
-    if (nms)
-        do_nms_sort(boxes, probs, l.w * l.h * l.n, l.classes, nms);
-    get_detections(im, tl, l.w * l.h * l.n, thresh, boxes, probs, names,
-            alphabet, l.classes);
-
-    sprintf(input, "%s/%s/%s%d_result", FILE_DIR, SERVER_ID, tl->name,
-            tl->name_subfix);
-    save_image(im, input);
-
-    free_image(im);
-    free_image(sized);
-    free(boxes);
-    free_ptrs((void **) probs, l.w * l.h * l.n);
+    if (ctx->classes != l.classes) {
+        for (i = 0; i < ctx->classes * 8; i++)
+            free_image(ctx->labels[i]);
+        free(ctx->labels);
+        ctx->labels = calloc(l.classes * 8, sizeof (image));
+        ctx->classes = l.classes;
+    }
+    if (ctx->dets.boxes < l.w * l.h * l.n || ctx->dets.classes != l.classes) {
+        free_detections(&ctx->dets);
+        ctx->dets = make_detections(l.w * l.h * l.n, l.classes);
+        free_detections(&ctx->merged);
+        ctx->merged = make_detections(l.w * l.h * l.n * ROI_MAX_TILES, l.classes);
+    }
 }
 
-int writeTrafficLightInfo(TrafficLight* tl) {
-    FILE* fp = NULL;
-    char filename[BUFSIZE];
-    char content[BUFSIZE];
+static image detect_context_image(DetectContext* ctx, int w, int h, int c) {
+    size_t size = (size_t) w * h * c;
+    image im = make_empty_image(w, h, c);
 
-    sprintf(filename, "%s/%s/%s%d_result.jpg", FILE_DIR, SERVER_ID, tl->name,
-            tl->name_subfix);
-    if (isImage(filename) == 0) {
-        printf("[%s] Can not load image\n", tl->name);
-        return -1;
+    if (size > ctx->draw_size) {
+        free(ctx->draw);
+        ctx->draw = malloc(size * sizeof (float));
+        ctx->draw_size = size;
     }
-    if (upload_file(filename) == -1)
-        return -1;
+    im.data = ctx->draw;
+    return im;
+}
 
-    sprintf(filename, "%s/%s/%s.txt", FILE_DIR, SERVER_ID, tl->name);
-    if ((fp = fopen(filename, "w")) == NULL) {
-        printf("[%s] file open error\n", tl->name);
-        return -1;
+/* 여러 타일로 나눠 분석한 신호등: 타일 경계에서 두 번 잡힌 차를 같은 class끼리 NMS로 하나만 남긴다 */
+static void suppress_tile_overlaps(detections* d, float nms) {
+    int i, j, m = 0;
+
+    for (i = 0; i < d->n; i++) {
+        box a = {d->x[i], d->y[i], d->w[i], d->h[i]};
+        for (j = 0; j < d->n && d->prob[i] > 0; j++) {
+            box b = {d->x[j], d->y[j], d->w[j], d->h[j]};
+            if (j != i && d->class_id[j] == d->class_id[i] && d->prob[j] > 0
+                    && (d->prob[j] > d->prob[i] || (d->prob[j] == d->prob[i] && j < i))
+                    && box_iou(a, b) > nms)
+                d->prob[i] = 0;
+        }
+    }
+    for (i = 0; i < d->n; i++) {
+        if (d->prob[i] == 0)
+            continue;
+        d->class_id[m] = d->class_id[i];
+        d->prob[m] = d->prob[i];
+        d->x[m] = d->x[i];
+        d->y[m] = d->y[i];
+        d->w[m] = d->w[i];
+        d->h[m] = d->h[i];
+        m++;
     }
+    d->n = m;
+}
 
-    sprintf(content, "%d %d %d %d %d %d %d %d", tl->name_subfix, tl->front,
-            tl->back, tl->side, tl->leds[0], tl->leds[1], tl->leds[2],
-            tl->leds[3]);
-    fwrite(content, 1, strlen(content), fp);
-    fclose(fp);
+/* 타일 좌표(0~1)의 검출을 w x h 프레임 좌표로 옮겨 dst 뒤에 붙인다 */
+static void append_tile_detections(detections* dst, const detections* src, RoiTile t, int w, int h) {
+    int i;
 
-    if (upload_file(filename) == -1)
-        return -1;
+    for (i = 0; i < src->n; i++) {
+        int k = dst->n++;
+        dst->class_id[k] = src->class_id[i];
+        dst->prob[k] = src->prob[i];
+        if (t.x == 0 && t.y == 0 && t.w == w && t.h == h) {
+            dst->x[k] = src->x[i];
+            dst->y[k] = src->y[i];
+            dst->w[k] = src->w[i];
+            dst->h[k] = src->h[i];
+        } else {
+            dst->x[k] = (t.x + src->x[i] * t.w) / w;
+            dst->y[k] = (t.y + src->y[i] * t.h) / h;
+            dst->w[k] = src->w[i] * t.w / w;
+            dst->h[k] = src->h[i] * t.h / h;
+        }
+    }
+}
 
-    return 0;
+/* 분석이 끝난 신호등 하나: 결과 이미지에 그리고 차량 수를 세서 저장 */
+static void finish_light(DetectContext* ctx, TrafficLight* tl, unsigned char* pixels, int w, int h,
+        int tiles, float nms, char** names, image** alphabet, int classes) {
+    char input[BUFSIZE];
+    image im = detect_context_image(ctx, w, h, 3);
+
+    tl->front = 0;
+    tl->back = 0;
+    tl->side = 0;
+    tl->accident = 0;
+    if (tiles > 1)
+        suppress_tile_overlaps(&ctx->merged, nms);
+
+    // 결과 이미지 그리기용 원본 (float)
+    rgb8_to_image_into(pixels, im);
+    get_detections(im, tl, &ctx->merged, names, alphabet, ctx->labels, classes);
+
+    // 업로드하는 이름 그대로 <name>_result.jpg
+    if (snprintf(input, sizeof (input), "%s/%s/%s%d_result", FILE_DIR, tl->intersection->id, tl->name,
+            (int) tl->name_subfix) < (int) sizeof (input))
+        save_image_jpg_stb(im, input, 80);
+    printf("[DETECT] %s : 수신 %u장, 분석 전에 덮어쓴 프레임 %u장\n", tl->tag,
+            tl->frames.published, tl->frames.dropped);
 }
 
-int writeGlobalInfo(int accident, int remain_time, int total_time) {
-    FILE* fp = NULL;
-    char filename[BUFSIZE];
-    char content[BUFSIZE];
+/* 여러 신호등의 triple buffer에서 가장 최근 프레임을 꺼내 batch 입력으로 묶고 network_predict를 돌린다.
+ * 관심 영역(tl->roi)이 있는 신호등은 그 부분만 잘라 타일로 나누고, 타일마다 입력 슬롯 하나를 쓴다
+ * (슬롯이 ctx->max_batch를 넘으면 여러 번 forward). 관심 영역이 없으면 프레임 전체가 슬롯 하나다.
+ * region 출력은 슬롯마다 l.outputs 크기로 이어져 있으므로 잘라서 박스를 뽑고 프레임 좌표로 모은다.
+ * n은 max_batch 이하. 새 프레임이 없는 신호등은 이전 결과를 유지한다.
+ * 반환값: 분석한 신호등 수 (lights 앞쪽으로 모은다) */
+int get_detect_results(TrafficLight** lights, int n, float thresh,
+        char** names, image** alphabet, network* net, DetectContext* ctx) {
+    int i, t, b = 0, slots = 0;
+    double start;
+    float nms = .4;
 
-    sprintf(filename, "%s/%s/global.txt", FILE_DIR, SERVER_ID);
-    if ((fp = fopen(filename, "w")) == NULL) {
-        printf("[DETECT] global file open error\n");
-        return -1;
+    TrafficLight* batch[NUM_OF_CLI];
+    unsigned char *pixels[NUM_OF_CLI];
+    int w[NUM_OF_CLI], h[NUM_OF_CLI];
+    RoiTile tiles[NUM_OF_CLI][ROI_MAX_TILES];
+    int num_tiles[NUM_OF_CLI];
+    // 입력 슬롯 -> (신호등, 타일)
+    int slot_light[NUM_OF_CLI * ROI_MAX_TILES], slot_tile[NUM_OF_CLI * ROI_MAX_TILES];
+
+    // 지난 주기의 디코딩 결과와 인코딩 버퍼를 한 번에 비운다
+    arena_reset(&ctx->codec);
+    image_codec_arena(&ctx->codec);
+
+    for (i = 0; i < n; i++) {
+        FrameBuf* frame = tbuf_read(&lights[i]->frames);
+
+        // 지난 분석 뒤로 받은 이미지가 없음
+        if (frame == NULL)
+            continue;
+        pixels[b] = load_rgb8_memory(frame->data, frame->size, &w[b], &h[b]);
+        if (pixels[b] == NULL) {
+            lights[i]->name_subfix = frame->timestamp;
+            continue;
+        }
+        // 장면이 그대로면 forward 없이 지난 차량 수를 쓴다 (결과 이미지도 지난 것)
+        if (ctx->skip_diff > 0 && skip_unchanged(ctx, lights[i], pixels[b], w[b], h[b]))
+            continue;
+        lights[i]->name_subfix = frame->timestamp;
+        num_tiles[b] = roi_tiles(lights[i]->roi, w[b], h[b], net->w, net->h, tiles[b]);
+        for (t = 0; t < num_tiles[b]; t++) {
+            slot_light[slots] = b;
+            slot_tile[slots++] = t;
+        }
+        batch[b++] = lights[i];
+    }
+    if (b == 0) {
+        image_codec_arena(0);
+        return 0;
     }
 
-    sprintf(content, "%d %d %d", accident, remain_time, total_time);
-    fwrite(content, 1, strlen(content), fp);
-    fclose(fp);
+    layer l = net->layers[net->n - 1];
+    detect_context_fit(ctx, l);
+    ctx->merged.n = 0;
+    ctx->total_analyzed += b;
 
-    if (upload_file(filename) == -1)
-        return -1;
+    for (i = 0; i < slots; i += ctx->max_batch) {
+        int k, m = slots - i < ctx->max_batch ? slots - i : ctx->max_batch;
 
-    return 0;
+        // 디코딩한 8bit 이미지(의 타일)를 k번째 입력 슬롯으로 바로 변환 (자르기 + 리사이즈 + 정규화)
+        for (k = 0; k < m; k++) {
+            int p = slot_light[i + k];
+            RoiTile r = tiles[p][slot_tile[i + k]];
+            preprocess_rgb8_stride(pixels[p] + ((size_t) r.y * w[p] + r.x) * 3, r.w, r.h, (size_t) w[p] * 3, 3,
+                    net->input + k * net->inputs, net->w, net->h);
+        }
+
+        // 배치 크기가 바뀔 때만 다시 설정 (CUDNN은 레이어마다 알고리즘을 다시 고른다)
+        if (net->batch != m)
+            set_batch_network(net, m);
+
+        start = what_time_is_it_now();
+        network_predict(*net, net->input);
+        ctx->predict_time += what_time_is_it_now() - start;
+        printf("[DETECT] %d image(s) predicted in %f seconds.\n", m,
+                what_time_is_it_now() - start);
+
+        for (k = 0; k < m; k++) {
+            int p = slot_light[i + k];
+            layer li = l;
+
+            li.output = l.output + k * l.outputs;
+            get_region_detections(li, thresh, nms, &ctx->dets);
+            append_tile_detections(&ctx->merged, &ctx->dets, tiles[p][slot_tile[i + k]], w[p], h[p]);
+            // 신호등의 마지막 타일이면 결과를 낸다
+            if (slot_tile[i + k] == num_tiles[p] - 1) {
+                finish_light(ctx, batch[p], pixels[p], w[p], h[p], num_tiles[p], nms, names, alphabet,
+                        l.classes);
+                ctx->merged.n = 0;
+            }
+        }
+    }
+
+    image_codec_arena(0);
+
+    for (i = 0; i < b; i++)
+        lights[i] = batch[i];
+    return b;
 }
 
 int isImage(char* filename) {
@@ -1154,319 +1383,428 @@ int isImage(char* filename) {
     return src != 0;
 }
 
-time_t traffic_time = -1;
-time_t orange_time = -1;
-int myswitch = 0;
-int old_switch = 0;
-int calc_time = 0;
-
-void traffic_normal_mode(int default_time, int default_orange) {
+/* 검증용 입력: 이미지를 네트워크 크기로 줄인 것, filename이 없으면 난수 */
+static float *load_validation_input(network net, char *filename) {
+    float *X = calloc(net.w * net.h * 3, sizeof (float));
     int i;
-    int accident, remain_time, total_time;
-    
-    if ((time(NULL) - traffic_time > default_time + calc_time) || (traffic_time == -1)) {
-        int EW_Max, NS_Max;
-    
-        pthread_mutex_lock(&conn_mutex);
+    if (filename) {
+        image im = load_image_color(filename, 0, 0);
+        image sized = resize_image(im, net.w, net.h);
+        memcpy(X, sized.data, net.w * net.h * 3 * sizeof (float));
+        free_image(im);
+        free_image(sized);
+    } else {
+        for (i = 0; i < net.w * net.h * 3; ++i)
+            X[i] = rand_uniform(0, 1);
+    }
+    return X;
+}
 
-        EW_Max = east.front + west.front;
-        NS_Max = north.front + south.front;
-
-        for (i = 0; i < NUM_OF_CLI; i++)
-            if (tls[i] != NULL)
-                writeTrafficLightInfo(tls[i]);
-
-        // 주황불 시간 결정
-        if ((time(NULL) - orange_time > default_orange)
-                || (orange_time == -1)) {
-
-            switch (myswitch) {
-                case 0:
-                    //North South Green
-                    //East West Red
-                    calc_time = 3 * (NS_Max - EW_Max);
-
-                    green_light(&north);
-                    green_light(&south);
-                    red_light(&east);
-                    red_light(&west);
-
-                    myswitch++;
-                    old_switch = myswitch;
-                    myswitch = 4;
-                    break;
-
-                case 1:
-                    //North South Left Green
-                    //East West Red
-                    calc_time = 3 * (NS_Max - EW_Max);
-
-                    green_left_light(&north);
-                    green_left_light(&south);
-                    red_light(&east);
-                    red_light(&west);
-
-                    myswitch++;
-                    old_switch = myswitch;
-                    myswitch = 4;
-                    break;
-
-                case 2:
-                    //North South Red
-                    //East West Green
-                    calc_time = 3 * (EW_Max - NS_Max);
-
-                    red_light(&north);
-                    red_light(&south);
-                    green_light(&east);
-                    green_light(&west);
-
-                    myswitch++;
-                    old_switch = myswitch;
-                    myswitch = 4;
-                    break;
-                case 3:
-                    //North South Red
-                    //East West Left Green
-                    calc_time = 3 * (EW_Max - NS_Max);
-
-                    red_light(&north);
-                    red_light(&south);
-                    green_left_light(&east);
-                    green_left_light(&west);
-
-                    myswitch = 0;
-                    old_switch = myswitch;
-                    myswitch = 4;
-                    break;
-                case 4:
-                    // orange
-                    orange_light(&east);
-                    orange_light(&west);
-                    orange_light(&south);
-                    orange_light(&north);
-
-                    orange_time = time(NULL);
-                    myswitch = old_switch;
-                    break;
-                default:
-                    break;
-            }
-        }
-        if (calc_time < -5)
-            calc_time = -5;
-        else if (calc_time > 10)
-            calc_time = 10;
-
-        // 신호등 정보 저장
-
-        for (i = 0; i < NUM_OF_CLI; i++)
-            if (tls[i] != NULL)
-                writeTrafficLightInfo(tls[i]);
-
-        // 사고 여부 결정
-        accident = 0;
-        for (i = 0; i < NUM_OF_CLI; i++) {
-            if (tls[i] != NULL && tls[i]->accident == 1) {
-                accident = 1;
-                break;
-            }
+/* 방금 돌린 forward의 레이어별 출력과 expect (기준 네트워크의 출력)를 비교해 출력하고 최대 상대 오차를 반환 */
+static float compare_layer_outputs(network net, float **expect) {
+    float max_err = 0;
+    int i, j;
+    printf("layer  type           outputs   max |x|   rel err\n");
+    for (i = 0; i < net.n; ++i) {
+        layer l = net.layers[i];
+        float max_val = 0, max_diff = 0, err;
+        for (j = 0; j < l.outputs; ++j) {
+            float d = fabsf(expect[i][j] - l.output[j]);
+            if (fabsf(expect[i][j]) > max_val)
+                max_val = fabsf(expect[i][j]);
+            if (d > max_diff)
+                max_diff = d;
         }
-
-        if (myswitch == 4)
-            traffic_time = time(NULL);
-        pthread_mutex_unlock(&conn_mutex);
+        err = max_val > 0 ? max_diff / max_val : max_diff;
+        if (err > max_err)
+            max_err = err;
+        printf("%5d  %-13s %8d  %8.3g   %.1e%s\n", i, get_layer_string(l.type), l.outputs, max_val, err,
+                l.quantized ? "  int8" : (l.fused ? "  fused" : ""));
     }
-    
-    if (myswitch == 4) {
-        remain_time = default_time + calc_time - time(NULL) + traffic_time;
-        total_time = default_time + calc_time;
-    } else {
-        remain_time = default_orange - (time(NULL) - orange_time);
-        total_time = default_orange;
+    return max_err;
+}
+
+static float **copy_layer_outputs(network net) {
+    float **outputs = calloc(net.n, sizeof (float *));
+    int i;
+    for (i = 0; i < net.n; ++i) {
+        outputs[i] = calloc(net.layers[i].outputs, sizeof (float));
+        memcpy(outputs[i], net.layers[i].output, net.layers[i].outputs * sizeof (float));
     }
-    writeGlobalInfo(accident, remain_time, total_time);
-    printf("[DETECT] 다음 신호까지 %d/%d 초 남았습니다.\n", remain_time, total_time);
+    return outputs;
 }
 
-void traffic_night_mode(int default_time, int default_orange) {
+static void free_layer_outputs(network net, float **outputs) {
     int i;
-    int accident, remain_time, total_time;
-    
-    if ((time(NULL) - traffic_time > default_time) || (traffic_time == -1)) {
-        int EW_Max, NS_Max;
-    
-        pthread_mutex_lock(&conn_mutex);
+    for (i = 0; i < net.n; ++i)
+        free(outputs[i]);
+    free(outputs);
+}
 
-        EW_Max = east.front + west.front;
-        NS_Max = north.front + south.front;
+/* batchnorm을 접은(fuse_network) 네트워크와 원래 네트워크를 같은 입력으로 돌려
+ * 레이어별 출력의 최대 상대 오차와 forward 시간을 비교한다. filename이 없으면 난수 입력 */
+void validate_fused(char *cfgfile, char *weightfile, char *filename, int iters) {
+    network net = parse_network_cfg(cfgfile);
+    network fused = parse_network_cfg(cfgfile);
+    float *X;
+    float **expect;
+    float max_err;
+    double start, t_net, t_fused;
+    int i;
 
-        for (i = 0; i < NUM_OF_CLI; i++)
-            if (tls[i] != NULL)
-                writeTrafficLightInfo(tls[i]);
+    if (weightfile) {
+        load_weights(&net, weightfile);
+        load_weights(&fused, weightfile);
+    }
+    set_batch_network(&net, 1);
+    set_batch_network(&fused, 1);
+    printf("batchnorm을 접은 conv 레이어 %d개\n", fuse_network(&fused));
 
-        if ((time(NULL) - orange_time > default_orange) || (orange_time == -1)) {
+    X = load_validation_input(net, filename);
+    if (iters < 1)
+        iters = 1;
 
-            switch (myswitch) {
-                case 0:
-                    //North South Green
-                    //East West Red
+    network_predict(net, X);
+    expect = copy_layer_outputs(net);
+    network_predict(fused, X);
+    max_err = compare_layer_outputs(fused, expect);
+    free_layer_outputs(net, expect);
+
+    start = what_time_is_it_now();
+    for (i = 0; i < iters; ++i)
+        network_predict(net, X);
+    t_net = (what_time_is_it_now() - start) / iters;
+    start = what_time_is_it_now();
+    for (i = 0; i < iters; ++i)
+        network_predict(fused, X);
+    t_fused = (what_time_is_it_now() - start) / iters;
+    printf("최대 상대 오차 %.1e, forward %.1f ms -> %.1f ms (접음)\n", max_err, t_net * 1000, t_fused * 1000);
+
+    free(X);
+    free_network(net);
+    free_network(fused);
+}
 
-                    green_light(&north);
-                    green_light(&south);
-                    red_light(&east);
-                    red_light(&west);
-                    if (EW_Max >= 2) {
-                        myswitch++;
-                        old_switch = myswitch;
-                        myswitch = 2;
-                    }
-                    break;
-
-                case 1:
-                    //North South Red
-                    //East West Green
-                    //없는쪽 신호시간
-                    default_time = 10;
-
-                    red_light(&north);
-                    red_light(&south);
-                    green_light(&east);
-                    green_light(&west);
-
-                    myswitch = 0;
-                    old_switch = myswitch;
-                    myswitch = 2;
-
-                    break;
-
-                case 2:
-                    // orange
-                    orange_light(&east);
-                    orange_light(&west);
-                    orange_light(&south);
-                    orange_light(&north);
-
-                    orange_time = time(NULL);
-                    myswitch = old_switch;
-
-                    if (default_time > 0)
-                        default_time = 0;
-
-                    //myswitch = oldswitch;
-                    break;
-                default:
-                    break;
-            }
+/* INT8 post-training quantization
+ * obj.data의 valid 목록에서 samples장으로 conv 입력의 채널별 범위를 모으고,
+ * batchnorm을 접은 weight를 양자화해서 <weights>.int8로 저장한다.
+ * 첫 샘플(또는 filename)로 FP32 대비 레이어별 오차를 출력한다 */
+void quantize_detector(char *datacfg, char *cfgfile, char *weightfile, int samples, char *filename) {
+    list *options = read_data_cfg(datacfg);
+    char *valid_images = option_find_str(options, "valid", "data/train.txt");
+    list *plist = get_paths(valid_images);
+    char **paths = (char **) list_to_array(plist);
+    char int8file[4096];
+    float **ranges, **expect;
+    float *X;
+    int n = (plist->size < samples) ? plist->size : samples;
+    int i, quantized;
+    double start, t_fp32, t_int8;
+
+    if (n < 1) {
+        printf("%s 에 calibration 이미지가 없습니다.\n", valid_images);
+        return;
+    }
+    network net = parse_network_cfg(cfgfile);
+    load_weights(&net, weightfile);
+    set_batch_network(&net, 1);
+    fuse_network(&net);
+    sprintf(int8file, "%s.int8", weightfile);
+
+    printf("calibration: %s 에서 %d장\n", valid_images, n);
+    ranges = calibrate_network(net, paths, n);
+
+    X = load_validation_input(net, filename ? filename : paths[0]);
+    network_predict(net, X);
+    expect = copy_layer_outputs(net);
+    start = what_time_is_it_now();
+    network_predict(net, X);
+    t_fp32 = what_time_is_it_now() - start;
+
+    quantized = quantize_network(&net, ranges);
+    save_int8_weights(net, int8file);
+    network_predict(net, X);
+    compare_layer_outputs(net, expect);
+    start = what_time_is_it_now();
+    network_predict(net, X);
+    t_int8 = what_time_is_it_now() - start;
+    printf("conv %d개를 INT8로 양자화해서 %s 에 저장했습니다. forward %.1f ms -> %.1f ms\n",
+            quantized, int8file, t_fp32 * 1000, t_int8 * 1000);
+    printf("mAP 비교: ./darknet map_int8 %s\n", weightfile);
+
+    for (i = 0; i < net.n; ++i)
+        free(ranges[i]);
+    free(ranges);
+    free_layer_outputs(net, expect);
+    free(X);
+    free(paths);
+    free_list(plist);
+    free_network(net);
+}
+
+void compile_detector(char *cfgfile, char *weightfile, int int8, char *filename) {
+    char buff[4096];
+    double start;
+    int i, count, quantized = 0;
+    network net = parse_network_cfg_inference(cfgfile, 1);
+
+    load_weights(&net, weightfile);
+    fuse_network(&net);
+    if (int8) {
+        sprintf(buff, "%s.int8", weightfile);
+        if (load_int8_weights(&net, buff) < 0)
+            printf("%s 를 읽을 수 없어 FP32로만 컴파일합니다. (./darknet quantize %s)\n", buff, weightfile);
+    }
+    if (!filename) {
+        sprintf(buff, "%s.model", weightfile);
+        filename = buff;
+    }
+    start = what_time_is_it_now();
+    count = save_compiled_model(net, filename);
+    for (i = 0; i < net.n; ++i)
+        quantized += net.layers[i].quantized;
+    printf("conv 레이어 %d개 (INT8 %d개)를 %s 에 저장했습니다. (%.1f ms)\n", count, quantized, filename,
+            (what_time_is_it_now() - start) * 1000);
+    printf("실행: ./darknet test %s [section_num]%s\n", filename, quantized ? " -int8" : "");
+    free_network(net);
+}
+
+/* 분석용 네트워크 설정 (시작할 때와 모델을 바꿀 때 같은 설정으로 만든다) */
+typedef struct {
+    char *cfgfile;
+    char *weightfile;
+    int batch;
+    int int8;
+    int threads;
+} DetectorModel;
+
+/* cfg와 weight(또는 컴파일된 모델)로 분석용 네트워크를 만든다. weight 파일을 읽을 수 없으면 0 */
+static int load_detector_network(DetectorModel *m, network *net) {
+    char *weightfile = m->weightfile;
+    int compiled = weightfile && is_compiled_model(weightfile);
+    FILE *fp;
+
+    if (weightfile) {
+        if (!(fp = fopen(weightfile, "rb"))) {
+            printf("[DETECT] %s 를 열 수 없습니다.\n", weightfile);
+            return 0;
         }
-        if (calc_time < 0)
-            calc_time = 0;
-        else if (calc_time > 40)
-            calc_time = 40;
-
-        // 신호등 정보 저장
-        for (i = 0; i < NUM_OF_CLI; i++)
-            if (tls[i] != NULL)
-                writeTrafficLightInfo(tls[i]);
-
-        // 사고 여부 결정
-        accident = 0;
-        for (i = 0; i < NUM_OF_CLI; i++) {
-            if (tls[i] != NULL && tls[i]->accident == 1) {
-                accident = 1;
-                break;
-            }
+        fclose(fp);
+    }
+    // 추론만 하므로 학습용 버퍼 없이 만들고 레이어 출력은 공유 버퍼에 나눠 담는다
+    *net = parse_network_cfg_inference(m->cfgfile, m->batch);
+    if (compiled) {
+        // 미리 접고 변환해 둔 배열을 mmap으로 바로 쓴다 (./darknet compile)
+        double start = what_time_is_it_now();
+        if (load_compiled_model(net, weightfile, m->int8) < 0) {
+            printf("[DETECT] 컴파일된 모델 %s 를 읽을 수 없습니다.\n", weightfile);
+            free_network(*net);
+            return 0;
         }
-
-        pthread_mutex_unlock(&conn_mutex);
-        traffic_time = time(NULL);
+        printf("[DETECT] 컴파일된 모델 %s (%.1f ms)\n", weightfile, (what_time_is_it_now() - start) * 1000);
+    } else if (weightfile) {
+        load_weights(net, weightfile);
     }
-    if (default_time - (time(NULL) - traffic_time) < 0) {
-        remain_time = 0;
-        total_time = default_time;
+    set_batch_network(net, 1);
+    // 네트워크마다 자기 쓰레드 풀을 쓴다 (모델을 바꿀 때 새 네트워크의 warm-up이 분석과 풀을 같이 쓰지 않게)
+    set_network_threads(net, m->threads);
+    printf("[DETECT] 추론 쓰레드 %d개\n", thread_pool_size(net->pool));
+    printf("[DETECT] batch = %d, batchnorm을 접은 conv 레이어 %d개\n", m->batch, fuse_network(net));
+    if (m->int8 && compiled) {
+        int i, quantized = 0;
+        for (i = 0; i < net->n; ++i)
+            quantized += net->layers[i].quantized;
+        printf("[DETECT] INT8 conv 레이어 %d개\n", quantized);
+    } else if (m->int8 && weightfile) {
+        char int8file[4096];
+        int quantized;
+        sprintf(int8file, "%s.int8", weightfile);
+        if ((quantized = load_int8_weights(net, int8file)) < 0) {
+            printf("[DETECT] %s 를 읽을 수 없어 FP32로 분석합니다. (./darknet quantize %s)\n", int8file, weightfile);
+        } else {
+            printf("[DETECT] INT8 conv 레이어 %d개 (%s)\n", quantized, int8file);
+        }
+    }
+    return 1;
+}
+
+/* 모델 교체 (kill -HUP): 같은 경로의 weight(또는 컴파일된 모델)로 새 네트워크를 백그라운드 쓰레드에서 만들고
+ * 빈 입력으로 최대 batch forward를 한 번 돌려 (페이지 폴트, 첫 할당) 준비해 둔다.
+ * 분석은 메인 루프에서만 하므로 루프 처음에 바꿔 끼우면 예전 네트워크를 쓰는 작업이 남아 있지 않고,
+ * 그때 예전 네트워크를 푼다. 연결과 신호 상태(교차로별 ctl)는 건드리지 않는다 */
+static volatile sig_atomic_t reload_requested = 0;
+static pthread_mutex_t reload_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int reload_running = 0;
+static network *reload_ready = 0;
+
+static void request_reload(int sig) {
+    reload_requested = 1;
+    tbuf_wake();
+}
+
+static void *reload_thread(void *arg) {
+    DetectorModel *m = (DetectorModel *) arg;
+    network *net = calloc(1, sizeof (network));
+    double start = what_time_is_it_now();
+
+    printf("[DETECT] 새 모델을 읽는 중: %s\n", m->weightfile);
+    if (!load_detector_network(m, net)) {
+        printf("[DETECT] 모델 교체 실패, 지금 모델로 계속 분석합니다.\n");
+        free(net);
+        net = 0;
     } else {
-        remain_time = default_time - time(NULL) + traffic_time;
-        total_time = default_time;
+        set_batch_network(net, m->batch);
+        network_predict(*net, net->input);
+        set_batch_network(net, 1);
+        printf("[DETECT] 새 모델 준비 완료 (%.2f 초), 다음 분석부터 사용합니다.\n", what_time_is_it_now() - start);
     }
-    printf("[DETECT] 다음 신호까지 %d/%d 초 남았습니다.\n", remain_time, total_time);
-    writeGlobalInfo(accident, remain_time, total_time);
+    pthread_mutex_lock(&reload_mutex);
+    reload_ready = net;
+    reload_running = 0;
+    pthread_mutex_unlock(&reload_mutex);
+    // 분석 루프가 새 프레임을 기다리는 중이어도 바로 바꾸도록
+    tbuf_wake();
+    return 0;
 }
 
-void test_detector(char *datacfg, char *cfgfile, char *weightfile, float thresh) {
+static void start_reload(DetectorModel *m) {
+    pthread_t tid;
+
+    pthread_mutex_lock(&reload_mutex);
+    if (reload_running) {
+        pthread_mutex_unlock(&reload_mutex);
+        printf("[DETECT] 이미 새 모델을 읽는 중입니다.\n");
+        return;
+    }
+    reload_running = 1;
+    pthread_mutex_unlock(&reload_mutex);
+    if (pthread_create(&tid, 0, reload_thread, m) != 0) {
+        pthread_mutex_lock(&reload_mutex);
+        reload_running = 0;
+        pthread_mutex_unlock(&reload_mutex);
+        return;
+    }
+    pthread_detach(tid);
+}
+
+/* 준비된 새 네트워크가 있으면 *net과 바꾸고 예전 것을 푼다 */
+static int swap_reloaded_network(network *net) {
+    network *next;
+
+    pthread_mutex_lock(&reload_mutex);
+    next = reload_ready;
+    reload_ready = 0;
+    pthread_mutex_unlock(&reload_mutex);
+    if (!next)
+        return 0;
+    free_network(*net);
+    *net = *next;
+    free(next);
+    return 1;
+}
+
+void test_detector(char *datacfg, char *cfgfile, char *weightfile, float thresh,
+        int io_threads, int batch, char *upload_url, int txt_sink, int int8, int threads, char *intersection_file,
+        char *control_path, float skip_diff, char *roi_file) {
     list *options = read_data_cfg(datacfg);
     char *name_list = option_find_str(options, "names", "data/names.list");
     char **names = get_labels(name_list);
     image **alphabet = load_alphabet();
-    network net = parse_network_cfg_custom(cfgfile, 1);
 
-    if (weightfile) {
-        load_weights(&net, weightfile);
-    }
-    set_batch_network(&net, 1);
+    // 신호등 batch개를 한 번의 forward로 분석 (출력 버퍼는 최대 배치 크기로 잡는다)
+    if (batch < 1)
+        batch = 1;
+    if (batch > NUM_OF_CLI)
+        batch = NUM_OF_CLI;
+    DetectorModel model = {cfgfile, weightfile, batch, int8, threads};
+    DetectContext ctx;
+    network net;
+    struct sigaction sa;
+    AllocStats heap = alloc_stats();
+
+    if (!load_detector_network(&model, &net))
+        error("weight 파일을 읽을 수 없습니다.");
+    memset(&ctx, 0, sizeof (ctx));
+    ctx.max_batch = batch;
+    ctx.skip_diff = skip_diff;
     srand(2222222);
 
-    int testMode = 0; //0: normal, 1: night
-    
+    // kill -HUP <pid> : 연결을 끊지 않고 같은 경로의 weight로 모델을 바꾼다
+    memset(&sa, 0, sizeof (sa));
+    sa.sa_handler = request_reload;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, 0);
+
+    // 결과 업로드는 분석과 별도 쓰레드에서
+    publisher_start(upload_url, txt_sink);
+
     // server on port "50000"
-    run_server(PORT);
+    run_server(PORT, io_threads, intersection_file, roi_file);
+    // 주간/야간 전환은 제어 소켓으로 (echo "mode night" | nc -U stlc.sock)
+    control_start(control_path);
 
-    while (1) {
-        int i;
-        time_t current_time;
-
-        if (kbhit()) {
-            if (getchar() == '1') {
-                testMode = !testMode;
-                if (testMode == 0) {
-                    printf("주간모드로 변경되었습니다.\n");
-                } else {
-                    printf("야간모드로 변경되었습니다.\n");
-                }
-                traffic_time = -1;
-                orange_time = -1;
-                myswitch = 0;
-                old_switch = 0;
-                calc_time = 0;
-                
-                sleep(2);
-            }
-        }
+    // 신호 전환은 신호 제어 쓰레드가 교차로별 예약 시각에 한다 (분석이 오래 걸려도 밀리지 않는다)
+    controller_start(CONTROLLER_NORMAL);
 
-        // Request Images
-
-        // Detect Images
-        current_time = time(NULL);
-        for (i = 0; i < NUM_OF_CLI; i++) {
-            pthread_mutex_lock(&conn_mutex);
-            if (tls[i]) {
-                tls[i]->front = 0;
-                tls[i]->back = 0;
-                tls[i]->side = 0;
-                tls[i]->accident = 0;
-
-                pthread_mutex_lock(&tls[i]->mutex);
-                get_detect_result(tls[i], thresh, names, alphabet, net);
-                writeTrafficLightInfo(tls[i]);
-                pthread_mutex_unlock(&tls[i]->mutex);
-            }
-            pthread_mutex_unlock(&conn_mutex);
-        }
-        printf("[DETECT] 이미지 분석 완료 (%.2f 초)\n", time(NULL) - current_time);
+    // 주기마다 conn_mutex 안에서 목록만 복사해 둘 버퍼 (신호등이 늘면 registry가 키운다)
+    TrafficLight** lights = NULL;
+    int lights_cap = 0;
 
-        // Traffic Algorithm
-        current_time = time(NULL);
+    while (1) {
+        int i, n, detected = 0;
+        double detect_start;
 
-        if (testMode == 0)
-            traffic_normal_mode(20, 5);
-        else
-            traffic_night_mode(0, 3);
+        // 새 프레임이나 모델 교체(tbuf_wake)가 있을 때만 깨어난다. 신호 전환은 신호 제어 쓰레드가 한다
+        tbuf_wait(-1);
 
-        printf("[DETECT] 신호등 신호 전달 완료 (%.2f 초)\n", time(NULL) - current_time);
-        printf("------------------------------------------------\n");
+        if (reload_requested) {
+            reload_requested = 0;
+            start_reload(&model);
+        }
+        if (swap_reloaded_network(&net))
+            printf("[DETECT] 모델을 교체했습니다: %s\n", weightfile);
 
-        // Request set LED
+        // 연결 목록만 복사하고 바로 놓는다. 분석과 업로드는 conn_mutex 밖에서 처리한다
+        pthread_mutex_lock(&conn_mutex);
+        n = registry_connected(&lights, &lights_cap);
+        pthread_mutex_unlock(&conn_mutex);
 
-        usleep(300);
+        // 새 프레임이 있는 신호등을 batch개씩 묶어서 분석하고, 결과는 업로드 쓰레드로 넘긴다
+        detect_start = what_time_is_it_now();
+        heap = alloc_stats();
+        for (i = 0; i < n; i += batch) {
+            int j, m = get_detect_results(lights + i, n - i < batch ? n - i : batch,
+                    thresh, names, alphabet, &net, &ctx);
+            for (j = 0; j < m; j++) {
+                publish_light(lights[i + j], 1);
+                // 교차로 상태도 새 차량 수로 (registry_connected는 같은 교차로의 신호등을 붙여서 준다)
+                if (j == m - 1 || lights[i + j + 1]->intersection != lights[i + j]->intersection)
+                    publish_cycle(lights[i + j]->intersection);
+            }
+            detected += m;
+        }
+        // 끊긴 신호등의 프레임이었거나 모델 교체로만 깨어났으면 남길 것이 없다
+        if (detected == 0 && ctx.skipped == 0)
+            continue;
+        printf("[DETECT] 이미지 %d장 분석 완료 (%.2f 초)\n", detected,
+                what_time_is_it_now() - detect_start);
+        if (ctx.skip_diff > 0) {
+            unsigned int frames = ctx.total_skipped + ctx.skipped + ctx.total_analyzed;
+            ctx.total_skipped += ctx.skipped;
+            // 아낀 시간은 지금까지 분석한 프레임의 평균 forward 시간으로 추정
+            printf("[DETECT] 변화 없는 프레임 %d장 건너뜀 (누적 %u/%u장, %.1f%%, 아낀 추론 약 %.1f 초)\n",
+                    ctx.skipped, ctx.total_skipped, frames, frames ? 100.0 * ctx.total_skipped / frames : 0,
+                    ctx.total_analyzed ? ctx.total_skipped * ctx.predict_time / ctx.total_analyzed : 0);
+            ctx.skipped = 0;
+        }
+        // 분석 쓰레드의 heap 사용: 첫 주기(버퍼를 잡을 때) 뒤로는 0이어야 한다
+        if (alloc_stats_enabled()) {
+            AllocStats now = alloc_stats();
+            printf("[DETECT] heap 할당 %zu회 (%zu bytes), 해제 %zu회\n", now.allocs - heap.allocs,
+                    now.bytes - heap.bytes, now.frees - heap.frees);
+        }
+        printf("------------------------------------------------\n");
     }
 }
 
@@ -1476,6 +1814,19 @@ void run_detector(int argc, char **argv) {
     int num_of_clusters = find_int_arg(argc, argv, "-num_of_clusters", 5);
     int final_width = find_int_arg(argc, argv, "-final_width", 13);
     int final_heigh = find_int_arg(argc, argv, "-final_heigh", 13);
+    int io_threads = find_int_arg(argc, argv, "-io_threads", NUM_OF_IO_THREADS);
+    int batch = find_int_arg(argc, argv, "-batch", 1);
+    char *upload_url = find_char_arg(argc, argv, "-upload_url", WEB_URL);
+    int txt_sink = find_arg(argc, argv, "-txt_sink");
+    int archive = find_arg(argc, argv, "-archive");
+    int int8 = find_arg(argc, argv, "-int8");
+    int threads = find_int_arg(argc, argv, "-threads", 0);
+    char *intersection_file = find_char_arg(argc, argv, "-intersections", 0);
+    char *control_path = find_char_arg(argc, argv, "-control", CONTROL_SOCKET);
+    float skip_diff = find_float_arg(argc, argv, "-skip_diff", 0);
+    char *roi_file = find_char_arg(argc, argv, "-roi", 0);
+    // bench_*의 반복 횟수 (0이면 명령마다 기본값). [weights]/[cfg] 자리를 읽기 전에 argv에서 빼 둔다
+    int iters = find_int_arg(argc, argv, "-iters", 0);
     if (argc < 2) {
         printf("사용법\n");
         printf("%s train [weights] //학습\n", argv[0]);
@@ -1483,7 +1834,20 @@ void run_detector(int argc, char **argv) {
         printf("%s recall [weights] //이전 학습 로그를 가져옴\n", argv[0]);
         printf("%s map [weights] //예측 정확도 테스트\n", argv[0]);
         printf("%s calc_anchor [weights] //yolo-obj.cfg에서 써야 할 anchor 값을 계산해줌\n", argv[0]);
-        printf("%s test [weights] [section_num] //주간모드\n", argv[0]);
+        printf("%s test [weights] [section_num] [-batch n] [-int8] [-threads n] [-intersections file] [-control socket] [-skip_diff x] [-roi file] //주간모드 (section_num: 방향만 보내는 신호등의 교차로 id, 야간모드는 제어 소켓으로)\n", argv[0]);
+        printf("%s quantize [weights] [-samples n] //valid 목록으로 calibration 후 INT8 weight(<weights>.int8) 생성\n", argv[0]);
+        printf("%s map_int8 [weights] //FP32와 INT8의 mAP, 속도 비교\n", argv[0]);
+        printf("%s bench_preprocess [image] [-iters n] //이미지 전처리 속도 비교\n", argv[0]);
+        printf("%s bench_nms [-iters n] [-classes n] //박스 수별 region 후처리(후보 compaction + NMS) 시간 비교\n", argv[0]);
+        printf("%s bench_controller [-count n] [-seconds s] //교차로 n개 신호 전환을 scheduler와 polling으로 돌려 지연(jitter), CPU 사용률 비교\n", argv[0]);
+        printf("%s bench_gemm [cfg] [-iters n] [-threads n] //conv 레이어 모양별 gemm GFLOP/s 비교\n", argv[0]);
+        printf("%s bench_conv [cfg] [-iters n] //conv 레이어별 im2col, 1x1, Winograd 경로 비교\n", argv[0]);
+        printf("%s bench_xnor [cfg] [-iters n] //conv 레이어 모양별 float conv와 XNOR popcount conv 비교\n", argv[0]);
+        printf("%s bench_layers [weights] [-iters n] [-threads n] //1 쓰레드와 n 쓰레드의 레이어별 forward 시간 비교\n", argv[0]);
+        printf("%s compile [weights] [-int8] [-out file] //접고 변환한 weight를 mmap으로 바로 읽는 컴파일된 모델(<weights>.model)로 저장\n", argv[0]);
+        printf("%s bench_startup [weights] [model] [-iters n] //.weights와 컴파일된 모델의 시작 시간 비교\n", argv[0]);
+        printf("%s bench_memory [cfg ...] //학습용 네트워크와 추론 전용 네트워크(공유 출력 버퍼)의 peak RSS 비교\n", argv[0]);
+        printf("%s validate_fused [weights] [image] [-iters n] //batchnorm을 접은 네트워크와 원래 네트워크 출력 비교\n", argv[0]);
         return;
     }
     if (strcmp(argv[1], "test") == 0) {
@@ -1492,6 +1856,9 @@ void run_detector(int argc, char **argv) {
             return;
         }
         strcpy(SERVER_ID, argv[3]);
+        // 받은 원본 이미지를 files/<id>/에 보관
+        if (archive)
+            archiver_start();
     }
 
     char *gpu_list = find_char_arg(argc, argv, "-gpus", 0);
@@ -1522,7 +1889,8 @@ void run_detector(int argc, char **argv) {
 
     char *datacfg = "data/obj.data";
     char *cfg = "yolo-obj.cfg";
-    char *weights = (argc < 3) ? 0 : argv[2];
+    // 생략할 수 있는 [cfg] 자리에 옵션이 오면 없는 것으로 본다 (bench_gemm -iters 2, 뺀 옵션 자리는 0)
+    char *weights = (argc < 3 || argv[2] == 0 || argv[2][0] == '-') ? 0 : argv[2];
     if (weights && weights[strlen(weights) - 1] == 0x0d)
         weights[strlen(weights) - 1] = 0;
 
@@ -1537,5 +1905,41 @@ void run_detector(int argc, char **argv) {
     else if (0 == strcmp(argv[1], "calc_anchors"))
         calc_anchors(datacfg, num_of_clusters, final_width, final_heigh, show);
     else if (0 == strcmp(argv[1], "test"))
-        test_detector(datacfg, cfg, weights, thresh);
+        test_detector(datacfg, cfg, weights, thresh, io_threads, batch, upload_url, txt_sink, int8, threads, intersection_file, control_path, skip_diff, roi_file);
+    else if (0 == strcmp(argv[1], "bench_preprocess") && weights)
+        test_preprocess(weights, find_int_arg(argc, argv, "-w", 416),
+                find_int_arg(argc, argv, "-h", 416), iters ? iters : 50);
+    else if (0 == strcmp(argv[1], "bench_nms"))
+        test_postprocess(find_int_arg(argc, argv, "-classes", 4), thresh,
+                iters ? iters : 100);
+    else if (0 == strcmp(argv[1], "bench_controller"))
+        test_controller(find_int_arg(argc, argv, "-count", 10000),
+                find_float_arg(argc, argv, "-seconds", 10));
+    else if (0 == strcmp(argv[1], "bench_gemm"))
+        test_gemm(weights ? weights : cfg, iters ? iters : 5, threads);
+    else if (0 == strcmp(argv[1], "quantize") && weights)
+        quantize_detector(datacfg, cfg, weights, find_int_arg(argc, argv, "-samples", 100), find_char_arg(argc, argv, "-image", 0));
+    else if (0 == strcmp(argv[1], "map_int8") && weights)
+        validate_detector_map_int8(datacfg, cfg, weights, thresh);
+    else if (0 == strcmp(argv[1], "validate_fused"))
+        validate_fused(cfg, weights, (argc > 3) ? argv[3] : 0, iters ? iters : 3);
+    else if (0 == strcmp(argv[1], "bench_conv"))
+        test_convolutional_algos(weights ? weights : cfg, iters ? iters : 3);
+    else if (0 == strcmp(argv[1], "bench_xnor"))
+        test_xnor_convolution(weights ? weights : cfg, iters ? iters : 3);
+    else if (0 == strcmp(argv[1], "bench_layers"))
+        test_network_threads(cfg, weights, iters ? iters : 3, threads);
+    else if (0 == strcmp(argv[1], "compile") && weights)
+        compile_detector(cfg, weights, int8, find_char_arg(argc, argv, "-out", 0));
+    else if (0 == strcmp(argv[1], "bench_startup") && weights) {
+        char model[4096];
+        sprintf(model, "%s.model", weights);
+        test_model_startup(cfg, weights, (argc > 3 && argv[3]) ? argv[3] : model, iters ? iters : 3);
+    } else if (0 == strcmp(argv[1], "bench_memory")) {
+        char *defaults[] = {cfg, "cfg/tiny-yolo-voc.cfg"};
+        if (argc > 2)
+            test_network_memory(argv + 2, argc - 2);
+        else
+            test_network_memory(defaults, 2);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include "frame_pool.h"
+#include <stdlib.h>
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FrameBuf* pool_head = NULL;
+static int pool_count = 0;
+
+/* size 바이트 이상을 담을 수 있는 버퍼를 꺼낸다. 참조 카운트는 1 */
+FrameBuf* frame_pool_get(int size) {
+    FrameBuf *f, **prev;
+
+    pthread_mutex_lock(&pool_mutex);
+    for (prev = &pool_head; (f = *prev) != NULL; prev = &f->next) {
+        if (f->cap >= size) {
+            *prev = f->next;
+            pool_count--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    if (f == NULL) {
+        f = calloc(1, sizeof (FrameBuf));
+        f->data = malloc(size);
+        f->cap = size;
+    }
+    f->size = 0;
+    f->refcount = 1;
+    f->next = NULL;
+    return f;
+}
+
+void frame_retain(FrameBuf* f) {
+    __sync_fetch_and_add(&f->refcount, 1);
+}
+
+void frame_release(FrameBuf* f) {
+    if (f == NULL || __sync_sub_and_fetch(&f->refcount, 1) > 0)
+        return;
+
+    pthread_mutex_lock(&pool_mutex);
+    if (pool_count < FRAME_POOL_MAX) {
+        f->next = pool_head;
+        pool_head = f;
+        pool_count++;
+        f = NULL;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    if (f != NULL) {
+        free(f->data);
+        free(f);
+    }
+}
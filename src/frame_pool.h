@@ -0,0 +1,27 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#define FRAME_POOL_MAX 64 //풀에 남겨둘 최대 버퍼 수
+
+/* 수신한 JPEG를 담는 재사용 버퍼
+ * 수신(I/O 쓰레드), 분석(detector), 보관(archiver)이 같은 버퍼를 공유하므로
+ * 참조 카운트가 0이 될 때 풀로 돌아간다. */
+typedef struct __FrameBuf {
+    unsigned char* data;
+    int size;
+    int cap;
+    int refcount;
+    uint32_t seq;
+    time_t timestamp;
+    struct __FrameBuf* next;
+} FrameBuf;
+
+FrameBuf* frame_pool_get(int size);
+void frame_retain(FrameBuf* f);
+void frame_release(FrameBuf* f);
+
+#endif /* FRAME_POOL_H */
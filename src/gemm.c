@@ -1,6 +1,9 @@
 #include "gemm.h"
 #include "utils.h"
 #include "cuda.h"
+#include "thread_pool.h"
+#include "parser.h"
+#include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
@@ -37,31 +40,6 @@ float *random_matrix(int rows, int cols)
     return m;
 }
 
-void time_random_matrix(int TA, int TB, int m, int k, int n)
-{
-    float *a;
-    if(!TA) a = random_matrix(m,k);
-    else a = random_matrix(k,m);
-    int lda = (!TA)?k:m;
-    float *b;
-    if(!TB) b = random_matrix(k,n);
-    else b = random_matrix(n,k);
-    int ldb = (!TB)?n:k;
-
-    float *c = random_matrix(m,n);
-    int i;
-    clock_t start = clock(), end;
-    for(i = 0; i<10; ++i){
-        gemm_cpu(TA,TB,m,n,k,1,a,lda,b,ldb,1,c,n);
-    }
-    end = clock();
-    printf("Matrix Multiplication %dx%d * %dx%d, TA=%d, TB=%d: %lf ms\n",m,k,k,n, TA, TB, (float)(end-start)/CLOCKS_PER_SEC);
-    free(a);
-    free(b);
-    free(c);
-}
-
-
 void gemm(int TA, int TB, int M, int N, int K, float ALPHA, 
         float *A, int lda, 
         float *B, int ldb,
@@ -138,6 +116,344 @@ void gemm_tt(int M, int N, int K, float ALPHA,
 }
 
 
+/*
+ * Packed, register-blocked SGEMM (NN): C += ALPHA * A * B
+ *
+ * 3단계 blocking (GotoBLAS/BLIS 방식):
+ *   N을 GEMM_NC, K를 GEMM_KC 단위로 자르고 B 블록을 NR열 panel로 pack (L3),
+ *   M을 GEMM_MC 단위로 자르고 A 블록을 MR행 panel로 pack (L2),
+ *   MRxNR 마이크로 커널이 pack된 panel 두 개로 C 타일을 레지스터에서 누적한다.
+ * 마이크로 커널은 AVX2/FMA (6x16, ymm 누산기 12개)와 같은 모양의 portable C 버전이 있고
+ * CPUID로 고른다. (M 블록 x N 조각) 단위 작업을 쓰레드 풀로 나눈다.
+ */
+#define GEMM_MR 6
+#define GEMM_NR 16
+#define GEMM_MC 120
+#define GEMM_KC 256
+#define GEMM_NC 3072
+
+/* 쓰레드 풀: forward_network 안에서는 네트워크의 풀(thread_pool_current), 그 밖에서는 아래 기본 풀 */
+static ThreadPool *gemm_pool = 0;
+static int gemm_use_avx2 = -1;
+
+void gemm_set_threads(int n)
+{
+    if(n <= 0) n = num_cpu_cores();
+    if(gemm_pool && thread_pool_size(gemm_pool) == n) return;
+    thread_pool_free(gemm_pool);
+    gemm_pool = thread_pool_create(n);
+}
+
+int gemm_get_threads()
+{
+    return thread_pool_size(gemm_thread_pool());
+}
+
+ThreadPool *gemm_thread_pool()
+{
+    if(thread_pool_current()) return thread_pool_current();
+    if(!gemm_pool) gemm_set_threads(0);
+    return gemm_pool;
+}
+
+/* 쓰레드별 pack 버퍼 */
+static __thread float *pack_a_buf = 0;
+static __thread float *pack_b_buf = 0;
+
+/* gemm_thread_buf로 잡은 버퍼들. 쓰레드가 끝날 때 key의 destructor가 푼다
+ * (thread pool worker는 네트워크를 풀 때, 모델 교체 쓰레드는 warm-up 뒤에 끝난다) */
+#define GEMM_THREAD_BUFS 4
+static __thread void **thread_bufs[GEMM_THREAD_BUFS];
+static __thread int num_thread_bufs = 0;
+static pthread_key_t thread_bufs_key;
+static pthread_once_t thread_bufs_once = PTHREAD_ONCE_INIT;
+
+static void free_thread_bufs(void *unused)
+{
+    int i;
+    for(i = 0; i < num_thread_bufs; ++i){
+        free(*thread_bufs[i]);
+        *thread_bufs[i] = 0;
+    }
+    num_thread_bufs = 0;
+}
+
+static void make_thread_bufs_key(void)
+{
+    pthread_key_create(&thread_bufs_key, free_thread_bufs);
+}
+
+void *gemm_thread_buf(void **buf, size_t bytes)
+{
+    if(*buf) return *buf;
+    pthread_once(&thread_bufs_once, make_thread_bufs_key);
+    if(num_thread_bufs == GEMM_THREAD_BUFS) error("gemm_thread_buf: too many buffers");
+    *buf = calloc(bytes, 1);
+    thread_bufs[num_thread_bufs++] = buf;
+    // destructor는 값이 NULL이 아닐 때만 불린다
+    pthread_setspecific(thread_bufs_key, thread_bufs);
+    return *buf;
+}
+
+static float *get_pack_buf(float **buf, size_t n)
+{
+    return gemm_thread_buf((void **)buf, n*sizeof(float));
+}
+
+/* A의 mc x kc 블록을 MR행 panel로: panel마다 k 순서로 MR개씩 (ALPHA를 곱해 둔다) */
+static void pack_a(int mc, int kc, const float *A, int lda, float alpha, float *pa)
+{
+    int i, p, r;
+    for(i = 0; i < mc; i += GEMM_MR){
+        int mr = (mc - i < GEMM_MR) ? mc - i : GEMM_MR;
+        const float *a = A + i*lda;
+        for(p = 0; p < kc; ++p){
+            for(r = 0; r < mr; ++r) pa[r] = alpha*a[r*lda + p];
+            for(; r < GEMM_MR; ++r) pa[r] = 0;
+            pa += GEMM_MR;
+        }
+    }
+}
+
+/* B의 kc x nc 블록 중 NR열 panel 하나: k 순서로 NR개씩 */
+static void pack_b_panel(int kc, int nr, const float *B, int ldb, float *pb)
+{
+    int p, j;
+    for(p = 0; p < kc; ++p){
+        const float *b = B + p*ldb;
+        if(nr == GEMM_NR){
+            for(j = 0; j < GEMM_NR; ++j) pb[j] = b[j];
+        } else {
+            for(j = 0; j < nr; ++j) pb[j] = b[j];
+            for(; j < GEMM_NR; ++j) pb[j] = 0;
+        }
+        pb += GEMM_NR;
+    }
+}
+
+/* add가 0이면 C에 더하지 않고 덮어쓴다 (첫 K 블록, C를 미리 0으로 채울 필요 없음) */
+static void kernel_6x16_c(int kc, const float *a, const float *b, float *c, int ldc, int add)
+{
+    float acc[GEMM_MR][GEMM_NR] = {{0}};
+    int p, i, j;
+    for(p = 0; p < kc; ++p){
+        for(i = 0; i < GEMM_MR; ++i){
+            float ai = a[i];
+            for(j = 0; j < GEMM_NR; ++j) acc[i][j] += ai*b[j];
+        }
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+    for(i = 0; i < GEMM_MR; ++i){
+        for(j = 0; j < GEMM_NR; ++j) c[i*ldc + j] = add ? c[i*ldc + j] + acc[i][j] : acc[i][j];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("avx2,fma")))
+static void kernel_6x16_avx2(int kc, const float *a, const float *b, float *c, int ldc, int add)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+    __m256 b0, b1, ai;
+    int p;
+
+    for(p = 0; p < kc; ++p){
+        b0 = _mm256_loadu_ps(b);
+        b1 = _mm256_loadu_ps(b + 8);
+        ai = _mm256_broadcast_ss(a + 0); c00 = _mm256_fmadd_ps(ai, b0, c00); c01 = _mm256_fmadd_ps(ai, b1, c01);
+        ai = _mm256_broadcast_ss(a + 1); c10 = _mm256_fmadd_ps(ai, b0, c10); c11 = _mm256_fmadd_ps(ai, b1, c11);
+        ai = _mm256_broadcast_ss(a + 2); c20 = _mm256_fmadd_ps(ai, b0, c20); c21 = _mm256_fmadd_ps(ai, b1, c21);
+        ai = _mm256_broadcast_ss(a + 3); c30 = _mm256_fmadd_ps(ai, b0, c30); c31 = _mm256_fmadd_ps(ai, b1, c31);
+        ai = _mm256_broadcast_ss(a + 4); c40 = _mm256_fmadd_ps(ai, b0, c40); c41 = _mm256_fmadd_ps(ai, b1, c41);
+        ai = _mm256_broadcast_ss(a + 5); c50 = _mm256_fmadd_ps(ai, b0, c50); c51 = _mm256_fmadd_ps(ai, b1, c51);
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+#define STORE_ROW(r, lo, hi) \
+    if(add){ \
+        lo = _mm256_add_ps(_mm256_loadu_ps(c + r*ldc), lo); \
+        hi = _mm256_add_ps(_mm256_loadu_ps(c + r*ldc + 8), hi); \
+    } \
+    _mm256_storeu_ps(c + r*ldc, lo); \
+    _mm256_storeu_ps(c + r*ldc + 8, hi);
+    STORE_ROW(0, c00, c01)
+    STORE_ROW(1, c10, c11)
+    STORE_ROW(2, c20, c21)
+    STORE_ROW(3, c30, c31)
+    STORE_ROW(4, c40, c41)
+    STORE_ROW(5, c50, c51)
+#undef STORE_ROW
+}
+#endif
+
+static void micro_kernel(int kc, const float *a, const float *b, float *c, int ldc, int add)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if(gemm_use_avx2) {
+        kernel_6x16_avx2(kc, a, b, c, ldc, add);
+        return;
+    }
+#endif
+    kernel_6x16_c(kc, a, b, c, ldc, add);
+}
+
+/* 마지막 K 블록이 끝난 타일이 캐시에 있을 때 bias와 activation (LINEAR, LEAKY)을 적용 */
+static void gemm_epilogue(float *c, int ldc, int mr, int nr, const float *bias, ACTIVATION act)
+{
+    int i, j;
+    for(i = 0; i < mr; ++i){
+        float b = bias[i];
+        float *row = c + i*ldc;
+        if(act == LEAKY){
+            for(j = 0; j < nr; ++j){
+                float v = row[j] + b;
+                row[j] = (v > 0) ? v : .1f*v;
+            }
+        } else {
+            for(j = 0; j < nr; ++j) row[j] += b;
+        }
+    }
+}
+
+typedef struct {
+    int M, N, K;
+    float ALPHA;
+    const float *A; int lda;
+    const float *B; int ldb;
+    float *C; int ldc;
+    int jc, pc, nc, kc;     // 현재 B 블록
+    int n_panels;           // B 블록의 NR panel 수
+    int m_blocks, n_splits;
+    float *pb;              // pack된 B 블록 (호출 쓰레드 소유)
+    int accumulate;         // 0이면 C를 덮어쓴다
+    const float *bias;      // 있으면 마지막 K 블록 뒤에 bias + act
+    ACTIVATION act;
+} GemmJob;
+
+static void pack_b_task(void *arg, int task, int thread)
+{
+    GemmJob *g = (GemmJob*)arg;
+    int per = (g->n_panels + g->n_splits - 1) / g->n_splits;
+    int q, end = (task + 1)*per;
+    if(end > g->n_panels) end = g->n_panels;
+    for(q = task*per; q < end; ++q){
+        int j = q*GEMM_NR;
+        int nr = (g->nc - j < GEMM_NR) ? g->nc - j : GEMM_NR;
+        pack_b_panel(g->kc, nr, g->B + g->pc*g->ldb + g->jc + j, g->ldb, g->pb + (size_t)q*g->kc*GEMM_NR);
+    }
+}
+
+/* task = (M 블록, N 조각). A 블록을 pack하고 맡은 NR panel들에 대해 마이크로 커널을 돌린다 */
+static void compute_task(void *arg, int task, int thread)
+{
+    GemmJob *g = (GemmJob*)arg;
+    int ib = task / g->n_splits;
+    int s = task % g->n_splits;
+    int ic = ib*GEMM_MC;
+    int mc = (g->M - ic < GEMM_MC) ? g->M - ic : GEMM_MC;
+    int per = (g->n_panels + g->n_splits - 1) / g->n_splits;
+    int q0 = s*per, q1 = (s + 1)*per;
+    float *pa = get_pack_buf(&pack_a_buf, (size_t)GEMM_MC*GEMM_KC);
+    float tmp[GEMM_MR*GEMM_NR];
+    int add = g->accumulate || g->pc > 0;
+    int last = g->pc + g->kc >= g->K;
+    int q, i, r, j;
+
+    if(q1 > g->n_panels) q1 = g->n_panels;
+    if(q0 >= q1) return;
+    pack_a(mc, g->kc, g->A + ic*g->lda + g->pc, g->lda, g->ALPHA, pa);
+
+    for(q = q0; q < q1; ++q){
+        int jj = q*GEMM_NR;
+        int nr = (g->nc - jj < GEMM_NR) ? g->nc - jj : GEMM_NR;
+        const float *pb = g->pb + (size_t)q*g->kc*GEMM_NR;
+        for(i = 0; i < mc; i += GEMM_MR){
+            int mr = (mc - i < GEMM_MR) ? mc - i : GEMM_MR;
+            float *c = g->C + (ic + i)*g->ldc + g->jc + jj;
+            const float *a = pa + i*g->kc;
+            if(mr == GEMM_MR && nr == GEMM_NR){
+                micro_kernel(g->kc, a, pb, c, g->ldc, add);
+            } else {
+                // 가장자리 타일은 임시 버퍼에 계산해서 유효한 부분만 옮긴다
+                micro_kernel(g->kc, a, pb, tmp, GEMM_NR, 0);
+                for(r = 0; r < mr; ++r){
+                    for(j = 0; j < nr; ++j){
+                        c[r*g->ldc + j] = add ? c[r*g->ldc + j] + tmp[r*GEMM_NR + j] : tmp[r*GEMM_NR + j];
+                    }
+                }
+            }
+            if(last && g->bias) gemm_epilogue(c, g->ldc, mr, nr, g->bias + ic + i, g->act);
+        }
+    }
+}
+
+static void gemm_nn_run(int M, int N, int K, float ALPHA,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc,
+        int accumulate, const float *bias, ACTIVATION act)
+{
+    GemmJob g;
+    ThreadPool *pool = gemm_thread_pool();
+    int threads, t;
+
+    if(M <= 0 || N <= 0 || K <= 0) return;
+    if(gemm_use_avx2 < 0) gemm_use_avx2 = cpu_supports_avx2();
+    threads = thread_pool_size(pool);
+    // 작은 행렬은 쓰레드를 깨우는 비용이 더 크다
+    if(2.0*M*N*K < 2e6) threads = 1;
+
+    g.M = M; g.N = N; g.K = K; g.ALPHA = ALPHA;
+    g.A = A; g.lda = lda; g.B = B; g.ldb = ldb; g.C = C; g.ldc = ldc;
+    g.accumulate = accumulate; g.bias = bias; g.act = act;
+    g.pb = get_pack_buf(&pack_b_buf, (size_t)GEMM_KC*GEMM_NC);
+    g.m_blocks = (M + GEMM_MC - 1) / GEMM_MC;
+
+    for(g.jc = 0; g.jc < N; g.jc += GEMM_NC){
+        g.nc = (N - g.jc < GEMM_NC) ? N - g.jc : GEMM_NC;
+        g.n_panels = (g.nc + GEMM_NR - 1) / GEMM_NR;
+        // M 블록이 쓰레드 수보다 적으면 N 방향으로도 나눈다
+        g.n_splits = (threads*2 + g.m_blocks - 1) / g.m_blocks;
+        if(threads == 1) g.n_splits = 1;
+        if(g.n_splits > g.n_panels) g.n_splits = g.n_panels;
+        for(g.pc = 0; g.pc < K; g.pc += GEMM_KC){
+            g.kc = (K - g.pc < GEMM_KC) ? K - g.pc : GEMM_KC;
+            if(threads == 1){
+                pack_b_task(&g, 0, 0);
+                for(t = 0; t < g.m_blocks; ++t) compute_task(&g, t, 0);
+            } else {
+                thread_pool_run(pool, pack_b_task, &g, g.n_splits);
+                thread_pool_run(pool, compute_task, &g, g.m_blocks*g.n_splits);
+            }
+        }
+    }
+}
+
+void gemm_nn_packed(int M, int N, int K, float ALPHA,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc)
+{
+    gemm_nn_run(M, N, K, ALPHA, A, lda, B, ldb, C, ldc, 1, 0, LINEAR);
+}
+
+void gemm_nn_fused(int M, int N, int K,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc,
+        const float *bias, ACTIVATION act)
+{
+    gemm_nn_run(M, N, K, 1, A, lda, B, ldb, C, ldc, 0, bias, act);
+}
+
 void gemm_cpu(int TA, int TB, int M, int N, int K, float ALPHA, 
         float *A, int lda, 
         float *B, int ldb,
@@ -146,12 +462,20 @@ void gemm_cpu(int TA, int TB, int M, int N, int K, float ALPHA,
 {
     //printf("cpu: %d %d %d %d %d %f %d %d %f %d\n",TA, TB, M, N, K, ALPHA, lda, ldb, BETA, ldc);
     int i, j;
-    for(i = 0; i < M; ++i){
-        for(j = 0; j < N; ++j){
-            C[i*ldc + j] *= BETA;
+    if(BETA != 1){
+        for(i = 0; i < M; ++i){
+            for(j = 0; j < N; ++j){
+                C[i*ldc + j] *= BETA;
+            }
         }
     }
 
+    // 추론(forward_convolutional_layer)은 항상 NN
+    if (!TA && !TB) {
+        gemm_nn_packed(M, N, K, ALPHA, A, lda, B, ldb, C, ldc);
+        return;
+    }
+
 	int t;
 	#pragma omp parallel for
 	for (t = 0; t < M; ++t) {
@@ -166,6 +490,106 @@ void gemm_cpu(int TA, int TB, int M, int N, int K, float ALPHA,
 	}
 }
 
+
+static double time_gemm_nn(int packed, int m, int n, int k, float *a, float *b, float *c, int iters)
+{
+    int i;
+    double start = what_time_is_it_now();
+    for(i = 0; i < iters; ++i){
+        if(packed) gemm_nn_packed(m, n, k, 1, a, k, b, n, c, n);
+        else gemm_nn(m, n, k, 1, a, k, b, n, c, n);
+    }
+    return (what_time_is_it_now() - start) / iters;
+}
+
+void time_random_matrix(int TA, int TB, int m, int k, int n)
+{
+    float *a;
+    if(!TA) a = random_matrix(m,k);
+    else a = random_matrix(k,m);
+    int lda = (!TA)?k:m;
+    float *b;
+    if(!TB) b = random_matrix(k,n);
+    else b = random_matrix(n,k);
+    int ldb = (!TB)?n:k;
+
+    float *c = random_matrix(m,n);
+    int i;
+    double start = what_time_is_it_now(), t;
+    for(i = 0; i<10; ++i){
+        gemm_cpu(TA,TB,m,n,k,1,a,lda,b,ldb,1,c,n);
+    }
+    t = (what_time_is_it_now() - start) / 10;
+    printf("Matrix Multiplication %dx%d * %dx%d, TA=%d, TB=%d: %lf ms, %.2f GFLOP/s\n",m,k,k,n, TA, TB, t*1000, 2.0*m*n*k/t*1e-9);
+    free(a);
+    free(b);
+    free(c);
+}
+
+/* cfg의 convolutional 레이어마다 forward와 같은 모양(M=filters, N=out_h*out_w, K=size*size*c)으로
+ * 기존 gemm_nn과 packed gemm(1 쓰레드, threads 쓰레드)의 속도와 오차를 비교한다 */
+void test_gemm(char *cfgfile, int iters, int threads)
+{
+    network net = parse_network_cfg(cfgfile);
+    double t_naive, t_one, t_all, sum_naive = 0, sum_one = 0, sum_all = 0, flops, sum_flops = 0;
+    int i;
+
+    if(iters < 1) iters = 1;
+    if(threads <= 0) threads = num_cpu_cores();
+    if(gemm_use_avx2 < 0) gemm_use_avx2 = cpu_supports_avx2();
+    printf("\n%s, kernel %s, %d threads, %d iterations\n", cfgfile,
+            gemm_use_avx2 ? "avx2/fma 6x16" : "portable 6x16", threads, iters);
+    printf("layer     M       N      K   GFLOP |  naive ms  GF/s | packed-1 ms  GF/s | packed-%d ms  GF/s | rel err\n", threads);
+
+    for(i = 0; i < net.n; ++i){
+        layer l = net.layers[i];
+        int m, n, k;
+        float *a, *b, *c0, *c1;
+        if(l.type != CONVOLUTIONAL) continue;
+        m = l.n;
+        k = l.size*l.size*l.c;
+        n = l.out_w*l.out_h;
+        flops = 2.0*m*n*k;
+        a = random_matrix(m, k);
+        b = random_matrix(k, n);
+        c0 = calloc(m*n, sizeof(float));
+        c1 = calloc(m*n, sizeof(float));
+
+        t_naive = time_gemm_nn(0, m, n, k, a, b, c0, 1);
+        gemm_set_threads(1);
+        time_gemm_nn(1, m, n, k, a, b, c1, 1);
+        t_one = time_gemm_nn(1, m, n, k, a, b, c1, iters);
+        gemm_set_threads(threads);
+        t_all = time_gemm_nn(1, m, n, k, a, b, c1, iters);
+
+        // 누적된 c1을 한 번 계산한 값으로 맞춰서 비교
+        memset(c1, 0, m*n*sizeof(float));
+        gemm_nn_packed(m, n, k, 1, a, k, b, n, c1, n);
+
+        printf("%5d %5d %7d %6d %7.3f | %9.2f %5.1f | %11.2f %5.1f | %11.2f %5.1f | %.1e\n",
+                i, m, n, k, flops*1e-9,
+                t_naive*1000, flops/t_naive*1e-9,
+                t_one*1000, flops/t_one*1e-9,
+                t_all*1000, flops/t_all*1e-9,
+                max_rel_diff(c0, c1, m*n));
+        sum_naive += t_naive;
+        sum_one += t_one;
+        sum_all += t_all;
+        sum_flops += flops;
+        free(a);
+        free(b);
+        free(c0);
+        free(c1);
+    }
+    printf("total             %13.3f | %9.2f %5.1f | %11.2f %5.1f | %11.2f %5.1f | speedup %.1fx / %.1fx\n",
+            sum_flops*1e-9,
+            sum_naive*1000, sum_flops/sum_naive*1e-9,
+            sum_one*1000, sum_flops/sum_one*1e-9,
+            sum_all*1000, sum_flops/sum_all*1e-9,
+            sum_naive/sum_one, sum_naive/sum_all);
+    free_network(net);
+}
+
 #ifdef GPU
 
 #include <math.h>
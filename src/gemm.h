@@ -1,6 +1,9 @@
 #ifndef GEMM_H
 #define GEMM_H
 
+#include "activations.h"
+#include "thread_pool.h"
+
 void gemm_bin(int M, int N, int K, float ALPHA, 
         char  *A, int lda, 
         float *B, int ldb,
@@ -18,6 +21,26 @@ void gemm_cpu(int TA, int TB, int M, int N, int K, float ALPHA,
         float BETA,
         float *C, int ldc);
 
+/* packed, register-blocked NN gemm (C += ALPHA*A*B), 쓰레드 풀로 병렬 처리 */
+void gemm_nn_packed(int M, int N, int K, float ALPHA,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc);
+/* 추론용: C = act(A*B + bias) (C를 덮어쓴다, bias는 행마다 하나). act는 LINEAR, LEAKY만 */
+void gemm_nn_fused(int M, int N, int K,
+        float *A, int lda,
+        float *B, int ldb,
+        float *C, int ldc,
+        const float *bias, ACTIVATION act);
+/* 네트워크 밖에서 쓰는 기본 gemm 쓰레드 수 (0이면 CPU 코어 수) */
+void gemm_set_threads(int n);
+int gemm_get_threads();
+/* 현재 풀 (forward_network 안이면 네트워크의 풀) */
+ThreadPool *gemm_thread_pool();
+/* 쓰레드별 작업 버퍼 (*buf는 __thread 변수). 처음 부를 때 bytes만큼 잡고, 쓰레드가 끝나면 풀고 *buf를 0으로 */
+void *gemm_thread_buf(void **buf, size_t bytes);
+void test_gemm(char *cfgfile, int iters, int threads);
+
 #ifdef GPU
 void gemm_ongpu(int TA, int TB, int M, int N, int K, float ALPHA, 
         float *A_gpu, int lda, 
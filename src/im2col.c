@@ -1,4 +1,5 @@
 #include "im2col.h"
+#include "thread_pool.h"
 #include <stdio.h>
 float im2col_get_pixel(float *im, int height, int width, int channels,
                         int row, int col, int channel, int pad)
@@ -13,16 +14,25 @@ float im2col_get_pixel(float *im, int height, int width, int channels,
 
 //From Berkeley Vision's Caffe!
 //https://github.com/BVLC/caffe/blob/master/LICENSE
-void im2col_cpu(float* data_im,
-     int channels,  int height,  int width,
-     int ksize,  int stride, int pad, float* data_col) 
+typedef struct {
+    float *data_im;
+    int channels, height, width, ksize, stride, pad;
+    float *data_col;
+} im2col_args;
+
+/* im2col 결과의 행 [begin, end) */
+static void im2col_range(void *arg, int begin, int end)
 {
+    im2col_args *p = (im2col_args *)arg;
+    float *data_im = p->data_im;
+    float *data_col = p->data_col;
+    int channels = p->channels, height = p->height, width = p->width;
+    int ksize = p->ksize, stride = p->stride, pad = p->pad;
     int c,h,w;
     int height_col = (height + 2*pad - ksize) / stride + 1;
     int width_col = (width + 2*pad - ksize) / stride + 1;
 
-    int channels_col = channels * ksize * ksize;
-    for (c = 0; c < channels_col; ++c) {
+    for (c = begin; c < end; ++c) {
         int w_offset = c % ksize;
         int h_offset = (c / ksize) % ksize;
         int c_im = c / ksize / ksize;
@@ -38,3 +48,13 @@ void im2col_cpu(float* data_im,
     }
 }
 
+void im2col_cpu(float* data_im,
+     int channels,  int height,  int width,
+     int ksize,  int stride, int pad, float* data_col) 
+{
+    int height_col = (height + 2*pad - ksize) / stride + 1;
+    int width_col = (width + 2*pad - ksize) / stride + 1;
+    im2col_args args = {data_im, channels, height, width, ksize, stride, pad, data_col};
+    parallel_for(channels*ksize*ksize, PARALLEL_GRAIN(height_col*width_col), im2col_range, &args);
+}
+
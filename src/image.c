@@ -2,9 +2,44 @@
 #include "utils.h"
 #include "blas.h"
 #include "cuda.h"
+#include "roi.h"
 #include <stdio.h>
 #include <math.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
+/* stb 디코더/인코더의 임시 메모리. image_codec_arena로 arena를 건 쓰레드는 heap 대신 arena에서 받는다
+ * (arena에서 받은 포인터의 free는 무시, 다음 arena_reset 때 한꺼번에 비워진다) */
+static __thread Arena *codec_arena = 0;
+
+void image_codec_arena(Arena *a) {
+    codec_arena = a;
+}
+
+static void *codec_malloc(size_t size) {
+    return codec_arena ? arena_alloc(codec_arena, size) : malloc(size);
+}
+
+static void *codec_realloc(void *p, size_t old_size, size_t size) {
+    if (codec_arena && (p == NULL || arena_owns(codec_arena, p)))
+        return arena_realloc(codec_arena, p, old_size, size);
+    return realloc(p, size);
+}
+
+static void codec_free(void *p) {
+    if (codec_arena && arena_owns(codec_arena, p))
+        return;
+    free(p);
+}
+
+#define STBI_MALLOC(sz) codec_malloc(sz)
+#define STBI_REALLOC_SIZED(p, oldsz, newsz) codec_realloc(p, oldsz, newsz)
+#define STBI_FREE(p) codec_free(p)
+#define STBIW_MALLOC(sz) codec_malloc(sz)
+#define STBIW_REALLOC_SIZED(p, oldsz, newsz) codec_realloc(p, oldsz, newsz)
+#define STBIW_FREE(p) codec_free(p)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -223,59 +258,64 @@ void draw_detections(image im, int num, float thresh, box *boxes, float **probs,
     }
 }
 
-void get_detections(image im, TrafficLight* tl, int num, float thresh, box *boxes, float **probs, char **names, image **alphabet, int classes) {
+/* get_region_detections가 남긴 검출(박스마다 class 하나)을 그리고 신호등의 차량 수를 센다. 관심 영역(tl->roi) 밖의 차는 뺀다.
+ * labels는 [classes*8] (class, 글자 크기)별 label 이미지 캐시. 처음 쓸 때 만들고 이후엔 다시 쓴다 (0이면 매번 만든다) */
+void get_detections(image im, TrafficLight* tl, detections *d, char **names, image **alphabet, image *labels, int classes) {
     int i;
-    int cnt = 0;
-
-    for (i = 0; i < num; ++i) {
-        int class_id = max_index(probs[i], classes);
-        float prob = probs[i][class_id];
-        if (prob > thresh) {
-            cnt++;
-            int width = im.h * .012;
-
-            int offset = class_id * 123457 % classes;
-            float red = get_color(2, offset, classes);
-            float green = get_color(1, offset, classes);
-            float blue = get_color(0, offset, classes);
-            float rgb[3];
-
-            rgb[0] = red;
-            rgb[1] = green;
-            rgb[2] = blue;
-            box b = boxes[i];
-
-            int left = (b.x - b.w / 2.) * im.w;
-            int right = (b.x + b.w / 2.) * im.w;
-            int top = (b.y - b.h / 2.) * im.h;
-            int bot = (b.y + b.h / 2.) * im.h;
-
-            if (left < 0) left = 0;
-            if (right > im.w - 1) right = im.w - 1;
-            if (top < 0) top = 0;
-            if (bot > im.h - 1) bot = im.h - 1;
-
-            //printf("  %s: %.0f%% (%d, %d)\n", names[class_id], prob*100, (left+right)/2, (top+bot)/2);
-
-            draw_box_width(im, left, top, right, bot, width, red, green, blue);
-            if (alphabet) {
-                image label = get_label(alphabet, names[class_id], (im.h * .03) / 10);
-                draw_label(im, top + width, left, label, rgb);
-            }
-
-            if (strcmp(names[class_id], "car-side") == 0)
-                tl->side++;
-            else if (strcmp(names[class_id], "car-back") == 0)
-                tl->back++;
-            else if (strcmp(names[class_id], "car-front") == 0)
-                tl->front++;
-            else
-                tl->accident++;
 
+    for (i = 0; i < d->n; ++i) {
+        int class_id = d->class_id[i];
+        int width = im.h * .012;
+
+        int offset = class_id * 123457 % classes;
+        float red = get_color(2, offset, classes);
+        float green = get_color(1, offset, classes);
+        float blue = get_color(0, offset, classes);
+        float rgb[3];
+
+        rgb[0] = red;
+        rgb[1] = green;
+        rgb[2] = blue;
+        box b = {d->x[i], d->y[i], d->w[i], d->h[i]};
+
+        if (tl->roi && !roi_keep(tl->roi, b))
+            continue;
+
+        int left = (b.x - b.w / 2.) * im.w;
+        int right = (b.x + b.w / 2.) * im.w;
+        int top = (b.y - b.h / 2.) * im.h;
+        int bot = (b.y + b.h / 2.) * im.h;
+
+        if (left < 0) left = 0;
+        if (right > im.w - 1) right = im.w - 1;
+        if (top < 0) top = 0;
+        if (bot > im.h - 1) bot = im.h - 1;
+
+        //printf("  %s: %.0f%% (%d, %d)\n", names[class_id], d->prob[i]*100, (left+right)/2, (top+bot)/2);
+
+        draw_box_width(im, left, top, right, bot, width, red, green, blue);
+        if (alphabet && labels) {
+            int size = (im.h * .03) / 10;
+            image *label = labels + class_id * 8 + (size > 7 ? 7 : size);
+            if (label->data == 0)
+                *label = get_label(alphabet, names[class_id], size);
+            draw_label(im, top + width, left, *label, rgb);
+        } else if (alphabet) {
+            image label = get_label(alphabet, names[class_id], (im.h * .03) / 10);
+            draw_label(im, top + width, left, label, rgb);
+            free_image(label);
         }
+
+        if (strcmp(names[class_id], "car-side") == 0)
+            tl->side++;
+        else if (strcmp(names[class_id], "car-back") == 0)
+            tl->back++;
+        else if (strcmp(names[class_id], "car-front") == 0)
+            tl->front++;
+        else
+            tl->accident++;
     }
     //printf("  front %d\tback %d\tside %d\n", tl->front, tl->back, tl->side);
-    //printf("  total %d\n", cnt);
 }
 
 #ifdef OPENCV
@@ -754,6 +794,71 @@ void save_image_png(image im, const char *name) {
     if (!success) fprintf(stderr, "Failed to write image %s\n", buff);
 }
 
+typedef struct {
+    int fd;
+    int len;
+    int failed;
+    unsigned char buf[16384];
+} fd_writer;
+
+static void fd_write_flush(fd_writer *f) {
+    int off = 0;
+    while (off < f->len) {
+        ssize_t n = write(f->fd, f->buf + off, f->len - off);
+        if (n <= 0) {
+            f->failed = 1;
+            break;
+        }
+        off += n;
+    }
+    f->len = 0;
+}
+
+/* stb jpeg 인코더는 1바이트씩 넘기므로 모아서 write */
+static void fd_write(void *context, void *data, int size) {
+    fd_writer *f = context;
+    if (f->len + size > sizeof (f->buf))
+        fd_write_flush(f);
+    if (size > sizeof (f->buf)) {
+        memcpy(f->buf, data, sizeof (f->buf));
+        f->len = sizeof (f->buf);
+        fd_write_flush(f);
+        fd_write(f, (unsigned char *) data + sizeof (f->buf), size - sizeof (f->buf));
+        return;
+    }
+    memcpy(f->buf + f->len, data, size);
+    f->len += size;
+}
+
+/* <name>.jpg를 OpenCV, stdio 없이 stb jpeg 인코더로 쓴다 (8bit 변환 버퍼는 codec 메모리에서 받는다) */
+int save_image_jpg_stb(image im, const char *name, int quality) {
+    char buff[256];
+    fd_writer f;
+    int i, k, ok;
+    unsigned char *data = codec_malloc(im.w * im.h * im.c);
+
+    for (k = 0; k < im.c; ++k) {
+        for (i = 0; i < im.w * im.h; ++i) {
+            data[i * im.c + k] = (unsigned char) (255 * im.data[i + k * im.w * im.h]);
+        }
+    }
+    snprintf(buff, sizeof (buff), "%s.jpg", name);
+    f.fd = open(buff, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    f.len = 0;
+    f.failed = f.fd < 0;
+    ok = !f.failed && stbi_write_jpg_to_func(fd_write, &f, im.w, im.h, im.c, data, quality);
+    if (f.fd >= 0) {
+        fd_write_flush(&f);
+        close(f.fd);
+    }
+    codec_free(data);
+    if (!ok || f.failed) {
+        fprintf(stderr, "Failed to write image %s\n", buff);
+        return 0;
+    }
+    return 1;
+}
+
 void save_image(image im, const char *name) {
 #ifdef OPENCV
     save_image_jpg(im, name);
@@ -1367,16 +1472,17 @@ void test_resize(char *filename) {
 #endif
 }
 
-image load_image_stb(char *filename, int channels) {
-    int w, h, c;
-    unsigned char *data = stbi_load(filename, &w, &h, &c, channels);
-    if (!data) {
-        fprintf(stderr, "Cannot load image \"%s\"\nSTB Reason: %s\n", filename, stbi_failure_reason());
-        return make_image(0, 0, 0);
-    }
-    if (channels) c = channels;
-    int i, j, k;
+/* 8bit interleaved(HWC) -> float planar(CHW, 0~1) */
+image rgb8_to_image(unsigned char *data, int w, int h, int c) {
     image im = make_image(w, h, c);
+    rgb8_to_image_into(data, im);
+    return im;
+}
+
+/* rgb8_to_image와 같고 im(w, h, c가 정해진 버퍼)에 쓴다 */
+void rgb8_to_image_into(unsigned char *data, image im) {
+    int i, j, k;
+    int w = im.w, h = im.h, c = im.c;
     for (k = 0; k < c; ++k) {
         for (j = 0; j < h; ++j) {
             for (i = 0; i < w; ++i) {
@@ -1386,7 +1492,41 @@ image load_image_stb(char *filename, int channels) {
             }
         }
     }
-    free(data);
+}
+
+image load_image_stb(char *filename, int channels) {
+    int w, h, c;
+    unsigned char *data = stbi_load(filename, &w, &h, &c, channels);
+    if (!data) {
+        fprintf(stderr, "Cannot load image \"%s\"\nSTB Reason: %s\n", filename, stbi_failure_reason());
+        return make_image(0, 0, 0);
+    }
+    if (channels) c = channels;
+    image im = rgb8_to_image(data, w, h, c);
+    stbi_image_free(data);
+    return im;
+}
+
+/* JPEG 버퍼를 8bit interleaved RGB로 디코딩한다. 실패하면 0 */
+unsigned char *load_rgb8_memory(unsigned char *buf, int size, int *w, int *h) {
+    int c;
+    unsigned char *data = stbi_load_from_memory(buf, size, w, h, &c, 3);
+    if (!data)
+        fprintf(stderr, "Cannot decode image (%d bytes)\nSTB Reason: %s\n", size, stbi_failure_reason());
+    return data;
+}
+
+/* 소켓으로 받은 JPEG 버퍼를 디스크를 거치지 않고 바로 디코딩한다 */
+image load_image_memory(unsigned char *buf, int size, int channels) {
+    int w, h, c;
+    unsigned char *data = stbi_load_from_memory(buf, size, &w, &h, &c, channels);
+    if (!data) {
+        fprintf(stderr, "Cannot decode image (%d bytes)\nSTB Reason: %s\n", size, stbi_failure_reason());
+        return make_image(0, 0, 0);
+    }
+    if (channels) c = channels;
+    image im = rgb8_to_image(data, w, h, c);
+    stbi_image_free(data);
     return im;
 }
 
@@ -8,6 +8,8 @@
 #include <math.h>
 #include "box.h"
 #include "server.h"
+#include "postprocess.h"
+#include "arena.h"
 
 typedef struct {
     int h;
@@ -24,7 +26,7 @@ void draw_bbox(image a, box bbox, int w, float r, float g, float b);
 void draw_label(image a, int r, int c, image label, const float *rgb);
 void write_label(image a, int r, int c, image *characters, char *string, float *rgb);
 void draw_detections(image im, int num, float thresh, box *boxes, float **probs, char **names, image **labels, int classes);
-void get_detections(image im, TrafficLight* tl, int num, float thresh, box *boxes, float **probs, char **names, image **labels, int classes);
+void get_detections(image im, TrafficLight* tl, detections *d, char **names, image **alphabet, image *labels, int classes);
 image image_distance(image a, image b);
 void scale_image(image m, float s);
 image crop_image(image im, int dx, int dy, int w, int h);
@@ -63,6 +65,7 @@ void show_image(image p, const char *name);
 void show_image_normalized(image im, const char *name);
 void save_image_png(image im, const char *name);
 void save_image(image p, const char *name);
+int save_image_jpg_stb(image im, const char *name, int quality);
 void show_images(image *ims, int n, char *window);
 void show_image_layers(image p, char *name);
 void show_image_collapsed(image p, char *name);
@@ -76,6 +79,12 @@ image float_to_image(int w, int h, int c, float *data);
 image copy_image(image p);
 image load_image(char *filename, int w, int h, int c);
 image load_image_color(char *filename, int w, int h);
+image load_image_memory(unsigned char *buf, int size, int channels);
+unsigned char *load_rgb8_memory(unsigned char *buf, int size, int *w, int *h);
+image rgb8_to_image(unsigned char *data, int w, int h, int c);
+void rgb8_to_image_into(unsigned char *data, image im);
+/* 이 쓰레드의 stb 디코딩/인코딩 임시 메모리를 a에서 받는다 (0이면 heap) */
+void image_codec_arena(Arena *a);
 image **load_alphabet();
 
 float get_pixel(image m, int x, int y, int c);
@@ -31,6 +31,14 @@ void free_layer(layer l)
 	if (l.scales)             free(l.scales);
 	if (l.scale_updates)      free(l.scale_updates);
 	if (l.weights)            free(l.weights);
+	if (l.winograd_weights)   free(l.winograd_weights);
+	if (l.weights_int8)       free(l.weights_int8);
+	if (l.weight_scales)      free(l.weight_scales);
+	if (l.weight_sums)        free(l.weight_sums);
+	if (l.input_scales)       free(l.input_scales);
+	if (l.xnor_weights)       free(l.xnor_weights);
+	if (l.xnor_alpha)         free(l.xnor_alpha);
+	if (l.xnor_tap_pop)       free(l.xnor_tap_pop);
 	if (l.weight_updates)     free(l.weight_updates);
 	if (l.delta)              free(l.delta);
 	if (l.output)             free(l.output);
@@ -3,6 +3,7 @@
 
 #include "activations.h"
 #include "stddef.h"
+#include <stdint.h>
 #include "tree.h"
 
 struct network_state;
@@ -42,6 +43,11 @@ typedef enum{
     SSE, MASKED, SMOOTH
 } COST_TYPE;
 
+// CPU 추론에서 convolutional 레이어를 계산하는 방법 (레이어를 만들 때 모양을 보고 정함)
+typedef enum{
+    CONV_IM2COL, CONV_1X1, CONV_WINOGRAD, CONV_XNOR
+} CONV_ALGO;
+
 struct layer{
     LAYER_TYPE type;
     ACTIVATION activation;
@@ -207,6 +213,18 @@ struct layer{
 
     size_t workspace_size;
 
+    CONV_ALGO conv_algo;
+    float *winograd_weights;
+    int fused;              // 추론용: batchnorm을 weight에 접고 bias, activation을 gemm 출력 단계에서 적용
+    int quantized;          // INT8 추론 (src/quantize.c)
+    signed char *weights_int8;  // pack된 int8 weight
+    float *weight_scales;   // 출력 채널별
+    int *weight_sums;       // 출력 채널별 sum(wq), 입력 zero point 보정용
+    float *input_scales;    // 입력 채널별 (calibration 범위 / 127)
+    uint64_t *xnor_weights; // xnor 레이어: 부호 bit로 pack한 weight (src/xnor_gemm.c)
+    float *xnor_alpha;      // 출력 채널별 mean|w|
+    int *xnor_tap_pop;      // 출력 채널, 커널 위치별 1 bit 수 (패딩 보정용)
+
     #ifdef GPU
     float *z_gpu;
     float *r_gpu;
@@ -1,5 +1,6 @@
 #include "maxpool_layer.h"
 #include "cuda.h"
+#include "thread_pool.h"
 #include <stdio.h>
 
 image get_maxpool_image(maxpool_layer l)
@@ -18,7 +19,7 @@ image get_maxpool_delta(maxpool_layer l)
     return float_to_image(w,h,c,l.delta);
 }
 
-maxpool_layer make_maxpool_layer(int batch, int h, int w, int c, int size, int stride, int padding)
+maxpool_layer make_maxpool_layer(int batch, int h, int w, int c, int size, int stride, int padding, int train)
 {
     maxpool_layer l = {0};
     l.type = MAXPOOL;
@@ -35,9 +36,11 @@ maxpool_layer make_maxpool_layer(int batch, int h, int w, int c, int size, int s
     l.size = size;
     l.stride = stride;
     int output_size = l.out_h * l.out_w * l.out_c * batch;
-    l.indexes = calloc(output_size, sizeof(int));
     l.output =  calloc(output_size, sizeof(float));
-    l.delta =   calloc(output_size, sizeof(float));
+    if(train){
+        l.indexes = calloc(output_size, sizeof(int));
+        l.delta =   calloc(output_size, sizeof(float));
+    }
     l.forward = forward_maxpool_layer;
     l.backward = backward_maxpool_layer;
     #ifdef GPU
@@ -45,7 +48,7 @@ maxpool_layer make_maxpool_layer(int batch, int h, int w, int c, int size, int s
     l.backward_gpu = backward_maxpool_layer_gpu;
     l.indexes_gpu = cuda_make_int_array(output_size);
     l.output_gpu  = cuda_make_array(l.output, output_size);
-    l.delta_gpu   = cuda_make_array(l.delta, output_size);
+    if(train) l.delta_gpu = cuda_make_array(l.delta, output_size);
     #endif
     fprintf(stderr, "max          %d x %d / %d  %4d x%4d x%4d   ->  %4d x%4d x%4d\n", size, size, stride, w, h, c, l.out_w, l.out_h, l.out_c);
     return l;
@@ -76,9 +79,17 @@ void resize_maxpool_layer(maxpool_layer *l, int w, int h)
     #endif
 }
 
-void forward_maxpool_layer(const maxpool_layer l, network_state state)
+typedef struct {
+    maxpool_layer l;
+    float *input;
+} maxpool_args;
+
+/* (batch, 채널) 쌍 [begin, end) */
+static void maxpool_range(void *arg, int begin, int end)
 {
-    int b,i,j,k,m,n;
+    maxpool_args *p = (maxpool_args *)arg;
+    const maxpool_layer l = p->l;
+    int bk,b,i,j,k,m,n;
     int w_offset = -l.pad;
     int h_offset = -l.pad;
 
@@ -86,33 +97,39 @@ void forward_maxpool_layer(const maxpool_layer l, network_state state)
     int w = l.out_w;
     int c = l.c;
 
-    for(b = 0; b < l.batch; ++b){
-        for(k = 0; k < c; ++k){
-            for(i = 0; i < h; ++i){
-                for(j = 0; j < w; ++j){
-                    int out_index = j + w*(i + h*(k + c*b));
-                    float max = -FLT_MAX;
-                    int max_i = -1;
-                    for(n = 0; n < l.size; ++n){
-                        for(m = 0; m < l.size; ++m){
-                            int cur_h = h_offset + i*l.stride + n;
-                            int cur_w = w_offset + j*l.stride + m;
-                            int index = cur_w + l.w*(cur_h + l.h*(k + b*l.c));
-                            int valid = (cur_h >= 0 && cur_h < l.h &&
-                                         cur_w >= 0 && cur_w < l.w);
-                            float val = (valid != 0) ? state.input[index] : -FLT_MAX;
-                            max_i = (val > max) ? index : max_i;
-                            max   = (val > max) ? val   : max;
-                        }
+    for(bk = begin; bk < end; ++bk){
+        b = bk / c;
+        k = bk % c;
+        for(i = 0; i < h; ++i){
+            for(j = 0; j < w; ++j){
+                int out_index = j + w*(i + h*(k + c*b));
+                float max = -FLT_MAX;
+                int max_i = -1;
+                for(n = 0; n < l.size; ++n){
+                    for(m = 0; m < l.size; ++m){
+                        int cur_h = h_offset + i*l.stride + n;
+                        int cur_w = w_offset + j*l.stride + m;
+                        int index = cur_w + l.w*(cur_h + l.h*(k + b*l.c));
+                        int valid = (cur_h >= 0 && cur_h < l.h &&
+                                     cur_w >= 0 && cur_w < l.w);
+                        float val = (valid != 0) ? p->input[index] : -FLT_MAX;
+                        max_i = (val > max) ? index : max_i;
+                        max   = (val > max) ? val   : max;
                     }
-                    l.output[out_index] = max;
-                    l.indexes[out_index] = max_i;
                 }
+                l.output[out_index] = max;
+                if(l.indexes) l.indexes[out_index] = max_i;
             }
         }
     }
 }
 
+void forward_maxpool_layer(const maxpool_layer l, network_state state)
+{
+    maxpool_args args = {l, state.input};
+    parallel_for(l.batch*l.c, PARALLEL_GRAIN(l.out_h*l.out_w*l.size*l.size), maxpool_range, &args);
+}
+
 void backward_maxpool_layer(const maxpool_layer l, network_state state)
 {
     int i;
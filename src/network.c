@@ -6,6 +6,9 @@
 #include "data.h"
 #include "utils.h"
 #include "blas.h"
+#include "gemm.h"
+#include "parser.h"
+#include "compiled_model.h"
 
 #include "crop_layer.h"
 #include "connected_layer.h"
@@ -148,7 +151,10 @@ void forward_network(network net, network_state state)
 {
     state.workspace = net.workspace;
     int i;
+    // 레이어 커널들(parallel_for, gemm)이 이 네트워크의 풀을 쓰게 한다
+    ThreadPool *prev = thread_pool_set_current(net.pool ? net.pool : gemm_thread_pool());
     for(i = 0; i < net.n; ++i){
+        double start = net.layer_times ? what_time_is_it_now() : 0;
         state.index = i;
         layer l = net.layers[i];
         if(l.delta){
@@ -156,7 +162,9 @@ void forward_network(network net, network_state state)
         }
         l.forward(l, state);
         state.input = l.output;
+        if(net.layer_times) net.layer_times[i] += what_time_is_it_now() - start;
     }
+    thread_pool_set_current(prev);
 }
 
 void update_network(network net)
@@ -335,8 +343,112 @@ void set_batch_network(network *net, int b)
     }
 }
 
+int fuse_network(network *net)
+{
+    int i, count = 0;
+#ifdef GPU
+    // GPU forward는 batchnorm을 따로 돌리므로 접지 않는다
+    if(gpu_index >= 0) return 0;
+#endif
+    for(i = 0; i < net->n; ++i){
+        layer *l = net->layers + i;
+        if(l->type != CONVOLUTIONAL) continue;
+        fuse_convolutional_layer(l);
+        if(l->fused) ++count;
+    }
+    return count;
+}
+
+void set_network_threads(network *net, int threads)
+{
+    if(threads <= 0) threads = num_cpu_cores();
+    if(net->pool && thread_pool_size(net->pool) == threads) return;
+    thread_pool_free(net->pool);
+    net->pool = thread_pool_create(threads);
+}
+
+int plan_network_memory(network *net)
+{
+    int n = net->n;
+    int i, j, b;
+    int *last_use, *assigned, *busy;
+    size_t *sizes;
+    size_t before = 0;
+    int count = 0;
+#ifdef GPU
+    if(gpu_index >= 0) return 0;
+#endif
+    if(n <= 0) return 0;
+    for(i = 0; i < n; ++i){
+        LAYER_TYPE t = net->layers[i].type;
+        if(t != CONVOLUTIONAL && t != MAXPOOL && t != AVGPOOL && t != ROUTE && t != REORG
+                && t != REORG_OLD && t != SHORTCUT && t != REGION) return 0;
+    }
+
+    // 레이어 i의 출력을 마지막으로 읽는 레이어. 마지막 레이어는 forward 뒤에도 읽으므로 끝까지 (n)
+    last_use = calloc(n, sizeof(int));
+    for(i = 0; i < n; ++i){
+        layer l = net->layers[i];
+        last_use[i] = (i == n-1) ? n : i+1;
+        if(l.type == ROUTE){
+            for(j = 0; j < l.n; ++j){
+                if(last_use[l.input_layers[j]] < i) last_use[l.input_layers[j]] = i;
+            }
+        }
+        if(l.type == SHORTCUT && last_use[l.index] < i) last_use[l.index] = i;
+    }
+
+    // 앞에서부터: 출력을 비어 있는 버퍼 중 가장 잘 맞는 것에 배치하고, 이번 레이어가 마지막으로 읽은 출력의 버퍼를 비운다
+    // (비우기를 배치 뒤에 하므로 레이어의 입력과 출력이 같은 버퍼가 되지 않는다)
+    assigned = calloc(n, sizeof(int));
+    busy = calloc(n, sizeof(int));
+    sizes = calloc(n, sizeof(size_t));
+    for(i = 0; i < n; ++i){
+        size_t need = (size_t)net->layers[i].batch*net->layers[i].outputs;
+        int best = -1;
+        before += need*sizeof(float);
+        for(b = 0; b < count; ++b){
+            if(busy[b]) continue;
+            if(best < 0) best = b;
+            else if(sizes[best] < need) best = (sizes[b] > sizes[best]) ? b : best;
+            else if(sizes[b] >= need && sizes[b] < sizes[best]) best = b;
+        }
+        if(best < 0) best = count++;
+        if(sizes[best] < need) sizes[best] = need;
+        busy[best] = 1;
+        assigned[i] = best;
+        for(j = 0; j <= i; ++j){
+            if(last_use[j] == i) busy[assigned[j]] = 0;
+        }
+    }
+
+    net->arenas = calloc(count, sizeof(float*));
+    net->n_arenas = count;
+    net->arena_bytes = 0;
+    for(b = 0; b < count; ++b){
+        net->arenas[b] = calloc(sizes[b], sizeof(float));
+        net->arena_bytes += sizes[b]*sizeof(float);
+    }
+    for(i = 0; i < n; ++i){
+        layer *l = net->layers + i;
+        free(l->output);
+        l->output = net->arenas[assigned[i]];
+    }
+    net->output = get_network_output(*net);
+    fprintf(stderr, "activations: %d layers %.1f MB -> %d shared buffers %.1f MB\n",
+            n, before/1048576., count, net->arena_bytes/1048576.);
+
+    free(last_use);
+    free(assigned);
+    free(busy);
+    free(sizes);
+    return count;
+}
+
 int resize_network(network *net, int w, int h)
 {
+    // 출력 버퍼를 공유 arena로 나눠 쓰는 추론 전용 네트워크는 크기를 바꿀 수 없다
+    if(net->arenas) error("Cannot resize a network with planned activation memory");
 #ifdef GPU
     cuda_set_device(net->gpu_index);
     if(gpu_index >= 0){
@@ -611,10 +723,20 @@ float network_accuracy_multi(network net, data d, int n)
 void free_network(network net)
 {
 	int i;
+	free_compiled_model(&net);
 	for (i = 0; i < net.n; ++i) {
+		// 공유 버퍼에 배치한 출력은 아래에서 한 번만 푼다
+		if (net.arenas) net.layers[i].output = 0;
 		free_layer(net.layers[i]);
 	}
+	for (i = 0; i < net.n_arenas; ++i) {
+		free(net.arenas[i]);
+	}
+	free(net.arenas);
 	free(net.layers);
+	free(net.input);
+	thread_pool_free(net.pool);
+	free(net.layer_times);
 #ifdef GPU
 	if (gpu_index >= 0) cuda_free(net.workspace);
 	else free(net.workspace);
@@ -626,3 +748,102 @@ void free_network(network net)
 	free(net.workspace);
 #endif
 }
+
+/* 레이어별 forward 시간 (iters번 평균)을 쓰레드 1개와 threads개로 재서 나란히 출력한다 */
+void test_network_threads(char *cfgfile, char *weightfile, int iters, int threads)
+{
+    network net = parse_network_cfg(cfgfile);
+    int counts[2];
+    double *times[2];
+    double total[2] = {0};
+    float *X;
+    int i, j, r;
+
+    if(weightfile) load_weights(&net, weightfile);
+    set_batch_network(&net, 1);
+    fuse_network(&net);
+    if(iters < 1) iters = 1;
+    counts[0] = 1;
+    counts[1] = (threads > 0) ? threads : num_cpu_cores();
+
+    X = calloc(net.w*net.h*net.c, sizeof(float));
+    for(i = 0; i < net.w*net.h*net.c; ++i) X[i] = rand_uniform(0, 1);
+    for(r = 0; r < 2; ++r){
+        set_network_threads(&net, counts[r]);
+        network_predict(net, X);
+        times[r] = calloc(net.n, sizeof(double));
+        net.layer_times = times[r];
+        for(j = 0; j < iters; ++j) network_predict(net, X);
+        net.layer_times = 0;
+        for(i = 0; i < net.n; ++i){
+            times[r][i] /= iters;
+            total[r] += times[r][i];
+        }
+    }
+
+    printf("\n%s, %d iterations (CPU 코어 %d개)\n", cfgfile, iters, num_cpu_cores());
+    printf("layer  type           outputs | %2d thread ms | %2d threads ms  speedup\n", counts[0], counts[1]);
+    for(i = 0; i < net.n; ++i){
+        printf("%5d  %-13s %8d | %12.2f | %13.2f  %6.2fx\n", i, get_layer_string(net.layers[i].type), net.layers[i].outputs,
+                times[0][i]*1000, times[1][i]*1000, times[1][i] > 0 ? times[0][i]/times[1][i] : 0);
+    }
+    printf("total                         | %12.2f | %13.2f  %6.2fx\n", total[0]*1000, total[1]*1000, total[0]/total[1]);
+
+    free(times[0]);
+    free(times[1]);
+    free(X);
+    free_network(net);
+}
+
+typedef struct {
+    char *cfgfile;
+    int inference;
+} MemoryRun;
+
+/* 자식 프로세스: 네트워크를 만들고 forward 한 번. result[0] = activation 버퍼 bytes */
+static void memory_child(void *arg, double *result)
+{
+    MemoryRun *r = arg;
+    network net;
+    float *X;
+    int j;
+
+    net = r->inference ? parse_network_cfg_inference(r->cfgfile, 1) : parse_network_cfg_custom(r->cfgfile, 1);
+    // 추론 전용 빌드는 weight를 초기화하지 않으므로 (파일에서 읽는다) 학습용과 같이 채워 둔다
+    for(j = 0; r->inference && j < net.n; ++j){
+        layer l = net.layers[j];
+        int k;
+        if(l.type != CONVOLUTIONAL) continue;
+        for(k = 0; k < l.n*l.c*l.size*l.size; ++k) l.weights[k] = rand_uniform(-.1, .1);
+        transform_convolutional_weights(l);
+    }
+    set_batch_network(&net, 1);
+    fuse_network(&net);
+    X = calloc(net.w*net.h*net.c, sizeof(float));
+    for(j = 0; j < net.w*net.h*net.c; ++j) X[j] = rand_uniform(0, 1);
+    network_predict(net, X);
+    result[0] = 0;
+    if(net.arenas){
+        result[0] = net.arena_bytes;
+    }else{
+        for(j = 0; j < net.n; ++j) result[0] += (double)net.layers[j].batch*net.layers[j].outputs*sizeof(float);
+    }
+}
+
+/* 한 프로세스의 peak RSS는 줄지 않으므로 cfg와 빌드마다 자식 프로세스에서 만들고 forward 한 번 한 뒤 잰다 */
+void test_network_memory(char **cfgfiles, int n)
+{
+    int i, mode;
+    printf("\ncfg                      build       activations MB   peak RSS MB\n");
+    for(i = 0; i < n; ++i){
+        double peak[2] = {0};
+        for(mode = 0; mode < 2; ++mode){
+            MemoryRun r = {cfgfiles[i], mode};
+            double activations = 0;
+            if(!run_in_child(memory_child, &r, &activations, 1, &peak[mode])) printf("%s: 측정 실패\n", cfgfiles[i]);
+            printf("%-24s %-11s %14.1f %13.1f\n", mode ? "" : cfgfiles[i], mode ? "inference" : "train",
+                    activations/1048576., peak[mode]/1048576.);
+        }
+        printf("%-24s %-11s %14s %12.1f%%\n", "", "절감", "", peak[0] > 0 ? 100.*(peak[0] - peak[1])/peak[0] : 0);
+    }
+}
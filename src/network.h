@@ -4,6 +4,7 @@
 
 #include <stdint.h>
 #include "layer.h"
+#include "thread_pool.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,6 +50,7 @@ typedef struct network{
     float eps;
 
     int inputs;
+    float *input; // 추론 입력 버퍼 (batch * inputs), 전처리 결과를 바로 쓴다
     int h, w, c;
     int max_crop;
     int min_crop;
@@ -61,6 +63,14 @@ typedef struct network{
     int gpu_index;
     tree *hierarchy;
 
+    ThreadPool *pool;       // CPU forward 커널이 쓰는 쓰레드 풀 (set_network_threads, 없으면 gemm 기본 풀)
+    double *layer_times;    // 있으면 forward_network가 레이어별 forward 시간(초)을 더한다
+    float **arenas;         // 추론 전용 네트워크에서 레이어 출력이 나눠 쓰는 버퍼 (plan_network_memory)
+    int n_arenas;
+    size_t arena_bytes;
+    void *model_map;        // 컴파일된 모델을 읽었으면 그 mmap (conv 레이어 배열이 가리킨다)
+    size_t model_size;
+
     #ifdef GPU
     float **input_gpu;
     float **truth_gpu;
@@ -126,6 +136,17 @@ void print_network(network net);
 void visualize_network(network net);
 int resize_network(network *net, int w, int h);
 void set_batch_network(network *net, int b);
+/* 추론 전용: conv 레이어의 batchnorm을 weight에 접고 bias, activation을 gemm에 합친다. 접은 레이어 수를 반환 */
+int fuse_network(network *net);
+/* 네트워크 전용 쓰레드 풀을 만든다 (threads <= 0이면 CPU 코어 수) */
+void set_network_threads(network *net, int threads);
+/* 레이어별 forward 시간을 쓰레드 1개와 threads개로 재서 비교 */
+void test_network_threads(char *cfgfile, char *weightfile, int iters, int threads);
+/* 추론 전용: 레이어 출력의 수명(다음 레이어, route/shortcut이 마지막으로 읽을 때까지)을 보고 겹치지 않는 출력끼리 버퍼를 나눠 쓰게 한다.
+ * 만든 공유 버퍼 수, 배치할 수 없는 레이어가 있으면 0 (그대로 둔다) */
+int plan_network_memory(network *net);
+/* cfg마다 학습용 네트워크와 추론 전용 네트워크를 따로 만들어 forward 한 번 뒤의 peak RSS 비교 */
+void test_network_memory(char **cfgfiles, int n);
 int get_network_input_size(network net);
 float get_network_cost(network net);
 
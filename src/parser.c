@@ -114,6 +114,7 @@ typedef struct size_params{
     int c;
     int index;
     int time_steps;
+    int train;      // 0이면 추론 전용: 학습용 버퍼(delta, *_updates, x, x_norm)를 만들지 않는다
     network net;
 } size_params;
 
@@ -160,7 +161,7 @@ convolutional_layer parse_convolutional(list *options, size_params params)
     int binary = option_find_int_quiet(options, "binary", 0);
     int xnor = option_find_int_quiet(options, "xnor", 0);
 
-    convolutional_layer layer = make_convolutional_layer(batch,h,w,c,n,size,stride,padding,activation, batch_normalize, binary, xnor, params.net.adam);
+    convolutional_layer layer = make_convolutional_layer(batch,h,w,c,n,size,stride,padding,activation, batch_normalize, binary, xnor, params.net.adam, params.train);
     layer.flipped = option_find_int_quiet(options, "flipped", 0);
     layer.dot = option_find_float_quiet(options, "dot", 0);
     if(params.net.adam){
@@ -242,7 +243,7 @@ layer parse_region(list *options, size_params params)
     int num = option_find_int(options, "num", 1);
 	int max_boxes = option_find_int_quiet(options, "max", 30);
 
-    layer l = make_region_layer(params.batch, params.w, params.h, num, classes, coords, max_boxes);
+    layer l = make_region_layer(params.batch, params.w, params.h, num, classes, coords, max_boxes, params.train);
     assert(l.outputs == params.inputs);
 
     l.log = option_find_int_quiet(options, "log", 0);
@@ -357,7 +358,7 @@ layer parse_reorg(list *options, size_params params)
     batch=params.batch;
     if(!(h && w && c)) error("Layer before reorg layer must output image.");
 
-    layer layer = make_reorg_layer(batch,w,h,c,stride,reverse);
+    layer layer = make_reorg_layer(batch,w,h,c,stride,reverse,params.train);
     return layer;
 }
 
@@ -391,7 +392,7 @@ maxpool_layer parse_maxpool(list *options, size_params params)
     batch=params.batch;
     if(!(h && w && c)) error("Layer before maxpool layer must output image.");
 
-    maxpool_layer layer = make_maxpool_layer(batch,h,w,c,size,stride,padding);
+    maxpool_layer layer = make_maxpool_layer(batch,h,w,c,size,stride,padding,params.train);
     return layer;
 }
 
@@ -491,7 +492,7 @@ route_layer parse_route(list *options, size_params params, network net)
     }
     int batch = params.batch;
 
-    route_layer layer = make_route_layer(batch, n, layers, sizes);
+    route_layer layer = make_route_layer(batch, n, layers, sizes, params.train);
 
     convolutional_layer first = net.layers[layers[0]];
     layer.out_w = first.out_w;
@@ -610,7 +611,21 @@ network parse_network_cfg(char *filename)
 	return parse_network_cfg_custom(filename, 0);
 }
 
+static network parse_network_cfg_train(char *filename, int batch, int train);
+
 network parse_network_cfg_custom(char *filename, int batch)
+{
+    return parse_network_cfg_train(filename, batch, 1);
+}
+
+network parse_network_cfg_inference(char *filename, int batch)
+{
+    network net = parse_network_cfg_train(filename, batch, 0);
+    plan_network_memory(&net);
+    return net;
+}
+
+static network parse_network_cfg_train(char *filename, int batch, int train)
 {
     list *sections = read_cfg(filename);
     node *n = sections->front;
@@ -631,6 +646,7 @@ network parse_network_cfg_custom(char *filename, int batch)
 	if (batch > 0) net.batch = batch;
     params.batch = net.batch;
     params.time_steps = net.time_steps;
+    params.train = train;
     params.net = net;
 
     size_t workspace_size = 0;
@@ -717,6 +733,7 @@ network parse_network_cfg_custom(char *filename, int batch)
     free_list(sections);
     net.outputs = get_network_output_size(net);
     net.output = get_network_output(net);
+    net.input = calloc(net.batch*net.h*net.w*net.c, sizeof(float));
     if(workspace_size){
         //printf("%ld\n", workspace_size);
 #ifdef GPU
@@ -1032,6 +1049,7 @@ void load_convolutional_weights(layer l, FILE *fp)
     if (l.flipped) {
         transpose_matrix(l.weights, l.c*l.size*l.size, l.n);
     }
+    transform_convolutional_weights(l);
     //if (l.binary) binarize_weights(l.weights, l.n, l.c*l.size*l.size, l.weights);
 #ifdef GPU
     if(gpu_index >= 0){
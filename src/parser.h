@@ -4,6 +4,8 @@
 
 network parse_network_cfg(char *filename);
 network parse_network_cfg_custom(char *filename, int batch);
+/* 추론 전용 네트워크: 학습용 버퍼 없이 만들고 레이어 출력은 공유 버퍼에 배치한다 (plan_network_memory) */
+network parse_network_cfg_inference(char *filename, int batch);
 void save_network(network net, char *filename);
 void save_weights(network net, char *filename);
 void save_weights_upto(network net, char *filename, int cutoff);
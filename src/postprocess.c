@@ -0,0 +1,291 @@
+#include "postprocess.h"
+#include "region_layer.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POSTPROCESS_X86
+#endif
+
+detections make_detections(int boxes, int classes)
+{
+    detections d = {0};
+    size_t n = (size_t)boxes*classes;
+    d.boxes = boxes;
+    d.classes = classes;
+    d.scores = calloc(n, sizeof(float));
+    d.flat = calloc(n, sizeof(int));
+    d.box_id = calloc(n, sizeof(int));
+    d.class_id = calloc(n, sizeof(int));
+    d.prob = calloc(n, sizeof(float));
+    d.x = calloc(n, sizeof(float));
+    d.y = calloc(n, sizeof(float));
+    d.w = calloc(n, sizeof(float));
+    d.h = calloc(n, sizeof(float));
+    d.order = calloc(n, sizeof(int));
+    return d;
+}
+
+void free_detections(detections *d)
+{
+    free(d->scores);
+    free(d->flat);
+    free(d->box_id);
+    free(d->class_id);
+    free(d->prob);
+    free(d->x);
+    free(d->y);
+    free(d->w);
+    free(d->h);
+    free(d->order);
+    memset(d, 0, sizeof(detections));
+}
+
+/* scores[i*classes + j] = objectness * class 확률 (get_region_boxes와 같은 계산) */
+static void region_scores(layer l, float *scores, int boxes)
+{
+    int i, j;
+    int stride = l.classes + 5;
+    const float *p = l.output;
+    for(i = 0; i < boxes; ++i, p += stride){
+        float scale = p[4];
+        float *s = scores + (size_t)i*l.classes;
+        if(l.classfix == -1 && scale < .5) scale = 0;
+        for(j = 0; j < l.classes; ++j) s[j] = scale*p[5 + j];
+    }
+}
+
+/* thresh를 넘는 score의 위치를 out에 앞에서부터 모은다 */
+static int compact_scalar(const float *s, int start, int n, float thresh, int *out)
+{
+    int i, k = 0;
+    for(i = start; i < n; ++i){
+        if(s[i] > thresh) out[k++] = i;
+    }
+    return k;
+}
+
+#ifdef POSTPROCESS_X86
+/* 8개씩 비교해서 mask가 0인 (대부분의) 구간은 건너뛰고, 넘는 것만 bit 위치로 꺼낸다 */
+__attribute__((target("avx2")))
+static int compact_avx2(const float *s, int n, float thresh, int *out)
+{
+    __m256 t = _mm256_set1_ps(thresh);
+    int i = 0, k = 0;
+    for(; i + 32 <= n; i += 32){
+        int m0 = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(s + i), t, _CMP_GT_OQ));
+        int m1 = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(s + i + 8), t, _CMP_GT_OQ));
+        int m2 = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(s + i + 16), t, _CMP_GT_OQ));
+        int m3 = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(s + i + 24), t, _CMP_GT_OQ));
+        unsigned int m = m0 | (m1 << 8) | (m2 << 16) | ((unsigned int)m3 << 24);
+        while(m){
+            out[k++] = i + __builtin_ctz(m);
+            m &= m - 1;
+        }
+    }
+    return k + compact_scalar(s, i, n, thresh, out + k);
+}
+#endif
+
+static int use_avx2 = -1;
+
+static int compact_scores(const float *s, int n, float thresh, int *out)
+{
+#ifdef POSTPROCESS_X86
+    if(use_avx2 < 0) use_avx2 = cpu_supports_avx2();
+    if(use_avx2) return compact_avx2(s, n, thresh, out);
+#endif
+    return compact_scalar(s, 0, n, thresh, out);
+}
+
+/* qsort에 인자를 넘길 수 없어서 정렬하는 동안만 쓴다 */
+static __thread const detections *sorting;
+
+/* class 순, 같은 class 안에서는 확률이 높은 순 (같으면 박스 번호 순) */
+static int candidate_comparator(const void *pa, const void *pb)
+{
+    int a = *(const int *)pa, b = *(const int *)pb;
+    const detections *d = sorting;
+    if(d->class_id[a] != d->class_id[b]) return d->class_id[a] - d->class_id[b];
+    if(d->prob[a] > d->prob[b]) return -1;
+    if(d->prob[a] < d->prob[b]) return 1;
+    return d->box_id[a] - d->box_id[b];
+}
+
+static box candidate_box(const detections *d, int k)
+{
+    box b;
+    b.x = d->x[k];
+    b.y = d->y[k];
+    b.w = d->w[k];
+    b.h = d->h[k];
+    return b;
+}
+
+int get_region_detections(layer l, float thresh, float nms, detections *d)
+{
+    int i, j, k, m;
+    int boxes = l.w*l.h*l.n;
+    int n;
+
+    if(boxes > d->boxes || l.classes != d->classes){
+        free_detections(d);
+        *d = make_detections(boxes, l.classes);
+    }
+
+    // 1. flat score 버퍼 + compaction
+    region_scores(l, d->scores, boxes);
+    n = compact_scores(d->scores, boxes*l.classes, thresh, d->flat);
+
+    // 2. 후보만 박스를 푼다 (flat 순서라 같은 박스의 후보는 붙어 있다)
+    for(k = 0; k < n; ++k){
+        int f = d->flat[k];
+        int id = f / l.classes;
+        d->box_id[k] = id;
+        d->class_id[k] = f % l.classes;
+        d->prob[k] = d->scores[f];
+        if(k > 0 && d->box_id[k - 1] == id){
+            d->x[k] = d->x[k - 1];
+            d->y[k] = d->y[k - 1];
+            d->w[k] = d->w[k - 1];
+            d->h[k] = d->h[k - 1];
+        } else {
+            int cell = id / l.n;
+            box b = get_region_box(l.output, l.biases, id % l.n, id*(l.classes + 5),
+                    cell % l.w, cell / l.w, l.w, l.h);
+            d->x[k] = b.x;
+            d->y[k] = b.y;
+            d->w[k] = b.w;
+            d->h[k] = b.h;
+        }
+        d->order[k] = k;
+    }
+
+    // 3. 후보만 정렬하고 같은 class끼리 NMS (밀린 후보는 prob = 0)
+    if(nms && n > 1){
+        sorting = d;
+        qsort(d->order, n, sizeof(int), candidate_comparator);
+        sorting = 0;
+        for(i = 0; i < n; i = j){
+            for(j = i + 1; j < n && d->class_id[d->order[j]] == d->class_id[d->order[i]]; ++j);
+            for(k = i; k < j; ++k){
+                int a = d->order[k];
+                if(d->prob[a] == 0) continue;
+                box ba = candidate_box(d, a);
+                for(m = k + 1; m < j; ++m){
+                    int b = d->order[m];
+                    if(d->prob[b] != 0 && box_iou(ba, candidate_box(d, b)) > nms) d->prob[b] = 0;
+                }
+            }
+        }
+    }
+
+    // 4. 박스마다 남은 후보 중 확률이 가장 높은 class 하나 (같으면 앞 class, max_index와 같다)
+    m = 0;
+    for(k = 0; k < n; ){
+        int id = d->box_id[k];
+        int best = -1;
+        for(; k < n && d->box_id[k] == id; ++k){
+            if(d->prob[k] > thresh && (best < 0 || d->prob[k] > d->prob[best])) best = k;
+        }
+        if(best < 0) continue;
+        d->box_id[m] = id;
+        d->class_id[m] = d->class_id[best];
+        d->prob[m] = d->prob[best];
+        d->x[m] = d->x[best];
+        d->y[m] = d->y[best];
+        d->w[m] = d->w[best];
+        d->h[m] = d->h[best];
+        ++m;
+    }
+    d->n = m;
+    return m;
+}
+
+/* 학습된 출력과 비슷하게: objectness는 대부분 낮고 일부 셀만 높다. 좌표는 이웃 셀끼리 겹치도록 */
+static void fill_region_output(layer l)
+{
+    int i, j;
+    int stride = l.classes + 5;
+    for(i = 0; i < l.w*l.h*l.n; ++i){
+        float *p = l.output + (size_t)i*stride;
+        float o = rand_uniform(0, 1);
+        float sum = 0;
+        p[0] = rand_normal();
+        p[1] = rand_normal();
+        p[2] = rand_normal()*.5;
+        p[3] = rand_normal()*.5;
+        p[4] = o*o*o*o;
+        for(j = 0; j < l.classes; ++j){
+            p[5 + j] = exp(rand_normal());
+            sum += p[5 + j];
+        }
+        for(j = 0; j < l.classes; ++j) p[5 + j] /= sum;
+    }
+}
+
+void test_postprocess(int classes, float thresh, int iters)
+{
+    int grids[] = {13, 19, 26, 38, 52};
+    float anchors[] = {1.08, 1.19, 3.42, 4.41, 6.63, 11.38, 9.42, 5.11, 16.62, 10.52};
+    float nms = .4;
+    int g, i, j, it;
+
+    srand(0);
+    printf("region 후처리: classes %d, thresh %.2f, nms %.2f, %d회 평균, %s compaction\n",
+            classes, thresh, nms, iters, cpu_supports_avx2() ? "AVX2" : "C");
+    printf("%7s %10s %6s %11s %11s %8s %6s\n", "boxes", "candidates", "dets", "old ms", "new ms", "speedup", "match");
+
+    for(g = 0; g < sizeof(grids)/sizeof(grids[0]); ++g){
+        layer l = {0};
+        int boxes, total = 0, found = 0, match = 1;
+        double t_old = 0, t_new = 0, start;
+        detections d;
+
+        l.w = l.h = grids[g];
+        l.n = 5;
+        l.classes = classes;
+        l.coords = 4;
+        l.biases = anchors;
+        boxes = l.w*l.h*l.n;
+        l.output = calloc((size_t)boxes*(classes + 5), sizeof(float));
+        fill_region_output(l);
+        d = make_detections(boxes, classes);
+
+        for(it = 0; it < iters; ++it){
+            // 기존: 박스마다 calloc한 확률 행 + class마다 전체 qsort
+            start = what_time_is_it_now();
+            box *old_boxes = calloc(boxes, sizeof(box));
+            float **probs = calloc(boxes, sizeof(float *));
+            for(j = 0; j < boxes; ++j) probs[j] = calloc(classes, sizeof(float));
+            get_region_boxes(l, 1, 1, thresh, probs, old_boxes, 0, 0);
+            do_nms_sort(old_boxes, probs, boxes, classes, nms);
+            t_old += what_time_is_it_now() - start;
+
+            start = what_time_is_it_now();
+            get_region_detections(l, thresh, nms, &d);
+            t_new += what_time_is_it_now() - start;
+
+            // get_detections가 쓰는 것 (박스마다 max class, thresh 초과)과 비교
+            found = 0;
+            for(i = 0; i < boxes; ++i){
+                int c = max_index(probs[i], classes);
+                if(probs[i][c] <= thresh) continue;
+                if(found >= d.n || d.box_id[found] != i || d.class_id[found] != c || d.prob[found] != probs[i][c]
+                        || d.x[found] != old_boxes[i].x || d.w[found] != old_boxes[i].w) match = 0;
+                ++found;
+            }
+            if(found != d.n) match = 0;
+            free(old_boxes);
+            free_ptrs((void **)probs, boxes);
+        }
+        total = compact_scores(d.scores, boxes*classes, thresh, d.flat);
+        printf("%7d %10d %6d %11.4f %11.4f %7.1fx %6s\n", boxes, total, d.n,
+                1000*t_old/iters, 1000*t_new/iters, t_old/t_new, match ? "yes" : "NO");
+        free_detections(&d);
+        free(l.output);
+    }
+}
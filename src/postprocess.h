@@ -0,0 +1,35 @@
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+#include "layer.h"
+#include "box.h"
+
+/* region 출력의 후처리 (thresh로 후보 추리기 + class별 NMS)
+ * get_region_boxes + do_nms_sort는 박스마다 calloc한 float* 행에 모든 class 확률을 쓰고
+ * class마다 전체 박스를 qsort한 뒤 확률이 0인 박스까지 IoU를 돈다.
+ * 여기서는 확률을 flat 버퍼 하나에 쓰고 thresh를 넘는 것만 SIMD로 골라(compaction)
+ * 그 후보만 박스를 풀고 정렬, NMS 한다. 결과는 같다 (박스마다 가장 높은 class 하나, 박스 번호 순) */
+typedef struct {
+    int boxes;          // l.w*l.h*l.n
+    int classes;
+    float *scores;      // [boxes*classes] objectness*class 확률 (flat)
+    int *flat;          // compaction 결과: scores에서의 위치
+    // 후보 / 결과 (struct of arrays)
+    int n;
+    int *box_id, *class_id;
+    float *prob;
+    float *x, *y, *w, *h;
+    int *order;         // 정렬용
+} detections;
+
+detections make_detections(int boxes, int classes);
+void free_detections(detections *d);
+
+/* l.output (이미지 하나)에서 thresh를 넘는 검출을 뽑아 nms(0이면 생략)를 적용한다.
+ * softmax_tree가 없는 region 레이어용. 박스 좌표는 0~1. 반환값: 검출 수 (d->n) */
+int get_region_detections(layer l, float thresh, float nms, detections *d);
+
+/* 박스 수(grid 크기)별로 get_region_boxes + do_nms_sort와 후처리 시간 비교, 결과 일치 확인 */
+void test_postprocess(int classes, float thresh, int iters);
+
+#endif
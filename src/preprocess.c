@@ -0,0 +1,328 @@
+#include "preprocess.h"
+#include "image.h"
+#include "utils.h"
+#include "stb_image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PREPROCESS_X86
+#endif
+
+/* 쓰레드별 작업 버퍼. 매 프레임 malloc/free 하지 않도록 필요할 때만 키운다 */
+static __thread float *scratch = 0;
+static __thread size_t scratch_size = 0;
+
+static float *get_scratch(size_t n)
+{
+    if (n > scratch_size) {
+        free(scratch);
+        scratch = malloc(n * sizeof(float));
+        scratch_size = n;
+    }
+    return scratch;
+}
+
+/* 가로 방향 보간: src의 y번째 행을 채널별 dw 길이 float 행(0~255)으로 만든다 */
+static void hresize_row_scalar(const unsigned char *row, int c, int dw,
+        const int *x0, const int *x1, const float *dx, float *out, int start)
+{
+    int i, k;
+    for (k = 0; k < c; ++k) {
+        float *o = out + k*dw;
+        for (i = start; i < dw; ++i) {
+            float a = row[x0[i]*c + k];
+            float b = row[x1[i]*c + k];
+            o[i] = a + dx[i]*(b - a);
+        }
+    }
+}
+
+static void vblend_scalar(const float *top, const float *bot, float wt, float wb,
+        float *dst, int n)
+{
+    int i;
+    for (i = 0; i < n; ++i) dst[i] = top[i]*wt + bot[i]*wb;
+}
+
+#ifdef PREPROCESS_X86
+__attribute__((target("avx2,fma")))
+static void hresize_row_avx2(const unsigned char *row, int sw, int c, int dw,
+        const int *x0, const int *x1, const float *dx, float *out)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i vc = _mm256_set1_epi32(c);
+    int i = 0, k;
+
+    // 4바이트 gather가 행 끝을 넘지 않는 구간까지만 벡터로 처리한다
+    for (; i + 8 <= dw && x1[i + 7] < sw - 1; i += 8) {
+        __m256i ia = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(x0 + i)), vc);
+        __m256i ib = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(x1 + i)), vc);
+        __m256 w = _mm256_loadu_ps(dx + i);
+        for (k = 0; k < c; ++k) {
+            __m256i ka = _mm256_add_epi32(ia, _mm256_set1_epi32(k));
+            __m256i kb = _mm256_add_epi32(ib, _mm256_set1_epi32(k));
+            __m256 a = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_i32gather_epi32((const int*)row, ka, 1), mask));
+            __m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_i32gather_epi32((const int*)row, kb, 1), mask));
+            _mm256_storeu_ps(out + k*dw + i, _mm256_fmadd_ps(w, _mm256_sub_ps(b, a), a));
+        }
+    }
+    hresize_row_scalar(row, c, dw, x0, x1, dx, out, i);
+}
+
+__attribute__((target("avx2,fma")))
+static void vblend_avx2(const float *top, const float *bot, float wt, float wb,
+        float *dst, int n)
+{
+    __m256 vt = _mm256_set1_ps(wt);
+    __m256 vb = _mm256_set1_ps(wb);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 t = _mm256_mul_ps(_mm256_loadu_ps(top + i), vt);
+        _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(_mm256_loadu_ps(bot + i), vb, t));
+    }
+    vblend_scalar(top + i, bot + i, wt, wb, dst + i, n - i);
+}
+
+static void vblend_sse(const float *top, const float *bot, float wt, float wb,
+        float *dst, int n)
+{
+    __m128 vt = _mm_set1_ps(wt);
+    __m128 vb = _mm_set1_ps(wb);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 t = _mm_mul_ps(_mm_loadu_ps(top + i), vt);
+        _mm_storeu_ps(dst + i, _mm_add_ps(t, _mm_mul_ps(_mm_loadu_ps(bot + i), vb)));
+    }
+    vblend_scalar(top + i, bot + i, wt, wb, dst + i, n - i);
+}
+#endif
+
+static int use_avx2 = -1;
+
+static void hresize_row(const unsigned char *row, int sw, int c, int dw,
+        const int *x0, const int *x1, const float *dx, float *out)
+{
+#ifdef PREPROCESS_X86
+    if (use_avx2) {
+        hresize_row_avx2(row, sw, c, dw, x0, x1, dx, out);
+        return;
+    }
+#endif
+    hresize_row_scalar(row, c, dw, x0, x1, dx, out, 0);
+}
+
+void preprocess_rgb8(const unsigned char *src, int sw, int sh, int c,
+        float *dst, int dw, int dh)
+{
+    preprocess_rgb8_stride(src, sw, sh, (size_t)sw*c, c, dst, dw, dh);
+}
+
+void preprocess_rgb8_stride(const unsigned char *src, int sw, int sh, size_t stride, int c,
+        float *dst, int dw, int dh)
+{
+    int i, k, r;
+    float w_scale = (dw > 1) ? (float)(sw - 1) / (dw - 1) : 0;
+    float h_scale = (dh > 1) ? (float)(sh - 1) / (dh - 1) : 0;
+    float *buf = get_scratch((size_t)dw*(2 + 2*c) + (size_t)dw);
+    int *x0 = (int*)buf;
+    int *x1 = x0 + dw;
+    float *dx = buf + 2*dw;
+    float *rows[2];
+    int row_y[2] = {-1, -1};
+
+    rows[0] = dx + dw;
+    rows[1] = rows[0] + c*dw;
+    if (use_avx2 < 0) use_avx2 = cpu_supports_avx2();
+
+    // 열 보간 테이블 (resize_image와 같은 규칙: 마지막 열은 원본 마지막 열)
+    for (i = 0; i < dw; ++i) {
+        if (i == dw - 1 || sw == 1) {
+            x0[i] = x1[i] = sw - 1;
+            dx[i] = 0;
+        } else {
+            float sx = i*w_scale;
+            x0[i] = (int)sx;
+            x1[i] = x0[i] + 1;
+            dx[i] = sx - x0[i];
+        }
+    }
+
+    for (r = 0; r < dh; ++r) {
+        float sy = r*h_scale;
+        int iy = (int)sy;
+        float dy = sy - iy;
+        int last = (r == dh - 1 || sh == 1);
+        float wt = (1 - dy) / 255.f;
+        float wb = last ? 0 : dy / 255.f;
+
+        // iy는 증가만 하므로 가로 보간한 두 행을 굴려가며 재사용한다
+        if (row_y[0] != iy) {
+            if (row_y[1] == iy) {
+                float *t = rows[0];
+                rows[0] = rows[1];
+                rows[1] = t;
+                row_y[0] = iy;
+                row_y[1] = -1;
+            } else {
+                hresize_row(src + iy*stride, sw, c, dw, x0, x1, dx, rows[0]);
+                row_y[0] = iy;
+            }
+        }
+        if (!last && row_y[1] != iy + 1) {
+            hresize_row(src + (iy + 1)*stride, sw, c, dw, x0, x1, dx, rows[1]);
+            row_y[1] = iy + 1;
+        }
+        for (k = 0; k < c; ++k) {
+            float *o = dst + (size_t)k*dw*dh + (size_t)r*dw;
+            float *top = rows[0] + k*dw;
+            float *bot = (last ? rows[0] : rows[1]) + k*dw;
+#ifdef PREPROCESS_X86
+            if (use_avx2) vblend_avx2(top, bot, wt, wb, o, dw);
+            else vblend_sse(top, bot, wt, wb, o, dw);
+#else
+            vblend_scalar(top, bot, wt, wb, o, dw);
+#endif
+        }
+    }
+}
+
+void rgb8_thumbnail(const unsigned char *src, int w, int h, int c, unsigned char *thumb)
+{
+    int cx, cy, x, y;
+    for (cy = 0; cy < THUMB_SIZE; ++cy) {
+        int y0 = cy*h/THUMB_SIZE, y1 = (cy + 1)*h/THUMB_SIZE;
+        int sy = (y1 - y0) / 4 > 1 ? (y1 - y0) / 4 : 1;
+        if (y1 <= y0) y1 = y0 + 1;
+        for (cx = 0; cx < THUMB_SIZE; ++cx) {
+            int x0 = cx*w/THUMB_SIZE, x1 = (cx + 1)*w/THUMB_SIZE;
+            int sx = (x1 - x0) / 4 > 1 ? (x1 - x0) / 4 : 1;
+            unsigned int sum = 0, n = 0;
+            if (x1 <= x0) x1 = x0 + 1;
+            for (y = y0; y < y1 && y < h; y += sy) {
+                const unsigned char *p = src + ((size_t)y*w + x0)*c;
+                for (x = x0; x < x1 && x < w; x += sx, p += sx*c) {
+                    // BT.601 luma (정수 근사)
+                    sum += c >= 3 ? (77*p[0] + 150*p[1] + 29*p[2]) >> 8 : p[0];
+                    ++n;
+                }
+            }
+            thumb[cy*THUMB_SIZE + cx] = n ? sum / n : 0;
+        }
+    }
+}
+
+int thumbnail_diff(const unsigned char *a, const unsigned char *b)
+{
+    int i, d, max = 0;
+    for (i = 0; i < THUMB_SIZE*THUMB_SIZE; ++i) {
+        d = abs(a[i] - b[i]);
+        if (d > max) max = d;
+    }
+    return max;
+}
+
+static unsigned char *read_file(char *filename, int *size)
+{
+    FILE *fp = fopen(filename, "rb");
+    unsigned char *buf;
+    if (!fp) file_error(filename);
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    rewind(fp);
+    buf = malloc(*size);
+    *size = fread(buf, 1, *size, fp);
+    fclose(fp);
+    return buf;
+}
+
+void test_preprocess(char *filename, int w, int h, int iterations)
+{
+    int i, size, sw, sh, sc;
+    double start, t_decode, t_base, t_fused, t_kernel, t_kernel_scalar, t_convert;
+    float max_diff = 0;
+    float *input = calloc(3*w*h, sizeof(float));
+    unsigned char *jpg = read_file(filename, &size);
+    unsigned char *pixels = stbi_load_from_memory(jpg, size, &sw, &sh, &sc, 3);
+    image im, sized;
+
+    if (!pixels) {
+        fprintf(stderr, "Cannot decode %s\n", filename);
+        return;
+    }
+    if (iterations < 1) iterations = 1;
+    free(pixels);
+
+    start = what_time_is_it_now();
+    for (i = 0; i < iterations; ++i) {
+        pixels = stbi_load_from_memory(jpg, size, &sw, &sh, &sc, 3);
+        free(pixels);
+    }
+    t_decode = (what_time_is_it_now() - start) / iterations;
+
+    // 기존 경로: 디스크 -> float 원본 -> float 리사이즈
+    start = what_time_is_it_now();
+    for (i = 0; i < iterations; ++i) {
+        im = load_image_color(filename, 0, 0);
+        sized = resize_image(im, w, h);
+        free_image(im);
+        free_image(sized);
+    }
+    t_base = (what_time_is_it_now() - start) / iterations;
+
+    // 새 경로: 메모리 -> 8bit 원본 -> 입력 버퍼
+    start = what_time_is_it_now();
+    for (i = 0; i < iterations; ++i) {
+        pixels = stbi_load_from_memory(jpg, size, &sw, &sh, &sc, 3);
+        preprocess_rgb8(pixels, sw, sh, 3, input, w, h);
+        free(pixels);
+    }
+    t_fused = (what_time_is_it_now() - start) / iterations;
+
+    // 디코딩을 뺀 전처리 단계만 비교
+    pixels = stbi_load_from_memory(jpg, size, &sw, &sh, &sc, 3);
+    start = what_time_is_it_now();
+    for (i = 0; i < iterations; ++i) {
+        im = load_image_memory(jpg, size, 3);
+        sized = resize_image(im, w, h);
+        free_image(im);
+        free_image(sized);
+    }
+    t_convert = (what_time_is_it_now() - start) / iterations - t_decode;
+
+    start = what_time_is_it_now();
+    for (i = 0; i < iterations; ++i) preprocess_rgb8(pixels, sw, sh, 3, input, w, h);
+    t_kernel = (what_time_is_it_now() - start) / iterations;
+
+    use_avx2 = 0;
+    start = what_time_is_it_now();
+    for (i = 0; i < iterations; ++i) preprocess_rgb8(pixels, sw, sh, 3, input, w, h);
+    t_kernel_scalar = (what_time_is_it_now() - start) / iterations;
+    use_avx2 = -1;
+
+    preprocess_rgb8(pixels, sw, sh, 3, input, w, h);
+    im = load_image_memory(jpg, size, 3);
+    sized = resize_image(im, w, h);
+    for (i = 0; i < 3*w*h; ++i) {
+        float d = fabsf(sized.data[i] - input[i]);
+        if (d > max_diff) max_diff = d;
+    }
+
+    printf("%s: %dx%d -> %dx%d, %d iterations\n", filename, sw, sh, w, h, iterations);
+    printf("  jpeg decode only                 : %8.3f ms\n", t_decode*1000);
+    printf("  load_image_color + resize_image  : %8.3f ms\n", t_base*1000);
+    printf("  decode + preprocess_rgb8         : %8.3f ms (%.2fx)\n", t_fused*1000, t_base/t_fused);
+    printf("  to float + resize (no decode)    : %8.3f ms\n", t_convert*1000);
+    printf("  preprocess_rgb8 (%s)           : %8.3f ms (%.2fx)\n", cpu_supports_avx2() ? "avx2" : "sse ", t_kernel*1000, t_convert/t_kernel);
+    printf("  preprocess_rgb8 (scalar/sse)     : %8.3f ms\n", t_kernel_scalar*1000);
+    printf("  max |diff| vs resize_image       : %g\n", max_diff);
+
+    free_image(im);
+    free_image(sized);
+    free(pixels);
+    free(jpg);
+    free(input);
+}
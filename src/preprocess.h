@@ -0,0 +1,27 @@
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+#include <stddef.h>
+
+/* 8bit interleaved(HWC) 이미지를 네트워크 입력 크기의 planar(CHW) float로
+ * 한 번에 변환한다. resize_image와 같은 bilinear 규칙을 쓰고 /255 정규화까지 포함한다.
+ * dst는 c * dw * dh 크기의 버퍼 (보통 net.input) */
+void preprocess_rgb8(const unsigned char *src, int sw, int sh, int c,
+        float *dst, int dw, int dh);
+/* 행 간격이 stride 바이트인 이미지 (큰 프레임의 일부 영역) */
+void preprocess_rgb8_stride(const unsigned char *src, int sw, int sh, size_t stride, int c,
+        float *dst, int dw, int dh);
+
+#define THUMB_SIZE 32
+
+/* 8bit interleaved 이미지를 THUMB_SIZE x THUMB_SIZE 칸의 평균 밝기(luma)로 줄인다.
+ * 칸마다 가로, 세로 4개 중 하나 정도만 표본으로 쓴다 (프레임 변화 확인용이라 정확할 필요는 없다) */
+void rgb8_thumbnail(const unsigned char *src, int w, int h, int c, unsigned char *thumb);
+/* 두 thumbnail에서 밝기가 가장 많이 바뀐 칸의 차이 (0~255).
+ * 평균을 쓰면 차 한 대(화면의 1/64) 정도의 변화가 센서 잡음과 구분되지 않는다 */
+int thumbnail_diff(const unsigned char *a, const unsigned char *b);
+
+/* load_image_color + resize_image 와 decode + preprocess_rgb8 비교 */
+void test_preprocess(char *filename, int w, int h, int iterations);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+/* STLC v2 전송 프로토콜
+ * 서버(src/server.c)와 PI 클라이언트(Client/)가 같이 사용한다.
+ *
+ * 협상: PI가 이름 뒤에 " v2"를 붙여 보내면 ("east v2") 서버는
+ *       "<sleep time> v2 <light id>"로 응답한다. 이름만 보내는 기존 PI는
+ *       예전처럼 512 byte 단위 stop-and-wait 프로토콜을 사용한다.
+ * 메세지: 고정 크기 헤더(STLC_HEADER_SIZE) + payload_len 바이트.
+ *       모든 필드는 network byte order 이다.
+ *       MSG_FRAME 한 개에 JPEG 전체를 한 번에 보내고, 서버는 MSG_LED로 응답한다. */
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#define STLC_MAGIC 0x53544c43 // "STLC"
+#define STLC_VERSION 2
+#define STLC_HEADER_SIZE 32
+#define STLC_HELLO_V2 "v2"
+
+enum {
+    MSG_FRAME = 1,  // PI -> 서버 : JPEG 이미지
+    MSG_LED = 2,    // 서버 -> PI : LED 상태 (payload NUM_OF_LED bytes)
+    MSG_GET_LED = 3,// PI -> 서버 : LED 상태 요청
+    MSG_EXIT = 4    // PI -> 서버 : 연결 종료
+};
+
+typedef struct __FrameHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    uint32_t light_id;
+    uint32_t seq;
+    uint64_t timestamp; // 촬영 시각 (ms, epoch)
+    uint32_t payload_len;
+} FrameHeader;
+
+static inline void pack_frame_header(unsigned char* buf, const FrameHeader* h) {
+    uint32_t v32;
+    uint16_t v16;
+
+    memset(buf, 0, STLC_HEADER_SIZE);
+    v32 = htonl(h->magic);                          memcpy(buf + 0, &v32, 4);
+    v16 = htons(h->version);                        memcpy(buf + 4, &v16, 2);
+    v16 = htons(h->type);                           memcpy(buf + 6, &v16, 2);
+    v32 = htonl(h->light_id);                       memcpy(buf + 8, &v32, 4);
+    v32 = htonl(h->seq);                            memcpy(buf + 12, &v32, 4);
+    v32 = htonl((uint32_t) (h->timestamp >> 32));   memcpy(buf + 16, &v32, 4);
+    v32 = htonl((uint32_t) h->timestamp);           memcpy(buf + 20, &v32, 4);
+    v32 = htonl(h->payload_len);                    memcpy(buf + 24, &v32, 4);
+}
+
+/* 반환값: 0 정상, -1 magic/version 불일치 */
+static inline int unpack_frame_header(const unsigned char* buf, FrameHeader* h) {
+    uint32_t v32, hi;
+    uint16_t v16;
+
+    memcpy(&v32, buf + 0, 4);  h->magic = ntohl(v32);
+    memcpy(&v16, buf + 4, 2);  h->version = ntohs(v16);
+    memcpy(&v16, buf + 6, 2);  h->type = ntohs(v16);
+    memcpy(&v32, buf + 8, 4);  h->light_id = ntohl(v32);
+    memcpy(&v32, buf + 12, 4); h->seq = ntohl(v32);
+    memcpy(&hi, buf + 16, 4);
+    memcpy(&v32, buf + 20, 4);
+    h->timestamp = ((uint64_t) ntohl(hi) << 32) | ntohl(v32);
+    memcpy(&v32, buf + 24, 4); h->payload_len = ntohl(v32);
+
+    if (h->magic != STLC_MAGIC || h->version != STLC_VERSION)
+        return -1;
+    return 0;
+}
+
+#endif /* PROTOCOL_H */
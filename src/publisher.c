@@ -0,0 +1,323 @@
+#include "publisher.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+int isImage(char* filename); // detector.c
+
+typedef struct __Upload {
+    char key[BUFSIZE];      // 같은 key가 다시 들어오면 대기 중인 업로드를 대체한다
+    char intersection[INTERSECTION_ID_SIZE]; // <upload_url>/<교차로>로 올린다
+    char filename[BUFSIZE];
+    char content[PUBLISH_CONTENT_SIZE]; // 메모리에서 바로 보낼 내용 (txt, json)
+    int content_len;        // -1이면 filename 파일을 읽어서 보낸다 (결과 이미지)
+    int save;               // content를 filename에도 남긴다 (txt 호환 sink)
+    const char* type;       // Content-Type (NULL이면 curl 기본값)
+    int attempts;
+    double next_time;       // 이 시각 이후에 보낸다 (재시도 백오프)
+    int used;
+} Upload;
+
+typedef struct __Transfer {
+    CURL* curl;             // 핸들은 재사용, 연결은 multi 핸들의 캐시에서 재사용된다
+    curl_mime* mime;
+    Upload upload;
+    int busy;
+} Transfer;
+
+static Upload pending[PUBLISH_QUEUE_SIZE];
+static Transfer transfers[PUBLISH_MAX_TRANSFERS];
+static CURLM* multi = NULL;
+static struct curl_slist* header_list = NULL;
+static char base_url[BUFSIZE];
+static int txt_sink = 0;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// 통계 (10초마다 출력)
+static int uploaded, retried, coalesced, failed, dropped;
+
+/* mutex를 잡고 호출. 반환값: 0 큐에 넣음, -1 큐가 가득 참 */
+static int enqueue_locked(Upload* u) {
+    Upload* slot = NULL;
+    int i;
+
+    for (i = 0; i < PUBLISH_QUEUE_SIZE; i++) {
+        if (pending[i].used && strcmp(pending[i].key, u->key) == 0) {
+            coalesced++;
+            slot = &pending[i];
+            break;
+        }
+        if (!pending[i].used && slot == NULL)
+            slot = &pending[i];
+    }
+    if (slot == NULL) {
+        if (dropped++ % 100 == 0)
+            printf("[PUBLISH] 큐가 가득 차 업로드를 건너뜁니다. (누적 %d)\n", dropped);
+        return -1;
+    }
+    *slot = *u;
+    slot->used = 1;
+    return 0;
+}
+
+static void enqueue(Upload* u) {
+    pthread_mutex_lock(&mutex);
+    enqueue_locked(u);
+    pthread_mutex_unlock(&mutex);
+    if (multi)
+        curl_multi_wakeup(multi);
+}
+
+/* 실패한 업로드를 백오프 뒤에 다시 넣는다. 그사이 같은 key가 새로 들어왔으면 그쪽을 보낸다 */
+static void retry(Upload* u) {
+    int i;
+    double backoff = PUBLISH_RETRY_BASE;
+
+    if (++u->attempts > PUBLISH_MAX_RETRY) {
+        failed++;
+        printf("[PUBLISH] %s 업로드를 포기합니다. (%d회 실패)\n", u->filename, u->attempts);
+        return;
+    }
+    for (i = 1; i < u->attempts && backoff < PUBLISH_RETRY_MAX; i++)
+        backoff *= 2;
+    if (backoff > PUBLISH_RETRY_MAX)
+        backoff = PUBLISH_RETRY_MAX;
+    u->next_time = what_time_is_it_now() + backoff;
+
+    pthread_mutex_lock(&mutex);
+    for (i = 0; i < PUBLISH_QUEUE_SIZE; i++) {
+        if (pending[i].used && strcmp(pending[i].key, u->key) == 0) {
+            coalesced++;
+            pthread_mutex_unlock(&mutex);
+            return;
+        }
+    }
+    if (enqueue_locked(u) == 0)
+        retried++;
+    pthread_mutex_unlock(&mutex);
+}
+
+// 응답 본문은 필요 없으므로 버린다 (기본 동작은 stdout 출력)
+static size_t discard_response(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    return size * nmemb;
+}
+
+static int start_transfer(Transfer* t) {
+    Upload* u = &t->upload;
+    curl_mimepart* part;
+    char url[BUFSIZE * 2];
+    FILE* fp;
+
+    if (u->content_len < 0) {
+        if (isImage(u->filename) == 0) {
+            printf("[%s] Can not load image\n", u->filename);
+            return -1;
+        }
+    } else if (u->save && u->attempts == 0) {
+        if ((fp = fopen(u->filename, "w")) == NULL) {
+            printf("[PUBLISH] %s file open error\n", u->filename);
+        } else {
+            fwrite(u->content, 1, u->content_len, fp);
+            fclose(fp);
+        }
+    }
+
+    t->mime = curl_mime_init(t->curl);
+    part = curl_mime_addpart(t->mime);
+    curl_mime_name(part, "file");
+    if (u->content_len < 0) {
+        curl_mime_filedata(part, u->filename);
+    } else {
+        char* base = strrchr(u->filename, '/');
+        curl_mime_data(part, u->content, u->content_len);
+        curl_mime_filename(part, base ? base + 1 : u->filename);
+    }
+    if (u->type)
+        curl_mime_type(part, u->type);
+
+    snprintf(url, sizeof (url), "%s/%s", base_url, u->intersection);
+    curl_easy_setopt(t->curl, CURLOPT_URL, url);
+    curl_easy_setopt(t->curl, CURLOPT_HTTPHEADER, header_list);
+    curl_easy_setopt(t->curl, CURLOPT_MIMEPOST, t->mime);
+    curl_easy_setopt(t->curl, CURLOPT_TIMEOUT, PUBLISH_TIMEOUT);
+    curl_easy_setopt(t->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(t->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, discard_response);
+    curl_easy_setopt(t->curl, CURLOPT_PRIVATE, t);
+    curl_multi_add_handle(multi, t->curl);
+    t->busy = 1;
+    return 0;
+}
+
+static void finish_transfer(Transfer* t, CURLcode res) {
+    long code = 0;
+
+    curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &code);
+    curl_multi_remove_handle(multi, t->curl);
+    curl_mime_free(t->mime);
+    t->mime = NULL;
+    t->busy = 0;
+
+    if (res == CURLE_OK && code < 400) {
+        uploaded++;
+        return;
+    }
+    if (res != CURLE_OK)
+        fprintf(stderr, "[PUBLISH] 파일 업로드 실패 (%s)\n", curl_easy_strerror(res));
+    else
+        fprintf(stderr, "[PUBLISH] 파일 업로드 실패 (HTTP %ld)\n", code);
+    retry(&t->upload);
+}
+
+/* 보낼 시각이 된 업로드를 빈 transfer에 배정한다. 반환값: 다음 재시도까지 남은 시간 (ms, 최대 PUBLISH_IDLE_WAIT)
+ * 새 업로드는 curl_multi_wakeup으로 깨우므로 할 일이 없을 때는 오래 잔다 */
+static long dispatch(double now) {
+    int i, j, best;
+    double next = now + PUBLISH_IDLE_WAIT;
+
+    pthread_mutex_lock(&mutex);
+    for (i = 0; i < PUBLISH_MAX_TRANSFERS; i++) {
+        if (transfers[i].busy)
+            continue;
+        best = -1;
+        for (j = 0; j < PUBLISH_QUEUE_SIZE; j++) {
+            if (!pending[j].used || pending[j].next_time > now)
+                continue;
+            if (best == -1 || pending[j].next_time < pending[best].next_time)
+                best = j;
+        }
+        if (best == -1)
+            break;
+        transfers[i].upload = pending[best];
+        pending[best].used = 0;
+        transfers[i].busy = 1;
+    }
+    // 보낼 차례가 됐지만 빈 transfer가 없는 업로드는 전송이 끝날 때 배정된다
+    for (j = 0; j < PUBLISH_QUEUE_SIZE; j++)
+        if (pending[j].used && pending[j].next_time > now && pending[j].next_time < next)
+            next = pending[j].next_time;
+    pthread_mutex_unlock(&mutex);
+
+    // 파일 확인/쓰기는 락 밖에서
+    for (i = 0; i < PUBLISH_MAX_TRANSFERS; i++)
+        if (transfers[i].busy && transfers[i].mime == NULL && start_transfer(&transfers[i]) == -1)
+            transfers[i].busy = 0;
+
+    return (long) ((next - now) * 1000) + 1;
+}
+
+static void* publish_thread(void* arg) {
+    CURLMsg* msg;
+    int running, left;
+    double report_time = what_time_is_it_now();
+    int last_uploaded = 0;
+
+    while (1) {
+        double now = what_time_is_it_now();
+        long timeout = dispatch(now);
+
+        curl_multi_perform(multi, &running);
+        while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+            Transfer* t;
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**) &t);
+            finish_transfer(t, msg->data.result);
+            timeout = 0; // 빈 transfer가 생겼으니 바로 다음 업로드를 배정
+        }
+
+        if (now - report_time >= 10) {
+            if (uploaded != last_uploaded || failed || retried)
+                printf("[PUBLISH] 업로드 %d건 (%.1f/s), 재시도 %d, 대체 %d, 포기 %d, 버림 %d\n",
+                        uploaded - last_uploaded, (uploaded - last_uploaded) / (now - report_time),
+                        retried, coalesced, failed, dropped);
+            last_uploaded = uploaded;
+            report_time = now;
+        }
+
+        // 전송 중인 소켓, 새 업로드(curl_multi_wakeup), 재시도 시각 중 먼저 오는 것을 기다린다
+        if (timeout > 0)
+            curl_multi_poll(multi, NULL, 0, (int) timeout, NULL);
+    }
+    return 0;
+}
+
+void publisher_start(const char* upload_url, int txt) {
+    pthread_t thread;
+    int i;
+
+    txt_sink = txt;
+    curl_global_init(CURL_GLOBAL_ALL);
+    snprintf(base_url, sizeof (base_url), "%s", upload_url ? upload_url : WEB_URL);
+    header_list = curl_slist_append(header_list, "Expect:");
+
+    multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) PUBLISH_MAX_TRANSFERS);
+    for (i = 0; i < PUBLISH_MAX_TRANSFERS; i++)
+        transfers[i].curl = curl_easy_init();
+
+    if (pthread_create(&thread, NULL, publish_thread, NULL)) {
+        printf("[PUBLISH] 업로드 쓰레드 생성 실패\n");
+        exit(0);
+    }
+    pthread_detach(thread);
+    printf("[PUBLISH] 업로드 주소 %s/<교차로>\n", base_url);
+}
+
+void publish_light(TrafficLight* tl, int with_image) {
+    Upload u;
+    const char* id = tl->intersection->id;
+
+    memset(&u, 0, sizeof (u));
+    strcpy(u.intersection, id);
+    if (with_image) {
+        sprintf(u.key, "%s_result", tl->tag);
+        u.content_len = -1;
+        if (snprintf(u.filename, sizeof (u.filename), "%s/%s/%s%d_result.jpg", FILE_DIR, id, tl->name,
+                (int) tl->name_subfix) < (int) sizeof (u.filename))
+            enqueue(&u);
+    }
+    if (!txt_sink)
+        return;
+
+    sprintf(u.key, "%s.txt", tl->tag);
+    if (snprintf(u.filename, sizeof (u.filename), "%s/%s/%s.txt", FILE_DIR, id, tl->name) >= (int) sizeof (u.filename))
+        return;
+    u.content_len = sprintf(u.content, "%d %d %d %d %d %d %d %d", (int) tl->name_subfix,
+            tl->front, tl->back, tl->side, tl->leds[0], tl->leds[1],
+            tl->leds[2], tl->leds[3]);
+    u.save = 1;
+    enqueue(&u);
+}
+
+void publish_global(const char* intersection, int accident, int remain_time, int total_time) {
+    Upload u;
+
+    if (!txt_sink)
+        return;
+    memset(&u, 0, sizeof (u));
+    strcpy(u.intersection, intersection);
+    sprintf(u.key, "%s/global.txt", intersection);
+    sprintf(u.filename, "%s/%s/global.txt", FILE_DIR, intersection);
+    u.content_len = sprintf(u.content, "%d %d %d", accident, remain_time, total_time);
+    u.save = 1;
+    enqueue(&u);
+}
+
+void publish_status(const StatusSnapshot* s) {
+    Upload u;
+
+    memset(&u, 0, sizeof (u));
+    strcpy(u.intersection, s->intersection);
+    sprintf(u.key, "%s/status.json", s->intersection);
+    sprintf(u.filename, "%s/%s/status.json", FILE_DIR, s->intersection);
+    if ((u.content_len = status_to_json(s, u.content, sizeof (u.content))) == -1) {
+        printf("[PUBLISH] status.json 크기 초과\n");
+        return;
+    }
+    u.type = "application/json";
+    enqueue(&u);
+}
@@ -0,0 +1,31 @@
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include "server.h"
+#include "status.h"
+
+#define PUBLISH_QUEUE_SIZE 256   // 대기 중인 업로드 최대 수 (교차로마다 status.json + 결과 이미지 4장)
+#define PUBLISH_MAX_TRANSFERS 4  // 동시에 진행하는 업로드 수 (연결은 curl multi가 재사용)
+#define PUBLISH_MAX_RETRY 5      // 실패 시 재시도 횟수
+#define PUBLISH_RETRY_BASE 0.5   // 첫 재시도 대기 (초), 실패할 때마다 두 배
+#define PUBLISH_RETRY_MAX 30.0   // 재시도 대기 상한 (초)
+#define PUBLISH_TIMEOUT 10L      // 업로드 하나의 최대 시간 (초)
+#define PUBLISH_IDLE_WAIT 10.0   // 대기 중인 업로드가 없을 때 업로드 쓰레드가 자는 최대 시간 (초)
+#define PUBLISH_CONTENT_SIZE STATUS_JSON_SIZE // 메모리에서 보내는 내용의 최대 크기
+
+/* 분석 결과를 웹 서버로 올리는 비동기 stage
+ * 분석 쓰레드는 그 시점의 값을 복사해서 큐에 넣기만 하고, 업로드 쓰레드가
+ * curl multi 핸들 하나로 keep-alive 연결을 재사용하며 여러 파일을 동시에 올린다.
+ * 같은 파일(key)의 업로드가 아직 대기 중이면 새 내용으로 대체하고,
+ * 실패한 업로드는 지수 백오프로 재시도한다.
+ * 상태는 주기마다 교차로별 status.json 하나로 올리고 (<upload_url>/<교차로>), txt_sink이면 예전 <name>.txt, global.txt도 남긴다. */
+void publisher_start(const char* upload_url, int txt_sink);
+
+/* <name><subfix>_result.jpg (with_image일 때)와 <name>.txt (txt_sink일 때) 업로드 */
+void publish_light(TrafficLight* tl, int with_image);
+/* 교차로의 global.txt 업로드 (txt_sink일 때) */
+void publish_global(const char* intersection, int accident, int remain_time, int total_time);
+/* 교차로의 신호등 상태를 status.json 하나로 업로드 */
+void publish_status(const StatusSnapshot* s);
+
+#endif /* PUBLISHER_H */
@@ -0,0 +1,599 @@
+#include "quantize.h"
+#include "gemm.h"
+#include "thread_pool.h"
+#include "image.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+/*
+ * int8 gemm도 float gemm(gemm.c)과 같은 blocking을 쓴다.
+ * k는 4개씩 묶어서 (vpdpbusd가 u8 4개 x s8 4개를 int32 하나에 더함) MRxNR = 6x16 타일을 계산한다.
+ *   A (weight) panel: k 묶음마다 [MR행][4] (로드할 때 한 번 pack)
+ *   B (입력)  panel: k 묶음마다 [NR열][4]
+ * int32 누산 값은 출력 버퍼(float) 자리에 두었다가 마지막 K 블록에서 그 자리를 float로 바꾼다.
+ */
+#define Q8_MR 6
+#define Q8_NR 16
+#define Q8_MC 120
+#define Q8_KC 1024
+#define Q8_NC 1024
+
+static int q8_kernel = -1;      // 0: C, 1: AVX2, 2: AVX512-VNNI
+
+static int align4(int k)
+{
+    return (k + 3) & ~3;
+}
+
+size_t packed_weights_int8_size(int n, int k)
+{
+    return (size_t)((n + Q8_MR - 1) / Q8_MR) * Q8_MR * align4(k);
+}
+
+void pack_weights_int8(const signed char *w, int n, int k, signed char *packed)
+{
+    int kp = align4(k);
+    int i, g, r, b;
+    for(i = 0; i < n; i += Q8_MR){
+        for(g = 0; g < kp; g += 4){
+            for(r = 0; r < Q8_MR; ++r){
+                for(b = 0; b < 4; ++b){
+                    int row = i + r, col = g + b;
+                    *packed++ = (row < n && col < k) ? w[(size_t)row*k + col] : 0;
+                }
+            }
+        }
+    }
+}
+
+static void unpack_weights_int8(const signed char *packed, int n, int k, signed char *w)
+{
+    int kp = align4(k);
+    int i, j;
+    for(i = 0; i < n; ++i){
+        const signed char *p = packed + (size_t)(i / Q8_MR)*Q8_MR*kp + (i % Q8_MR)*4;
+        for(j = 0; j < k; ++j){
+            w[(size_t)i*k + j] = p[(j / 4)*Q8_MR*4 + j % 4];
+        }
+    }
+}
+
+/* B의 kc x nr 조각 (kc는 4 배수) -> [kc/4][NR][4]. k_valid 이후 행과 nr 이후 열은 0 */
+static void pack_b_int8(int kc, int nr, int k_valid, const uint8_t *B, int ldb, uint8_t *pb)
+{
+    int g, j, b;
+    for(g = 0; g < kc; g += 4){
+        for(j = 0; j < Q8_NR; ++j){
+            for(b = 0; b < 4; ++b){
+                pb[j*4 + b] = (j < nr && g + b < k_valid) ? B[(size_t)(g + b)*ldb + j] : 0;
+            }
+        }
+        pb += Q8_NR*4;
+    }
+}
+
+static void kernel_int8_c(int kc, const int8_t *a, const uint8_t *b, int32_t *c, int ldc, int add)
+{
+    int32_t acc[Q8_MR][Q8_NR] = {{0}};
+    int p, i, j;
+    for(p = 0; p < kc; p += 4){
+        for(i = 0; i < Q8_MR; ++i){
+            const int8_t *ai = a + i*4;
+            for(j = 0; j < Q8_NR; ++j){
+                const uint8_t *bj = b + j*4;
+                acc[i][j] += ai[0]*bj[0] + ai[1]*bj[1] + ai[2]*bj[2] + ai[3]*bj[3];
+            }
+        }
+        a += Q8_MR*4;
+        b += Q8_NR*4;
+    }
+    for(i = 0; i < Q8_MR; ++i){
+        for(j = 0; j < Q8_NR; ++j) c[i*ldc + j] = add ? c[i*ldc + j] + acc[i][j] : acc[i][j];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define INT8_KERNEL_STORE_ROW(r, lo, hi) \
+    if(add){ \
+        lo = _mm256_add_epi32(_mm256_loadu_si256((__m256i*)(c + r*ldc)), lo); \
+        hi = _mm256_add_epi32(_mm256_loadu_si256((__m256i*)(c + r*ldc + 8)), hi); \
+    } \
+    _mm256_storeu_si256((__m256i*)(c + r*ldc), lo); \
+    _mm256_storeu_si256((__m256i*)(c + r*ldc + 8), hi);
+
+__attribute__((target("avx2,avx512vnni,avx512vl")))
+static void kernel_int8_vnni(int kc, const int8_t *a, const uint8_t *b, int32_t *c, int ldc, int add)
+{
+    __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+    __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+    __m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+    __m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+    __m256i c40 = _mm256_setzero_si256(), c41 = _mm256_setzero_si256();
+    __m256i c50 = _mm256_setzero_si256(), c51 = _mm256_setzero_si256();
+    __m256i b0, b1, ai;
+    int p;
+
+    for(p = 0; p < kc; p += 4){
+        b0 = _mm256_loadu_si256((const __m256i*)b);
+        b1 = _mm256_loadu_si256((const __m256i*)(b + 32));
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 0));  c00 = _mm256_dpbusd_epi32(c00, b0, ai); c01 = _mm256_dpbusd_epi32(c01, b1, ai);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 4));  c10 = _mm256_dpbusd_epi32(c10, b0, ai); c11 = _mm256_dpbusd_epi32(c11, b1, ai);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 8));  c20 = _mm256_dpbusd_epi32(c20, b0, ai); c21 = _mm256_dpbusd_epi32(c21, b1, ai);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 12)); c30 = _mm256_dpbusd_epi32(c30, b0, ai); c31 = _mm256_dpbusd_epi32(c31, b1, ai);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 16)); c40 = _mm256_dpbusd_epi32(c40, b0, ai); c41 = _mm256_dpbusd_epi32(c41, b1, ai);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 20)); c50 = _mm256_dpbusd_epi32(c50, b0, ai); c51 = _mm256_dpbusd_epi32(c51, b1, ai);
+        a += Q8_MR*4;
+        b += Q8_NR*4;
+    }
+    INT8_KERNEL_STORE_ROW(0, c00, c01)
+    INT8_KERNEL_STORE_ROW(1, c10, c11)
+    INT8_KERNEL_STORE_ROW(2, c20, c21)
+    INT8_KERNEL_STORE_ROW(3, c30, c31)
+    INT8_KERNEL_STORE_ROW(4, c40, c41)
+    INT8_KERNEL_STORE_ROW(5, c50, c51)
+}
+
+/* vpdpbusd 흉내: maddubs는 u8*s8 두 개를 int16으로 더하면서 포화될 수 있으므로
+ * 짝수/홀수 byte를 나눠 곱 하나씩만 int16에 담고 madd로 int32까지 더한다 */
+__attribute__((target("avx2")))
+static inline __m256i dpbusd_avx2(__m256i acc, __m256i u_even, __m256i u_odd, __m256i s)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i lo = _mm256_madd_epi16(_mm256_maddubs_epi16(u_even, s), ones);
+    __m256i hi = _mm256_madd_epi16(_mm256_maddubs_epi16(u_odd, s), ones);
+    return _mm256_add_epi32(acc, _mm256_add_epi32(lo, hi));
+}
+
+__attribute__((target("avx2")))
+static void kernel_int8_avx2(int kc, const int8_t *a, const uint8_t *b, int32_t *c, int ldc, int add)
+{
+    const __m256i even = _mm256_set1_epi16(0x00ff);
+    __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+    __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+    __m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+    __m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+    __m256i c40 = _mm256_setzero_si256(), c41 = _mm256_setzero_si256();
+    __m256i c50 = _mm256_setzero_si256(), c51 = _mm256_setzero_si256();
+    __m256i b0, b1, b0e, b0o, b1e, b1o, ai;
+    int p;
+
+    for(p = 0; p < kc; p += 4){
+        b0 = _mm256_loadu_si256((const __m256i*)b);
+        b1 = _mm256_loadu_si256((const __m256i*)(b + 32));
+        b0e = _mm256_and_si256(b0, even); b0o = _mm256_andnot_si256(even, b0);
+        b1e = _mm256_and_si256(b1, even); b1o = _mm256_andnot_si256(even, b1);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 0));  c00 = dpbusd_avx2(c00, b0e, b0o, ai); c01 = dpbusd_avx2(c01, b1e, b1o, ai);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 4));  c10 = dpbusd_avx2(c10, b0e, b0o, ai); c11 = dpbusd_avx2(c11, b1e, b1o, ai);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 8));  c20 = dpbusd_avx2(c20, b0e, b0o, ai); c21 = dpbusd_avx2(c21, b1e, b1o, ai);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 12)); c30 = dpbusd_avx2(c30, b0e, b0o, ai); c31 = dpbusd_avx2(c31, b1e, b1o, ai);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 16)); c40 = dpbusd_avx2(c40, b0e, b0o, ai); c41 = dpbusd_avx2(c41, b1e, b1o, ai);
+        ai = _mm256_set1_epi32(*(const int32_t*)(a + 20)); c50 = dpbusd_avx2(c50, b0e, b0o, ai); c51 = dpbusd_avx2(c51, b1e, b1o, ai);
+        a += Q8_MR*4;
+        b += Q8_NR*4;
+    }
+    INT8_KERNEL_STORE_ROW(0, c00, c01)
+    INT8_KERNEL_STORE_ROW(1, c10, c11)
+    INT8_KERNEL_STORE_ROW(2, c20, c21)
+    INT8_KERNEL_STORE_ROW(3, c30, c31)
+    INT8_KERNEL_STORE_ROW(4, c40, c41)
+    INT8_KERNEL_STORE_ROW(5, c50, c51)
+}
+#undef INT8_KERNEL_STORE_ROW
+#endif
+
+static void kernel_int8(int kc, const int8_t *a, const uint8_t *b, int32_t *c, int ldc, int add)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if(q8_kernel == 2){
+        kernel_int8_vnni(kc, a, b, c, ldc, add);
+        return;
+    }
+    if(q8_kernel == 1){
+        kernel_int8_avx2(kc, a, b, c, ldc, add);
+        return;
+    }
+#endif
+    kernel_int8_c(kc, a, b, c, ldc, add);
+}
+
+static int select_int8_kernel()
+{
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    if(__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl")) return 2;
+    if(cpu_supports_avx2()) return 1;
+#endif
+    return 0;
+}
+
+/* 같은 자리의 int32 누산 값을 float 출력으로 바꾼다 */
+static void int8_epilogue(float *c, int ldc, int mr, int nr,
+        const float *scales, const int *sums, const float *bias, ACTIVATION act)
+{
+    int i, j;
+    for(i = 0; i < mr; ++i){
+        int32_t *ci = (int32_t*)(c + i*ldc);
+        float *cf = c + i*ldc;
+        int32_t zero = 128*sums[i];
+        float s = scales[i], b = bias[i];
+        for(j = 0; j < nr; ++j){
+            float v = s*(float)(ci[j] - zero) + b;
+            cf[j] = (act == LEAKY && v < 0) ? .1f*v : v;
+        }
+    }
+}
+
+typedef struct {
+    int M, N, K, k_valid;
+    const int8_t *A;
+    const uint8_t *B; int ldb;
+    float *C; int ldc;
+    const float *scales; const int *sums; const float *bias; ACTIVATION act;
+    int jc, pc, nc, kc;
+    int n_panels, m_blocks, n_splits;
+    uint8_t *pb;
+} Int8Job;
+
+static __thread uint8_t *pack_b_int8_buf = 0;
+
+static void int8_pack_task(void *arg, int task, int thread)
+{
+    Int8Job *g = (Int8Job*)arg;
+    int per = (g->n_panels + g->n_splits - 1) / g->n_splits;
+    int q, end = (task + 1)*per;
+    if(end > g->n_panels) end = g->n_panels;
+    for(q = task*per; q < end; ++q){
+        int j = q*Q8_NR;
+        int nr = (g->nc - j < Q8_NR) ? g->nc - j : Q8_NR;
+        pack_b_int8(g->kc, nr, g->k_valid - g->pc, g->B + (size_t)g->pc*g->ldb + g->jc + j, g->ldb,
+                g->pb + (size_t)q*g->kc*Q8_NR);
+    }
+}
+
+static void int8_compute_task(void *arg, int task, int thread)
+{
+    Int8Job *g = (Int8Job*)arg;
+    int ib = task / g->n_splits;
+    int s = task % g->n_splits;
+    int ic = ib*Q8_MC;
+    int mc = (g->M - ic < Q8_MC) ? g->M - ic : Q8_MC;
+    int per = (g->n_panels + g->n_splits - 1) / g->n_splits;
+    int q0 = s*per, q1 = (s + 1)*per;
+    int add = g->pc > 0;
+    int last = g->pc + g->kc >= g->K;
+    int32_t tmp[Q8_MR*Q8_NR];
+    int q, i, r, j;
+
+    if(q1 > g->n_panels) q1 = g->n_panels;
+    for(q = q0; q < q1; ++q){
+        int jj = q*Q8_NR;
+        int nr = (g->nc - jj < Q8_NR) ? g->nc - jj : Q8_NR;
+        const uint8_t *pb = g->pb + (size_t)q*g->kc*Q8_NR;
+        for(i = 0; i < mc; i += Q8_MR){
+            int mr = (mc - i < Q8_MR) ? mc - i : Q8_MR;
+            float *cf = g->C + (size_t)(ic + i)*g->ldc + g->jc + jj;
+            int32_t *c = (int32_t*)cf;
+            const int8_t *a = g->A + (size_t)(ic + i)*g->K + (size_t)g->pc*Q8_MR;
+            if(mr == Q8_MR && nr == Q8_NR){
+                kernel_int8(g->kc, a, pb, c, g->ldc, add);
+            } else {
+                kernel_int8(g->kc, a, pb, tmp, Q8_NR, 0);
+                for(r = 0; r < mr; ++r){
+                    for(j = 0; j < nr; ++j){
+                        c[r*g->ldc + j] = add ? c[r*g->ldc + j] + tmp[r*Q8_NR + j] : tmp[r*Q8_NR + j];
+                    }
+                }
+            }
+            if(last) int8_epilogue(cf, g->ldc, mr, nr, g->scales + ic + i, g->sums + ic + i, g->bias + ic + i, g->act);
+        }
+    }
+}
+
+void gemm_int8(int M, int N, int K, const signed char *A, const unsigned char *B, int ldb,
+        float *C, int ldc, const float *scales, const int *sums, const float *bias, ACTIVATION act)
+{
+    Int8Job g;
+    ThreadPool *pool = gemm_thread_pool();
+    int threads = thread_pool_size(pool);
+    int t;
+
+    if(q8_kernel < 0) q8_kernel = select_int8_kernel();
+    gemm_thread_buf((void **)&pack_b_int8_buf, (size_t)Q8_KC*Q8_NC);
+    if(2.0*M*N*K < 2e6) threads = 1;
+
+    g.M = M; g.N = N; g.K = align4(K); g.k_valid = K;
+    g.A = (const int8_t*)A; g.B = B; g.ldb = ldb; g.C = C; g.ldc = ldc;
+    g.scales = scales; g.sums = sums; g.bias = bias; g.act = act;
+    g.pb = pack_b_int8_buf;
+    g.m_blocks = (M + Q8_MC - 1) / Q8_MC;
+
+    for(g.jc = 0; g.jc < N; g.jc += Q8_NC){
+        g.nc = (N - g.jc < Q8_NC) ? N - g.jc : Q8_NC;
+        g.n_panels = (g.nc + Q8_NR - 1) / Q8_NR;
+        g.n_splits = (threads == 1) ? 1 : (threads*2 + g.m_blocks - 1) / g.m_blocks;
+        if(g.n_splits > g.n_panels) g.n_splits = g.n_panels;
+        for(g.pc = 0; g.pc < g.K; g.pc += Q8_KC){
+            g.kc = (g.K - g.pc < Q8_KC) ? g.K - g.pc : Q8_KC;
+            if(threads == 1){
+                int8_pack_task(&g, 0, 0);
+                for(t = 0; t < g.m_blocks; ++t) int8_compute_task(&g, t, 0);
+            } else {
+                thread_pool_run(pool, int8_pack_task, &g, g.n_splits);
+                thread_pool_run(pool, int8_compute_task, &g, g.m_blocks*g.n_splits);
+            }
+        }
+    }
+}
+
+typedef struct {
+    const float *x;
+    const float *scales;
+    const uint8_t *im;
+    uint8_t *q, *col;
+    int spatial, h, w, size, stride, pad;
+} Int8InputJob;
+
+/* 입력 채널 [begin, end)를 채널별 scale로 u8 (zero point 128) */
+static void quantize_input_range(void *arg, int begin, int end)
+{
+    Int8InputJob *g = (Int8InputJob*)arg;
+    int i, j;
+    for(i = begin; i < end; ++i){
+        float inv = 1.f/g->scales[i];
+        const float *xi = g->x + (size_t)i*g->spatial;
+        uint8_t *qi = g->q + (size_t)i*g->spatial;
+        for(j = 0; j < g->spatial; ++j){
+            float v = xi[j]*inv + 128.5f;
+            v = (v < 0) ? 0 : ((v > 255) ? 255 : v);
+            qi[j] = (uint8_t)v;
+        }
+    }
+}
+
+static void quantize_input(const float *x, int c, int spatial, const float *scales, uint8_t *q)
+{
+    Int8InputJob g = {0};
+    g.x = x; g.scales = scales; g.q = q; g.spatial = spatial;
+    parallel_for(c, PARALLEL_GRAIN(spatial), quantize_input_range, &g);
+}
+
+/* im2col_cpu의 u8 버전 (결과 행 [begin, end)). 패딩 자리는 zero point(128) */
+static void im2col_u8_range(void *arg, int begin, int end)
+{
+    Int8InputJob *g = (Int8InputJob*)arg;
+    const uint8_t *im = g->im;
+    uint8_t *col = g->col;
+    int h = g->h, w = g->w, size = g->size, stride = g->stride, pad = g->pad;
+    int out_h = (h + 2*pad - size) / stride + 1;
+    int out_w = (w + 2*pad - size) / stride + 1;
+    int k, y, x;
+    for(k = begin; k < end; ++k){
+        int kx = k % size;
+        int ky = (k / size) % size;
+        int ch = k / size / size;
+        const uint8_t *src = im + (size_t)ch*h*w;
+        uint8_t *dst = col + (size_t)k*out_h*out_w;
+        for(y = 0; y < out_h; ++y){
+            int iy = y*stride + ky - pad;
+            if(iy < 0 || iy >= h){
+                memset(dst + y*out_w, 128, out_w);
+                continue;
+            }
+            for(x = 0; x < out_w; ++x){
+                int ix = x*stride + kx - pad;
+                dst[y*out_w + x] = (ix < 0 || ix >= w) ? 128 : src[iy*w + ix];
+            }
+        }
+    }
+}
+
+static void im2col_u8(const uint8_t *im, int c, int h, int w, int size, int stride, int pad, uint8_t *col)
+{
+    Int8InputJob g = {0};
+    int out_h = (h + 2*pad - size) / stride + 1;
+    int out_w = (w + 2*pad - size) / stride + 1;
+    g.im = im; g.col = col;
+    g.h = h; g.w = w; g.size = size; g.stride = stride; g.pad = pad;
+    parallel_for(c*size*size, PARALLEL_GRAIN(out_h*out_w), im2col_u8_range, &g);
+}
+
+void forward_convolutional_layer_int8(layer l, network_state state)
+{
+    int k = l.size*l.size*l.c;
+    int n = l.out_h*l.out_w;
+    size_t in_size = (size_t)l.c*l.h*l.w;
+    uint8_t *q = (uint8_t*)state.workspace;
+    uint8_t *col = q + in_size;
+    int b;
+
+    for(b = 0; b < l.batch; ++b){
+        const uint8_t *B = q;
+        quantize_input(state.input + b*in_size, l.c, l.h*l.w, l.input_scales, q);
+        if(!(l.size == 1 && l.stride == 1 && l.pad == 0)){
+            im2col_u8(q, l.c, l.h, l.w, l.size, l.stride, l.pad, col);
+            B = col;
+        }
+        gemm_int8(l.n, n, k, l.weights_int8, B, n, l.output + (size_t)b*l.outputs, n,
+                l.weight_scales, l.weight_sums, l.biases, l.activation);
+    }
+}
+
+static int quantizable(network *net, int i)
+{
+    layer l = net->layers[i];
+    if(l.type != CONVOLUTIONAL || !l.fused) return 0;
+    // region/detection 레이어로 바로 들어가는 conv는 좌표, 확률을 직접 만드므로 FP32로 둔다
+    if(i + 1 < net->n && (net->layers[i+1].type == REGION || net->layers[i+1].type == DETECTION)) return 0;
+    return 1;
+}
+
+float **calibrate_network(network net, char **paths, int n)
+{
+    float **ranges = calloc(net.n, sizeof(float*));
+    int i, j, s, ch;
+
+    for(i = 0; i < net.n; ++i){
+        if(net.layers[i].type == CONVOLUTIONAL) ranges[i] = calloc(net.layers[i].c, sizeof(float));
+    }
+    for(s = 0; s < n; ++s){
+        image im = load_image_color(paths[s], 0, 0);
+        image sized;
+        if(im.w == 0 || im.h == 0){
+            // 읽지 못한 이미지는 범위에 넣지 않는다
+            free_image(im);
+            continue;
+        }
+        sized = resize_image(im, net.w, net.h);
+        network_predict(net, sized.data);
+        for(i = 0; i < net.n; ++i){
+            layer l = net.layers[i];
+            float *in = (i == 0) ? sized.data : net.layers[i-1].output;
+            int spatial = l.h*l.w;
+            if(!ranges[i]) continue;
+            for(ch = 0; ch < l.c; ++ch){
+                float m = ranges[i][ch];
+                for(j = 0; j < spatial; ++j){
+                    float v = fabsf(in[ch*spatial + j]);
+                    if(v > m) m = v;
+                }
+                ranges[i][ch] = m;
+            }
+        }
+        free_image(im);
+        free_image(sized);
+        if((s + 1) % 10 == 0 || s + 1 == n) fprintf(stderr, "calibration %d/%d\r", s + 1, n);
+    }
+    fprintf(stderr, "\n");
+    return ranges;
+}
+
+static void alloc_int8_layer(layer *l)
+{
+    int k = l->size*l->size*l->c;
+    if(!l->weights_int8) l->weights_int8 = calloc(packed_weights_int8_size(l->n, k), 1);
+    if(!l->weight_scales) l->weight_scales = calloc(l->n, sizeof(float));
+    if(!l->weight_sums) l->weight_sums = calloc(l->n, sizeof(int));
+    if(!l->input_scales) l->input_scales = calloc(l->c, sizeof(float));
+}
+
+static void quantize_convolutional_layer(layer *l, const float *range)
+{
+    int k = l->size*l->size*l->c;
+    int kk = l->size*l->size;
+    signed char *wq = calloc((size_t)l->n*k, 1);
+    int i, j;
+
+    alloc_int8_layer(l);
+    for(i = 0; i < l->c; ++i){
+        l->input_scales[i] = (range[i] > 0) ? range[i]/127 : 1;
+    }
+    for(i = 0; i < l->n; ++i){
+        float max = 0, s;
+        int sum = 0;
+        for(j = 0; j < k; ++j){
+            float w = fabsf(l->weights[(size_t)i*k + j]*l->input_scales[j/kk]);
+            if(w > max) max = w;
+        }
+        s = (max > 0) ? max/127 : 1;
+        for(j = 0; j < k; ++j){
+            float w = l->weights[(size_t)i*k + j]*l->input_scales[j/kk]/s;
+            int v = (int)roundf(w);
+            if(v > 127) v = 127;
+            if(v < -127) v = -127;
+            wq[(size_t)i*k + j] = v;
+            sum += v;
+        }
+        l->weight_scales[i] = s;
+        l->weight_sums[i] = sum;
+    }
+    pack_weights_int8(wq, l->n, k, l->weights_int8);
+    l->quantized = 1;
+    free(wq);
+}
+
+int quantize_network(network *net, float **ranges)
+{
+    int i, count = 0;
+    for(i = 0; i < net->n; ++i){
+        if(!quantizable(net, i) || !ranges[i]) continue;
+        quantize_convolutional_layer(net->layers + i, ranges[i]);
+        ++count;
+    }
+    return count;
+}
+
+void save_int8_weights(network net, char *filename)
+{
+    FILE *fp = fopen(filename, "wb");
+    int header[3] = {INT8_MAGIC, INT8_VERSION, 0};
+    int i;
+    if(!fp) file_error(filename);
+    for(i = 0; i < net.n; ++i) if(net.layers[i].quantized) ++header[2];
+    fwrite(header, sizeof(int), 3, fp);
+    for(i = 0; i < net.n; ++i){
+        layer l = net.layers[i];
+        int k = l.size*l.size*l.c;
+        int shape[4] = {i, l.n, l.c, l.size};
+        signed char *wq;
+        if(!l.quantized) continue;
+        wq = calloc((size_t)l.n*k, 1);
+        unpack_weights_int8(l.weights_int8, l.n, k, wq);
+        fwrite(shape, sizeof(int), 4, fp);
+        fwrite(l.input_scales, sizeof(float), l.c, fp);
+        fwrite(l.weight_scales, sizeof(float), l.n, fp);
+        fwrite(l.weight_sums, sizeof(int), l.n, fp);
+        fwrite(wq, 1, (size_t)l.n*k, fp);
+        free(wq);
+    }
+    fclose(fp);
+}
+
+int load_int8_weights(network *net, char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    int header[3];
+    int i, count = 0;
+    if(!fp) return -1;
+    if(fread(header, sizeof(int), 3, fp) != 3 || header[0] != INT8_MAGIC || header[1] != INT8_VERSION){
+        fprintf(stderr, "%s: INT8 weight 파일이 아닙니다.\n", filename);
+        fclose(fp);
+        return -1;
+    }
+    for(i = 0; i < header[2]; ++i){
+        int shape[4];
+        layer *l;
+        int k;
+        signed char *wq;
+        if(fread(shape, sizeof(int), 4, fp) != 4 || shape[0] < 0 || shape[0] >= net->n) break;
+        l = net->layers + shape[0];
+        if(!quantizable(net, shape[0]) || l->n != shape[1] || l->c != shape[2] || l->size != shape[3]){
+            fprintf(stderr, "%s: 레이어 %d의 모양이 cfg와 다릅니다.\n", filename, shape[0]);
+            break;
+        }
+        k = l->size*l->size*l->c;
+        alloc_int8_layer(l);
+        if(fread(l->input_scales, sizeof(float), l->c, fp) != (size_t)l->c) break;
+        if(fread(l->weight_scales, sizeof(float), l->n, fp) != (size_t)l->n) break;
+        if(fread(l->weight_sums, sizeof(int), l->n, fp) != (size_t)l->n) break;
+        wq = calloc((size_t)l->n*k, 1);
+        if(fread(wq, 1, (size_t)l->n*k, fp) != (size_t)l->n*k){
+            free(wq);
+            break;
+        }
+        pack_weights_int8(wq, l->n, k, l->weights_int8);
+        l->quantized = 1;
+        free(wq);
+        ++count;
+    }
+    fclose(fp);
+    if(count != header[2]){
+        for(i = 0; i < net->n; ++i) net->layers[i].quantized = 0;
+        return -1;
+    }
+    return count;
+}
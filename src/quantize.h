@@ -0,0 +1,34 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "network.h"
+
+#define INT8_MAGIC 0x38514e44   // "DNQ8"
+#define INT8_VERSION 1
+
+/* INT8 추론 (post-training quantization, CPU 전용)
+ * activation: calibration으로 모은 입력 채널별 범위로 u8 양자화 (zero point 128)
+ *             입력 채널 scale은 weight에 미리 곱해 두므로 gemm 안에서는 scale이 출력 채널별 하나뿐이다
+ * weight    : (입력 채널 scale을 곱한 뒤) 출력 채널별 대칭 int8, scale = max|w| / 127
+ *   y[i] = weight_scale[i] * (sum_k wq[i][k]*xq[k] - 128*sum_k wq[i][k]) + bias[i]
+ * 양자화된 weight는 <weights>.int8 파일에 따로 저장한다.
+ * batchnorm을 접은 (fuse_network) conv 레이어만 대상이고, region 레이어로 들어가는 마지막 conv는 FP32로 둔다 */
+
+/* 샘플 이미지들로 conv 레이어 입력의 채널별 최대 절댓값을 모은다. ranges[i]는 레이어 i (conv가 아니면 0) */
+float **calibrate_network(network net, char **paths, int n);
+/* fuse_network 뒤에 호출. 양자화한 레이어 수 */
+int quantize_network(network *net, float **ranges);
+void save_int8_weights(network net, char *filename);
+/* 양자화한 레이어 수, 파일이 없거나 모양이 다르면 -1 */
+int load_int8_weights(network *net, char *filename);
+
+void forward_convolutional_layer_int8(layer l, network_state state);
+
+/* int8 gemm: C = act(scales[i]*(A*B - 128*sums[i]) + bias[i])
+ * A는 pack_weights_int8로 pack한 weight (M x K), B는 u8 (K x N, zero point 128) */
+void gemm_int8(int M, int N, int K, const signed char *A, const unsigned char *B, int ldb,
+        float *C, int ldc, const float *scales, const int *sums, const float *bias, ACTIVATION act);
+size_t packed_weights_int8_size(int n, int k);
+void pack_weights_int8(const signed char *w, int n, int k, signed char *packed);
+
+#endif
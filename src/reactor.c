@@ -0,0 +1,79 @@
+#include "reactor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static void* reactor_loop(void* arg) {
+    ReactorWorker* w = (ReactorWorker*) arg;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    int i, n;
+
+    while (1) {
+        n = epoll_wait(w->epfd, events, REACTOR_MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            ReactorHandler* h = (ReactorHandler*) events[i].data.ptr;
+            h->on_event(h, events[i].events);
+        }
+    }
+    return 0;
+}
+
+Reactor* reactor_create(int num_workers) {
+    int i;
+    Reactor* r;
+
+    if (num_workers < 1)
+        num_workers = 1;
+
+    r = calloc(1, sizeof (Reactor));
+    r->num_workers = num_workers;
+    r->workers = calloc(num_workers, sizeof (ReactorWorker));
+    for (i = 0; i < num_workers; i++) {
+        if ((r->workers[i].epfd = epoll_create1(0)) == -1) {
+            perror("epoll_create1");
+            return NULL;
+        }
+        if (pthread_create(&r->workers[i].thread, NULL, reactor_loop, &r->workers[i])) {
+            perror("pthread_create");
+            return NULL;
+        }
+        pthread_detach(r->workers[i].thread);
+    }
+    return r;
+}
+
+int reactor_add(Reactor* r, ReactorHandler* h, unsigned int events) {
+    struct epoll_event ev;
+
+    h->worker = __sync_fetch_and_add(&r->next, 1) % r->num_workers;
+    ev.events = events;
+    ev.data.ptr = h;
+    return epoll_ctl(r->workers[h->worker].epfd, EPOLL_CTL_ADD, h->fd, &ev);
+}
+
+int reactor_mod(Reactor* r, ReactorHandler* h, unsigned int events) {
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.ptr = h;
+    return epoll_ctl(r->workers[h->worker].epfd, EPOLL_CTL_MOD, h->fd, &ev);
+}
+
+int reactor_del(Reactor* r, ReactorHandler* h) {
+    return epoll_ctl(r->workers[h->worker].epfd, EPOLL_CTL_DEL, h->fd, NULL);
+}
+
+int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1)
+        return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
@@ -0,0 +1,35 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#define REACTOR_MAX_EVENTS 64
+
+/* epoll 기반 이벤트 루프
+ * I/O 쓰레드마다 epoll 인스턴스를 하나씩 가지고, 등록된 핸들러는
+ * 항상 같은 쓰레드에서만 호출된다. 따라서 핸들러의 상태는 락 없이 다룰 수 있다. */
+typedef struct __ReactorHandler {
+    int fd;
+    int worker; // 담당 I/O 쓰레드 번호
+    void (*on_event)(struct __ReactorHandler* h, unsigned int events);
+} ReactorHandler;
+
+typedef struct __ReactorWorker {
+    int epfd;
+    pthread_t thread;
+} ReactorWorker;
+
+typedef struct __Reactor {
+    int num_workers;
+    int next; // round-robin 배정 위치
+    ReactorWorker* workers;
+} Reactor;
+
+Reactor* reactor_create(int num_workers);
+int reactor_add(Reactor* r, ReactorHandler* h, unsigned int events);
+int reactor_mod(Reactor* r, ReactorHandler* h, unsigned int events);
+int reactor_del(Reactor* r, ReactorHandler* h);
+int set_nonblocking(int fd);
+
+#endif /* REACTOR_H */
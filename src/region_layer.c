@@ -11,7 +11,7 @@
 
 #define DOABS 1
 
-region_layer make_region_layer(int batch, int w, int h, int n, int classes, int coords, int max_boxes)
+region_layer make_region_layer(int batch, int w, int h, int n, int classes, int coords, int max_boxes, int train)
 {
     region_layer l = {0};
     l.type = REGION;
@@ -24,12 +24,12 @@ region_layer make_region_layer(int batch, int w, int h, int n, int classes, int
     l.coords = coords;
     l.cost = calloc(1, sizeof(float));
     l.biases = calloc(n*2, sizeof(float));
-    l.bias_updates = calloc(n*2, sizeof(float));
+    if(train) l.bias_updates = calloc(n*2, sizeof(float));
     l.outputs = h*w*n*(classes + coords + 1);
     l.inputs = l.outputs;
 	l.max_boxes = max_boxes;
     l.truths = max_boxes*(5);
-    l.delta = calloc(batch*l.outputs, sizeof(float));
+    if(train) l.delta = calloc(batch*l.outputs, sizeof(float));
     l.output = calloc(batch*l.outputs, sizeof(float));
     int i;
     for(i = 0; i < n*2; ++i){
@@ -42,7 +42,7 @@ region_layer make_region_layer(int batch, int w, int h, int n, int classes, int
     l.forward_gpu = forward_region_layer_gpu;
     l.backward_gpu = backward_region_layer_gpu;
     l.output_gpu = cuda_make_array(l.output, batch*l.outputs);
-    l.delta_gpu = cuda_make_array(l.delta, batch*l.outputs);
+    if(train) l.delta_gpu = cuda_make_array(l.delta, batch*l.outputs);
 #endif
 
     fprintf(stderr, "detection\n");
@@ -170,9 +170,10 @@ void forward_region_layer(const region_layer l, network_state state)
 {
     int i,j,b,t,n;
     int size = l.coords + l.classes + 1;
-    memcpy(l.output, state.input, l.outputs*l.batch*sizeof(float));
     #ifndef GPU
-    flatten(l.output, l.w*l.h, size*l.n, l.batch, 1);
+    flatten_into(state.input, l.w*l.h, size*l.n, l.batch, 1, l.output);
+    #else
+    memcpy(l.output, state.input, l.outputs*l.batch*sizeof(float));
     #endif
     for (b = 0; b < l.batch; ++b){
         for(i = 0; i < l.h*l.w*l.n; ++i){
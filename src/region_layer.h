@@ -6,9 +6,10 @@
 
 typedef layer region_layer;
 
-region_layer make_region_layer(int batch, int h, int w, int n, int classes, int coords, int max_boxes);
+region_layer make_region_layer(int batch, int h, int w, int n, int classes, int coords, int max_boxes, int train);
 void forward_region_layer(const region_layer l, network_state state);
 void backward_region_layer(const region_layer l, network_state state);
+box get_region_box(float *x, float *biases, int n, int index, int i, int j, int w, int h);
 void get_region_boxes(layer l, int w, int h, float thresh, float **probs, box *boxes, int only_objectness, int *map);
 void resize_region_layer(layer *l, int w, int h);
 
@@ -0,0 +1,205 @@
+#include "registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+const char* approach_names[NUM_OF_APPROACH] = {"east", "west", "south", "north"};
+
+typedef struct {
+    uint32_t hash;
+    TrafficLight* tl;       // NULL이면 빈 칸
+} RegistrySlot;
+
+static RegistrySlot* slots = NULL;
+static int capacity = 0;    // 2의 거듭제곱
+static int used = 0;
+
+static Intersection** intersections = NULL;
+static int num_intersections = 0;
+static int max_intersections = 0;
+static int fixed = 0;       // 설정 파일을 읽었으면 그 교차로만 받는다
+
+int approach_index(const char* name) {
+    int i;
+    for (i = 0; i < NUM_OF_APPROACH; i++)
+        if (strcmp(name, approach_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+/* FNV-1a (id + '/' + approach) */
+static uint32_t key_hash(const char* id, const char* approach) {
+    uint32_t h = 2166136261u;
+    for (; *id; id++)
+        h = (h ^ (unsigned char) *id) * 16777619u;
+    h = (h ^ '/') * 16777619u;
+    for (; *approach; approach++)
+        h = (h ^ (unsigned char) *approach) * 16777619u;
+    return h;
+}
+
+static void insert_slot(uint32_t hash, TrafficLight* tl) {
+    int i = hash & (capacity - 1);
+    while (slots[i].tl != NULL)
+        i = (i + 1) & (capacity - 1);
+    slots[i].hash = hash;
+    slots[i].tl = tl;
+    used++;
+}
+
+/* 채움 비율을 1/2 아래로 유지한다 */
+static void reserve(int n) {
+    RegistrySlot* old = slots;
+    int old_capacity = capacity, i;
+
+    if ((used + n) * 2 <= capacity)
+        return;
+    while ((used + n) * 2 > capacity)
+        capacity = capacity ? capacity * 2 : 64;
+    slots = calloc(capacity, sizeof (RegistrySlot));
+    used = 0;
+    for (i = 0; i < old_capacity; i++)
+        if (old[i].tl != NULL)
+            insert_slot(old[i].hash, old[i].tl);
+    free(old);
+}
+
+void registry_init(int n) {
+    reserve(n * NUM_OF_APPROACH);
+}
+
+TrafficLight* registry_find(const char* id, const char* approach) {
+    uint32_t hash;
+    int i;
+
+    if (capacity == 0)
+        return NULL;
+    hash = key_hash(id, approach);
+    for (i = hash & (capacity - 1); slots[i].tl != NULL; i = (i + 1) & (capacity - 1)) {
+        TrafficLight* tl = slots[i].tl;
+        if (slots[i].hash == hash && strcmp(tl->intersection->id, id) == 0
+                && strcmp(approach_names[tl->approach], approach) == 0)
+            return tl;
+    }
+    return NULL;
+}
+
+/* 교차로 id는 파일 경로(files/<id>/)와 업로드 주소에 들어가므로 영문, 숫자, '-', '_', '.'만 (첫 글자는 '.' 제외) */
+static int valid_id(const char* id) {
+    int len = strlen(id), i;
+
+    if (len == 0 || len >= INTERSECTION_ID_SIZE || id[0] == '.')
+        return 0;
+    for (i = 0; i < len; i++)
+        if (!isalnum((unsigned char) id[i]) && id[i] != '-' && id[i] != '_' && id[i] != '.')
+            return 0;
+    return 1;
+}
+
+static Intersection* create_intersection(const char* id) {
+    TrafficLight* tl;
+    Intersection* x;
+    char dirname[BUFSIZE];
+    int i;
+
+    if (!valid_id(id))
+        return NULL;
+    x = calloc(1, sizeof (Intersection));
+    strcpy(x->id, id);
+    x->index = num_intersections;
+    x->ctl.timer.data = x;
+
+    reserve(NUM_OF_APPROACH);
+    for (i = 0; i < NUM_OF_APPROACH; i++) {
+        tl = &x->lights[i];
+        init_traffic_light(tl, (char*) approach_names[i]);
+        tl->id = x->index * NUM_OF_APPROACH + i;
+        tl->intersection = x;
+        tl->approach = i;
+        snprintf(tl->tag, sizeof (tl->tag), "%s/%s", id, approach_names[i]);
+        insert_slot(key_hash(id, approach_names[i]), tl);
+    }
+
+    if (num_intersections == max_intersections) {
+        max_intersections = max_intersections ? max_intersections * 2 : 16;
+        intersections = realloc(intersections, max_intersections * sizeof (Intersection*));
+    }
+    intersections[num_intersections++] = x;
+
+    snprintf(dirname, sizeof (dirname), "%s/%s", FILE_DIR, id);
+    mkdir(dirname, 0755);
+    return x;
+}
+
+Intersection* registry_intersection(const char* id, int create) {
+    TrafficLight* tl = registry_find(id, approach_names[0]);
+
+    if (tl != NULL)
+        return tl->intersection;
+    // 접속만으로 교차로가 끝없이 늘지 않도록 (교차로마다 폴더, 신호 타이머, 상태 업로드가 생긴다)
+    if (!create || fixed || num_intersections >= MAX_INTERSECTIONS)
+        return NULL;
+    return create_intersection(id);
+}
+
+int registry_load(const char* filename) {
+    FILE* fp = fopen(filename, "r");
+    char line[BUFSIZE];
+    int n = 0;
+
+    if (fp == NULL)
+        return -1;
+    while (fgets(line, sizeof (line), fp) != NULL) {
+        char id[BUFSIZE];
+        char* comment = strchr(line, '#');
+
+        if (comment != NULL)
+            *comment = 0;
+        if (sscanf(line, "%s", id) != 1)
+            continue;
+        if (registry_intersection(id, 0) != NULL)
+            continue;
+        // 설정 파일의 교차로는 MAX_INTERSECTIONS와 상관없이 만든다
+        if (create_intersection(id) == NULL)
+            printf("[SERVER] 잘못된 교차로 id \"%s\" (%s)\n", id, filename);
+        else
+            n++;
+    }
+    fclose(fp);
+    fixed = 1;
+    return n;
+}
+
+int registry_intersections(Intersection*** buf, int* cap) {
+    if (*cap < num_intersections) {
+        *cap = max_intersections;
+        *buf = realloc(*buf, *cap * sizeof (Intersection*));
+    }
+    memcpy(*buf, intersections, num_intersections * sizeof (Intersection*));
+    return num_intersections;
+}
+
+int registry_connected(TrafficLight*** buf, int* cap) {
+    int i, j, n = 0;
+
+    for (i = 0; i < num_intersections; i++) {
+        for (j = 0; j < NUM_OF_APPROACH; j++) {
+            TrafficLight* tl = &intersections[i]->lights[j];
+            if (!tl->connected)
+                continue;
+            if (n == *cap) {
+                *cap = *cap ? *cap * 2 : 16;
+                *buf = realloc(*buf, *cap * sizeof (TrafficLight*));
+            }
+            (*buf)[n++] = tl;
+        }
+    }
+    return n;
+}
+
+int registry_size() {
+    return num_intersections;
+}
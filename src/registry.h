@@ -0,0 +1,51 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <time.h>
+#include "server.h"
+#include "scheduler.h"
+
+#define NUM_OF_APPROACH NUM_OF_LED  // east, west, south, north (traffic.h의 EAST..NORTH 순)
+#define MAX_INTERSECTIONS 256       // 설정 파일 없이 접속으로 만들 수 있는 교차로 수 (registry_load는 제한 없음)
+
+/* 교차로 하나의 신호 주기 상태 (controller.c의 신호 제어 쓰레드가 바꾼다) */
+typedef struct __TrafficController {
+    Timer timer;            // 다음 신호 전환 (신호 제어 쓰레드만 쓴다, data = 교차로)
+    double phase_end;       // 지금 신호가 끝나는 시각 (what_time_is_it_now 기준)
+    double phase_time;      // 지금 신호의 길이 (초)
+    int myswitch;           // 다음에 켤 신호, 주황불 차례이면 4 (야간 2)
+    int old_switch;
+    int calc_time;          // 차량 수로 늘리고 줄인 신호 시간 (초)
+} TrafficController;
+
+/* 교차로. 방향별 신호등 4개와 신호 상태를 갖는다. 한 번 만들면 프로세스가 끝날 때까지 주소가 바뀌지 않는다 */
+typedef struct __Intersection {
+    char id[INTERSECTION_ID_SIZE];
+    int index;              // 만든 순서
+    TrafficLight lights[NUM_OF_APPROACH];
+    TrafficController ctl;
+    unsigned int status_seq;
+} Intersection;
+
+extern const char* approach_names[NUM_OF_APPROACH];
+/* "east" -> EAST, 모르는 이름은 -1 */
+int approach_index(const char* name);
+
+/* 교차로 registry
+ * (교차로 id, 방향) -> 신호등 을 open addressing (linear probing) 해시 테이블로 찾는다.
+ * 교차로는 신호등이 처음 연결될 때나 설정 파일(registry_load)로 만들어지고 지워지지 않는다.
+ * 아래 함수들은 conn_mutex를 잡고 호출한다 (registry_init, registry_load는 서버 시작 전) */
+void registry_init(int capacity);
+/* 설정 파일: 한 줄에 교차로 id 하나 (# 뒤는 주석). 읽은 뒤로는 목록에 없는 교차로를 만들지 않는다.
+ * 반환값: 만든 교차로 수, 파일이 없으면 -1 */
+int registry_load(const char* filename);
+/* 없으면 create일 때 만든다. id가 비었거나 너무 길면, 설정 파일에 없거나 MAX_INTERSECTIONS개가 찼으면 NULL */
+Intersection* registry_intersection(const char* id, int create);
+TrafficLight* registry_find(const char* id, const char* approach);
+/* 교차로 목록을 *buf에 복사한다 (*cap이 모자라면 늘린다). 반환값: 교차로 수 */
+int registry_intersections(Intersection*** buf, int* cap);
+/* 연결된 신호등을 *buf에 복사한다. 반환값: 신호등 수 */
+int registry_connected(TrafficLight*** buf, int* cap);
+int registry_size();
+
+#endif /* REGISTRY_H */
@@ -4,7 +4,7 @@
 #include <stdio.h>
 
 
-layer make_reorg_layer(int batch, int w, int h, int c, int stride, int reverse)
+layer make_reorg_layer(int batch, int w, int h, int c, int stride, int reverse, int train)
 {
     layer l = {0};
     l.type = REORG;
@@ -28,7 +28,7 @@ layer make_reorg_layer(int batch, int w, int h, int c, int stride, int reverse)
     l.inputs = h*w*c;
     int output_size = l.out_h * l.out_w * l.out_c * batch;
     l.output =  calloc(output_size, sizeof(float));
-    l.delta =   calloc(output_size, sizeof(float));
+    if(train) l.delta = calloc(output_size, sizeof(float));
 
     l.forward = forward_reorg_layer;
     l.backward = backward_reorg_layer;
@@ -37,7 +37,7 @@ layer make_reorg_layer(int batch, int w, int h, int c, int stride, int reverse)
     l.backward_gpu = backward_reorg_layer_gpu;
 
     l.output_gpu  = cuda_make_array(l.output, output_size);
-    l.delta_gpu   = cuda_make_array(l.delta, output_size);
+    if(train) l.delta_gpu = cuda_make_array(l.delta, output_size);
 #endif
     return l;
 }
@@ -0,0 +1,189 @@
+#include "roi.h"
+#include "registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+extern char SERVER_ID[BUFSIZE];
+
+/* "x,y x,y ..." -> p. 점이 3개보다 적거나 너무 많거나 0~1을 벗어나면 (화소 단위 등) -1 */
+static int parse_polygon(char* points, Polygon* p) {
+    char* tok;
+
+    p->n = 0;
+    for (tok = strtok(points, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+        if (p->n == ROI_MAX_POINTS || sscanf(tok, "%f,%f", &p->x[p->n], &p->y[p->n]) != 2)
+            return -1;
+        if (!(p->x[p->n] >= 0 && p->x[p->n] <= 1 && p->y[p->n] >= 0 && p->y[p->n] <= 1))
+            return -1;
+        p->n++;
+    }
+    return p->n >= 3 ? 0 : -1;
+}
+
+static LightRoi* light_roi(char* light) {
+    char* intersection = SERVER_ID, *approach = light, *slash;
+    Intersection* x;
+    TrafficLight* tl;
+
+    if ((slash = strchr(light, '/')) != NULL) {
+        *slash = 0;
+        intersection = light;
+        approach = slash + 1;
+    }
+    if (approach_index(approach) < 0 || (x = registry_intersection(intersection, 1)) == NULL)
+        return NULL;
+    tl = &x->lights[approach_index(approach)];
+    if (tl->roi == NULL) {
+        tl->roi = calloc(1, sizeof (LightRoi));
+        tl->roi->max_tiles = ROI_MAX_TILES;
+    }
+    return tl->roi;
+}
+
+int roi_load(const char* filename) {
+    FILE* fp = fopen(filename, "r");
+    char line[BUFSIZE * 4];
+    int n = 0, line_num = 0;
+
+    if (fp == NULL)
+        return -1;
+    while (fgets(line, sizeof (line), fp) != NULL) {
+        char light[BUFSIZE], key[16];
+        char* comment = strchr(line, '#');
+        LightRoi* roi;
+        int offset, ok = 0;
+
+        line_num++;
+        if (comment != NULL)
+            *comment = 0;
+        if (sscanf(line, "%512s %15s %n", light, key, &offset) != 2)
+            continue;
+        if ((roi = light_roi(light)) == NULL) {
+            printf("[SERVER] %s:%d 잘못된 신호등 이름\n", filename, line_num);
+            fclose(fp);
+            return -1;
+        }
+        if (strcmp(key, "roi") == 0) {
+            ok = parse_polygon(line + offset, &roi->area) == 0;
+        } else if (strcmp(key, "lane") == 0) {
+            ok = roi->num_lanes < ROI_MAX_LANES && parse_polygon(line + offset, &roi->lanes[roi->num_lanes]) == 0;
+            if (ok)
+                roi->num_lanes++;
+        } else if (strcmp(key, "tiles") == 0) {
+            ok = sscanf(line + offset, "%d", &roi->max_tiles) == 1 && roi->max_tiles >= 1 && roi->max_tiles <= ROI_MAX_TILES;
+        }
+        if (!ok) {
+            printf("[SERVER] %s:%d 해석할 수 없는 줄 (roi|lane x,y x,y x,y ... / tiles 1~%d)\n", filename, line_num,
+                    ROI_MAX_TILES);
+            fclose(fp);
+            return -1;
+        }
+        n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+int polygon_contains(const Polygon* p, float x, float y) {
+    int i, j, in = 0;
+
+    for (i = 0, j = p->n - 1; i < p->n; j = i++) {
+        if ((p->y[i] > y) != (p->y[j] > y)
+                && x < (p->x[j] - p->x[i]) * (y - p->y[i]) / (p->y[j] - p->y[i]) + p->x[i])
+            in = !in;
+    }
+    return in;
+}
+
+static void polygon_bounds(const Polygon* p, float* x0, float* y0, float* x1, float* y1) {
+    int i;
+    for (i = 0; i < p->n; i++) {
+        if (p->x[i] < *x0) *x0 = p->x[i];
+        if (p->y[i] < *y0) *y0 = p->y[i];
+        if (p->x[i] > *x1) *x1 = p->x[i];
+        if (p->y[i] > *y1) *y1 = p->y[i];
+    }
+}
+
+/* 구간 [start, start + len)을 n개로 겹치게 나눈 것 중 k번째 */
+static void split(int start, int len, int n, int k, int* pos, int* size) {
+    int s = n > 1 ? len / n + ROI_TILE_OVERLAP : len;
+    if (s > len)
+        s = len;
+    *size = s;
+    *pos = start + (n > 1 ? k * (len - s) / (n - 1) : 0);
+}
+
+int roi_tiles(const LightRoi* roi, int w, int h, int net_w, int net_h, RoiTile* tiles) {
+    float x0 = 1, y0 = 1, x1 = 0, y1 = 0;
+    int px, py, cw, ch, nx, ny, i, j, n = 0;
+
+    if (roi != NULL && roi->area.n > 0) {
+        polygon_bounds(&roi->area, &x0, &y0, &x1, &y1);
+    } else if (roi != NULL && roi->num_lanes > 0) {
+        for (i = 0; i < roi->num_lanes; i++)
+            polygon_bounds(&roi->lanes[i], &x0, &y0, &x1, &y1);
+    }
+    if (roi == NULL || x1 <= x0 || y1 <= y0) {
+        tiles[0].x = tiles[0].y = 0;
+        tiles[0].w = w;
+        tiles[0].h = h;
+        return 1;
+    }
+
+    // 설정은 0~1로 검사하지만, 잘린 영역이 프레임 밖으로 나가지 않도록 한 번 더 막는다
+    px = x0 < 0 ? 0 : (int) (x0 * w);
+    py = y0 < 0 ? 0 : (int) (y0 * h);
+    if (px > w - 1)
+        px = w - 1;
+    if (py > h - 1)
+        py = h - 1;
+    cw = (x1 > 1 ? w : (int) ceil(x1 * w)) - px;
+    ch = (y1 > 1 ? h : (int) ceil(y1 * h)) - py;
+    if (cw > w - px)
+        cw = w - px;
+    if (ch > h - py)
+        ch = h - py;
+    if (cw < 1)
+        cw = 1;
+    if (ch < 1)
+        ch = 1;
+
+    // 원래 해상도에 가깝게: 네트워크 입력보다 큰 만큼 타일로 나눈다 (max_tiles를 넘으면 줄여서)
+    nx = (cw + net_w - 1) / net_w;
+    ny = (ch + net_h - 1) / net_h;
+    while (nx * ny > roi->max_tiles) {
+        if (nx >= ny)
+            nx--;
+        else
+            ny--;
+    }
+    for (j = 0; j < ny; j++) {
+        for (i = 0; i < nx; i++) {
+            split(px, cw, nx, i, &tiles[n].x, &tiles[n].w);
+            split(py, ch, ny, j, &tiles[n].y, &tiles[n].h);
+            n++;
+        }
+    }
+    return n;
+}
+
+int roi_keep(const LightRoi* roi, box b) {
+    float x = b.x, y = b.y + b.h / 2;
+    int i;
+
+    if (roi == NULL)
+        return 1;
+    if (y > 1)
+        y = 1;
+    if (roi->area.n > 0 && !polygon_contains(&roi->area, x, y))
+        return 0;
+    if (roi->num_lanes == 0)
+        return 1;
+    for (i = 0; i < roi->num_lanes; i++)
+        if (polygon_contains(&roi->lanes[i], x, y))
+            return 1;
+    return 0;
+}
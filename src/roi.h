@@ -0,0 +1,46 @@
+#ifndef ROI_H
+#define ROI_H
+
+#include "box.h"
+
+#define ROI_MAX_POINTS 16
+#define ROI_MAX_LANES 8
+#define ROI_MAX_TILES 4     // 신호등 하나를 나눠 분석하는 최대 타일 수
+#define ROI_TILE_OVERLAP 32 // 타일 경계에 걸친 차를 놓치지 않도록 겹치는 화소 수
+
+/* 다각형. 좌표는 이미지 크기에 대한 비율 (0~1) */
+typedef struct __Polygon {
+    int n;
+    float x[ROI_MAX_POINTS];
+    float y[ROI_MAX_POINTS];
+} Polygon;
+
+/* 신호등(카메라)별 관심 영역
+ * area의 bounding box만 잘라서 원래 해상도에 가깝게 분석하고 (넓으면 타일로 나눈다),
+ * 박스의 바닥 가운데(차가 도로에 닿는 점)가 area와 차선(lanes 중 하나) 안에 있는 차만 센다 */
+typedef struct __LightRoi {
+    Polygon area;           // n == 0이면 차선들을 감싸는 영역, 차선도 없으면 전체 화면
+    int num_lanes;
+    Polygon lanes[ROI_MAX_LANES];
+    int max_tiles;          // 1이면 자른 영역을 한 번에 네트워크 크기로 줄인다
+} LightRoi;
+
+/* 프레임 안의 분석할 영역 (화소) */
+typedef struct __RoiTile {
+    int x, y, w, h;
+} RoiTile;
+
+/* 설정 파일. 한 줄에 하나 (# 뒤는 주석), 방향만 쓰면 기본 교차로 (SERVER_ID):
+ *   <교차로>/<방향> roi x,y x,y x,y ...
+ *   <교차로>/<방향> lane x,y x,y x,y ...   (여러 줄이면 차선 여러 개)
+ *   <교차로>/<방향> tiles n
+ * 반환값: 읽은 줄 수, 파일이 없거나 잘못된 줄이 있으면 -1. 서버 시작 전에 호출 (run_server) */
+int roi_load(const char* filename);
+
+int polygon_contains(const Polygon* p, float x, float y);
+/* w x h 프레임에서 분석할 타일들 (roi가 NULL이면 전체 화면 하나). 반환값: 타일 수 */
+int roi_tiles(const LightRoi* roi, int w, int h, int net_w, int net_h, RoiTile* tiles);
+/* 프레임 비율 좌표의 박스를 셀지 */
+int roi_keep(const LightRoi* roi, box b);
+
+#endif /* ROI_H */
@@ -0,0 +1,87 @@
+#include "scheduler.h"
+#include <stdlib.h>
+
+static void place(Scheduler* s, int i, Timer* t) {
+    s->heap[i] = t;
+    t->index = i;
+}
+
+static void sift_up(Scheduler* s, int i) {
+    Timer* t = s->heap[i];
+    while (i > 1 && s->heap[i / 2]->when > t->when) {
+        place(s, i, s->heap[i / 2]);
+        i /= 2;
+    }
+    place(s, i, t);
+}
+
+static void sift_down(Scheduler* s, int i) {
+    Timer* t = s->heap[i];
+    for (;;) {
+        int c = i * 2;
+        if (c > s->size)
+            break;
+        if (c < s->size && s->heap[c + 1]->when < s->heap[c]->when)
+            c++;
+        if (s->heap[c]->when >= t->when)
+            break;
+        place(s, i, s->heap[c]);
+        i = c;
+    }
+    place(s, i, t);
+}
+
+void schedule_at(Scheduler* s, Timer* t, double when) {
+    double old = t->when;
+
+    t->when = when;
+    if (t->index) {
+        if (when < old)
+            sift_up(s, t->index);
+        else
+            sift_down(s, t->index);
+        return;
+    }
+    if (s->size + 1 >= s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 64;
+        s->heap = realloc(s->heap, s->cap * sizeof (Timer*));
+    }
+    place(s, ++s->size, t);
+    sift_up(s, s->size);
+}
+
+void schedule_cancel(Scheduler* s, Timer* t) {
+    int i = t->index;
+    Timer* last;
+
+    if (i == 0)
+        return;
+    t->index = 0;
+    last = s->heap[s->size--];
+    if (last == t)
+        return;
+    place(s, i, last);
+    if (i > 1 && s->heap[i / 2]->when > last->when)
+        sift_up(s, i);
+    else
+        sift_down(s, i);
+}
+
+Timer* scheduler_next(Scheduler* s) {
+    return s->size ? s->heap[1] : NULL;
+}
+
+Timer* scheduler_pop(Scheduler* s, double now) {
+    Timer* t = scheduler_next(s);
+
+    if (t == NULL || t->when > now)
+        return NULL;
+    schedule_cancel(s, t);
+    return t;
+}
+
+void scheduler_free(Scheduler* s) {
+    free(s->heap);
+    s->heap = NULL;
+    s->size = s->cap = 0;
+}
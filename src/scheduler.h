@@ -0,0 +1,28 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/* 교차로 신호 전환 시각을 관리하는 min-heap 타이머
+ * Timer는 쓰는 쪽 구조체 안에 두고 heap 위치(index)를 기억하므로 예약, 변경, 취소가 모두 O(log n)이다.
+ * 시각은 what_time_is_it_now() 기준 (초, CLOCK_MONOTONIC). 락이 없으므로 한 쓰레드에서만 쓴다 */
+typedef struct __Timer {
+    double when;
+    int index;              // heap 위치 (1부터), 0이면 예약되지 않음
+    void* data;
+} Timer;
+
+typedef struct __Scheduler {
+    Timer** heap;           // heap[1..size]
+    int size;
+    int cap;
+} Scheduler;
+
+/* 예약되어 있으면 시각만 바꾼다 */
+void schedule_at(Scheduler* s, Timer* t, double when);
+void schedule_cancel(Scheduler* s, Timer* t);
+/* 가장 이른 타이머, 없으면 NULL */
+Timer* scheduler_next(Scheduler* s);
+/* now까지 된 타이머를 하나 꺼낸다 (꺼낸 타이머는 예약되지 않은 상태), 없으면 NULL */
+Timer* scheduler_pop(Scheduler* s, double now);
+void scheduler_free(Scheduler* s);
+
+#endif /* SCHEDULER_H */
@@ -1,5 +1,9 @@
 
 #include "server.h"
+#include "archiver.h"
+#include "registry.h"
+#include "controller.h"
+#include "roi.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,13 +12,12 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/stat.h>
-#include <curl/curl.h>
+#include <errno.h>
 
 /* TRAFFIC LIGHT */
-char SERVER_ID[BUFSIZE] = "1";
-TrafficLight* tls[NUM_OF_CLI];
-TrafficLight east, west, south, north;
+char SERVER_ID[BUFSIZE] = "1"; // 이름만 보내는 신호등이 붙는 기본 교차로
 
 void init_traffic_light(TrafficLight* tl, char* name) {
     int i;
@@ -25,41 +28,39 @@ void init_traffic_light(TrafficLight* tl, char* name) {
     tl->back = 0;
     tl->side = 0;
     tl->accident = 0;
+    tl->connected = 0;
+    tl->clientSock = -1;
+    tl->thumb_valid = 0;
+    tl->skipped = 0;
+    tbuf_init(&tl->frames);
     for (i = 0; i < NUM_OF_LED; i++)
         tl->leds[i] = 0;
-    pthread_mutex_init(&tl->mutex, NULL);
 }
 
-TrafficLight* createTrafficLight(char* name, int sock) {
-    int i, j;
-    for (i = 0; i < NUM_OF_CLI; i++) {
-        if (tls[i] == NULL) {
-            if (strcmp(name, east.name) == 0)
-                tls[i] = &east;
-            else if (strcmp(name, west.name) == 0)
-                tls[i] = &west;
-            else if (strcmp(name, south.name) == 0)
-                tls[i] = &south;
-            else if (strcmp(name, north.name) == 0)
-                tls[i] = &north;
-            else
-                return NULL;
-
-            tls[i]->clientSock = sock;
-
-            return tls[i];
-        }
-    }
-    return NULL;
+TrafficLight* createTrafficLight(char* intersection, char* name, int sock) {
+    Intersection* x;
+    TrafficLight* tl;
+
+    if (approach_index(name) < 0 || (x = registry_intersection(intersection, 1)) == NULL)
+        return NULL;
+    tl = &x->lights[approach_index(name)];
+
+    // 같은 신호등에 writer가 둘이 되지 않도록 이미 연결된 신호등은 거부한다
+    if (tl->connected)
+        return NULL;
+    tl->connected = 1;
+    tl->clientSock = sock;
+    // 처음 보는 교차로면 신호 제어 쓰레드가 바로 예약하도록
+    controller_wake();
+    return tl;
 }
 
 void destroyTrafficLight(TrafficLight* tl) {
-    int i;
-    for (i = 0; i < NUM_OF_CLI; i++) {
-        if (tls[i] == tl) {
-            tls[i] = NULL;
-        }
-    }
+    tl->connected = 0;
+    tl->clientSock = -1;
+    // 분석하지 못한 프레임은 다음 연결에 넘기지 않는다 (다음 연결의 첫 프레임은 항상 분석)
+    tbuf_clear(&tl->frames);
+    tl->thumb_valid = 0;
 }
 
 int getBit(int bit, int bit_id) {
@@ -70,15 +71,15 @@ int getBit(int bit, int bit_id) {
 
 /* SOCKET */
 pthread_mutex_t conn_mutex;
+Reactor* reactor;
 
-void run_server(char* port) {
+void run_server(char* port, int io_threads, char* intersection_file, char* roi_file) {
     int serv_sock;
     struct sockaddr_in serv_addr;
     int sock_opt;
     pthread_t listen_thread;
-    char dirname[BUFSIZE];
-    
     pthread_mutex_init(&conn_mutex, NULL);
+    tbuf_wait_init();
 
     if ((serv_sock = socket(PF_INET, SOCK_STREAM, 0)) == -1)
         error_handler("socket() error");
@@ -90,18 +91,24 @@ void run_server(char* port) {
     serv_addr.sin_port = htons(atoi(port)); //16bit PORT
     if (bind(serv_sock, (struct sockaddr*) &serv_addr, sizeof (serv_addr)) == -1)
         error_handler("bind() error");
-    if (listen(serv_sock, NUM_OF_CLI) == -1)
+    if (listen(serv_sock, SOMAXCONN) == -1)
         error_handler("listen() error");
 
-    init_traffic_light(&east, "east");
-    init_traffic_light(&west, "west");
-    init_traffic_light(&south, "south");
-    init_traffic_light(&north, "north");
-
-    sprintf(dirname, "%s/%s", FILE_DIR, SERVER_ID);
-    mkdir(dirname, 0755);
+    // 교차로는 신호등이 처음 연결될 때 만들어진다 (MAX_INTERSECTIONS개까지).
+    // 설정 파일이 있으면 미리 만들어 두고 그 목록과 [section_num] 교차로만 받는다
+    registry_init(16);
+    registry_intersection(SERVER_ID, 1);
+    if (intersection_file != NULL && registry_load(intersection_file) < 0)
+        error_handler("교차로 설정 파일을 열 수 없습니다");
+    // 신호등별 관심 영역 (없으면 전체 화면을 분석한다)
+    if (roi_file != NULL && roi_load(roi_file) < 0)
+        error_handler("관심 영역 설정 파일을 읽을 수 없습니다");
+
+    // I/O 쓰레드 생성
+    if ((reactor = reactor_create(io_threads)) == NULL)
+        error_handler("I/O 쓰레드 생성 실패");
     
-    if (pthread_create(&listen_thread, NULL, listen_clnt, (void*) serv_sock))
+    if (pthread_create(&listen_thread, NULL, listen_clnt, (void*) (long) serv_sock))
         error_handler("연결 대기 쓰레드 생성 실패");
 
     printf("\n\n");
@@ -120,205 +127,397 @@ void run_server(char* port) {
     printf("        C  ontroller                    \\___________________/\n\n");
     printf("                            << Team KKCC >>\n\n");
     
-    printf("[SERVER] STLC 시작. PORT %s\n", port);
+    printf("[SERVER] STLC 시작. PORT %s (I/O 쓰레드 %d개, 교차로 %d개)\n", port, reactor->num_workers,
+            registry_size());
 
     return;
 }
 
 void *listen_clnt(void *arg) {
-    pthread_t thread;
     struct sockaddr_in clnt_addr;
-    int clnt_addr_size;
-    int serv_sock = (int) arg;
+    socklen_t clnt_addr_size;
+    int serv_sock = (int) (long) arg;
     int clnt_sock;
+    int sock_opt;
+    Connection* c;
 
     while (1) {
         clnt_addr_size = sizeof (clnt_addr);
         clnt_sock = accept(serv_sock, (struct sockaddr *) &clnt_addr,
                 &clnt_addr_size);
-        pthread_create(&thread, NULL, clnt_connection, (void*) clnt_sock);
-        printf("[SERVER] IP %s와 연결을 시도합니다.\n", inet_ntoa(clnt_addr.sin_addr));
+        if (clnt_sock == -1)
+            continue;
+        set_nonblocking(clnt_sock);
+        sock_opt = 1; // 작은 응답(OK, LED)이 Nagle 알고리즘에 묶이지 않도록 한다
+        setsockopt(clnt_sock, IPPROTO_TCP, TCP_NODELAY, &sock_opt, sizeof (sock_opt));
+
+        c = calloc(1, sizeof (Connection));
+        c->handler.fd = clnt_sock;
+        c->handler.on_event = clnt_connection;
+        c->state = CONN_HELLO;
+        inet_ntop(AF_INET, &clnt_addr.sin_addr, c->addr, sizeof (c->addr));
+        printf("[SERVER] IP %s와 연결을 시도합니다.\n", c->addr);
+
+        if (reactor_add(reactor, &c->handler, EPOLLIN | EPOLLRDHUP) == -1) {
+            close(clnt_sock);
+            free(c);
+        }
     }
 }
 
-void *clnt_connection(void *arg) {
-    char message[BUFSIZE];
-    int msg_size;
-    TrafficLight* tl;
+/* 연결별 상태 머신. 하나의 연결은 항상 같은 I/O 쓰레드에서 처리된다. */
+void clnt_connection(ReactorHandler* h, unsigned int events) {
+    Connection* c = (Connection*) h;
+    int msg_size, ret;
 
-    // 쓰레드 이름 설정
-    if (recv_message((int) arg, message) == 0)
-        return 0;
+    if (events & EPOLLOUT) {
+        conn_send(c, NULL, 0);
+        if (c->out_len == -1) {
+            close_connection(c);
+            return;
+        }
+    }
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        close_connection(c);
+        return;
+    }
+    if (!(events & (EPOLLIN | EPOLLRDHUP)))
+        return;
 
-    pthread_mutex_lock(&conn_mutex);
-    tl = createTrafficLight(message, (int) arg);
-    pthread_mutex_unlock(&conn_mutex);
+    if (c->state == CONN_IMG_DATA) {
+        if ((ret = recv_image(c)) == -1 || c->out_len == -1) {
+            fprintf(stderr, "recv image err\n");
+            close_connection(c);
+        }
+        return;
+    }
+    if (c->state == CONN_V2_HEADER || c->state == CONN_V2_PAYLOAD) {
+        if ((ret = recv_frame_v2(c)) == -1 || c->out_len == -1) {
+            if (c->header_info.type != MSG_EXIT)
+                fprintf(stderr, "recv frame err\n");
+            close_connection(c);
+        }
+        return;
+    }
 
-    if (tl == NULL) {
-        close((int) arg);
-        printf("[SERVER] 연결을 실패했습니다.\n");
+    if ((msg_size = recv_message(c)) == -1)
+        return;
+    if (msg_size == 0) {
+        close_connection(c);
         return;
     }
 
-    printf("[SERVER] \"%s\" 신호등이 연결되었습니다.\n", tl->name);
+    switch (c->state) {
+        case CONN_HELLO: {
+            char name[BUFSIZE], version[BUFSIZE] = "";
+            char *intersection = SERVER_ID, *approach = name, *slash;
 
-    // PI sleep time 설정
-    sprintf(message, "%d", STREAM_FPS);
-    send_message(tl->clientSock, message, strlen(message));
+            // "<교차로>/<방향>" 또는 "<방향>" (기본 교차로), 뒤에 " v2"가 붙어 있으면 v2 프로토콜 사용
+            if (sscanf(c->message, "%s %s", name, version) < 1) {
+                close_connection(c);
+                return;
+            }
+            c->proto = strcmp(version, STLC_HELLO_V2) == 0 ? 2 : 1;
+            if ((slash = strchr(name, '/')) != NULL) {
+                *slash = 0;
+                intersection = name;
+                approach = slash + 1;
+            }
+
+            pthread_mutex_lock(&conn_mutex);
+            c->tl = createTrafficLight(intersection, approach, c->handler.fd);
+            pthread_mutex_unlock(&conn_mutex);
+
+            if (c->tl == NULL) {
+                printf("[SERVER] 연결을 실패했습니다. (%s/%s)\n", intersection, approach);
+                close_connection(c);
+                return;
+            }
+            printf("[SERVER] \"%s\" 신호등이 연결되었습니다. (프로토콜 v%d)\n", c->tl->tag, c->proto);
+
+            // PI sleep time 설정
+            if (c->proto == 2) {
+                sprintf(c->message, "%d %s %d", STREAM_FPS, STLC_HELLO_V2, c->tl->id);
+                c->state = CONN_V2_HEADER;
+            } else {
+                sprintf(c->message, "%d", STREAM_FPS);
+                c->state = CONN_IDLE;
+            }
+            conn_send(c, c->message, strlen(c->message));
+            break;
+        }
+
+        case CONN_IDLE:
+            if (strstr(c->message, "/send_image") != NULL) { //trans seq:1 (start)
+                conn_send(c, "OK", 2); //trans seq:2
+                c->state = CONN_IMG_INFO;
+            } else if (strstr(c->message, "/get_led") != NULL) {
+                memset(c->message, 0, 16);
+                sprintf(c->message, "%d %d %d %d", c->tl->leds[0],
+                        c->tl->leds[1], c->tl->leds[2], c->tl->leds[3]);
+                conn_send(c, c->message, 16);
+            } else if (strstr(c->message, "/exit") != NULL) {
+                conn_send(c, "OK", 2);
+                close_connection(c);
+                return;
+            }
+            break;
 
-    // 쓰레드 동작
-    while ((msg_size = recv_message(tl->clientSock, message)) != 0) {
-        if (strstr(message, "/send_image") != NULL) { //trans seq:1 (start)
-            send_message(tl->clientSock, "OK", 2); //trans seq:2
-            if (recv_image(tl, message) == -1) {
+        case CONN_IMG_INFO: {
+            char cmd_line[BUFSIZE];
+            int filesize = 0;
+
+            // recv the file info
+            sscanf(c->message, "%s %d", cmd_line, &filesize); //trans seq:3
+            if (strstr(cmd_line, "NOK")) {
+                printf("[%s] 이미지 전송 실패\n", c->tl->tag);
                 fprintf(stderr, "recv image err\n");
+                close_connection(c);
+                return;
+            }
+            if (filesize <= 0 || filesize > MAX_IMAGE_SIZE) {
+                printf("[%s] 이미지 크기 오류 (%d bytes)\n", c->tl->tag, filesize);
+                conn_send(c, "NOK", 3);
+                c->state = CONN_IDLE;
                 break;
             }
-        } else if (strstr(message, "/get_led") != NULL) {
-            sprintf(message, "%d %d %d %d",
-                    tl->leds[0], tl->leds[1], tl->leds[2], tl->leds[3]);
-            send_message(tl->clientSock, message, 16);
-        } else if (strstr(message, "/exit") != NULL) {
-            send_message(tl->clientSock, "OK", 2);
+            c->frame = tbuf_write_begin(&c->tl->frames, filesize);
+            c->image_size = filesize;
+            c->image_recv = 0;
+            c->chunk_recv = 0;
+
+            // send ok sign
+            conn_send(c, "OK", 2); //trans seq:4
+            c->state = CONN_IMG_DATA;
             break;
         }
+
+        default:
+            break;
     }
+    if (c->out_len == -1)
+        close_connection(c);
+}
 
-    pthread_mutex_lock(&conn_mutex);
-    close(tl->clientSock);
-    printf("[SERVER] \"%s\" 신호등의 연결이 끊어졌습니다.\n", tl->name);
-    destroyTrafficLight(tl);
-    pthread_mutex_unlock(&conn_mutex);
+void close_connection(Connection* c) {
+    reactor_del(reactor, &c->handler);
+    close(c->handler.fd);
 
-    return 0;
+    if (c->tl != NULL) {
+        pthread_mutex_lock(&conn_mutex);
+        printf("[SERVER] \"%s\" 신호등의 연결이 끊어졌습니다.\n", c->tl->tag);
+        destroyTrafficLight(c->tl);
+        pthread_mutex_unlock(&conn_mutex);
+    }
+    free(c);
 }
 
 void send_message(int clnt_sock, char * message, int msg_size) {
-    send(clnt_sock, message, msg_size, 0);
+    send(clnt_sock, message, msg_size, MSG_NOSIGNAL);
+}
+
+/* 논블로킹 전송. 다 보내지 못한 데이터는 c->out에 남겨두고 EPOLLOUT을 기다린다.
+ * message가 NULL이면 남은 데이터만 밀어낸다. 오류가 나면 out_len이 -1이 된다. */
+void conn_send(Connection* c, char* message, int msg_size) {
+    int sent;
+
+    if (c->out_len == -1)
+        return;
+    if (message != NULL) {
+        if (c->out_len + msg_size > BUFSIZE) {
+            c->out_len = -1;
+            return;
+        }
+        memcpy(c->out + c->out_len, message, msg_size);
+        c->out_len += msg_size;
+    }
+    if (c->out_len == 0)
+        return;
+
+    sent = send(c->handler.fd, c->out, c->out_len, MSG_NOSIGNAL);
+    if (sent == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            c->out_len = -1;
+        sent = 0;
+    }
+    if (c->out_len == -1)
+        return;
+
+    c->out_len -= sent;
+    memmove(c->out, c->out + sent, c->out_len);
+    reactor_mod(reactor, &c->handler,
+            EPOLLIN | EPOLLRDHUP | (c->out_len > 0 ? EPOLLOUT : 0));
 }
 
-int recv_message(int clnt_sock, char* message) {
+/* 반환값: 수신한 바이트 수, 0이면 연결 종료, -1이면 아직 읽을 데이터 없음 */
+int recv_message(Connection* c) {
     int msg_size;
-    msg_size = recv(clnt_sock, message, MTUSIZE, 0);
-    message[msg_size] = 0;
+
+    msg_size = recv(c->handler.fd, c->message, MTUSIZE, 0);
+    if (msg_size == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return -1;
+        msg_size = 0;
+    }
+    c->message[msg_size] = 0;
 
     return msg_size;
 }
 
 void broadcast_message(char * message) {
-    int i;
-    for (i = 0; i < NUM_OF_CLI; i++)
-        if (tls[i] != NULL)
-            send_message(tls[i]->clientSock, message, strlen(message));
+    static TrafficLight** lights = NULL;
+    static int cap = 0;
+    int i, n;
+
+    pthread_mutex_lock(&conn_mutex);
+    n = registry_connected(&lights, &cap);
+    for (i = 0; i < n; i++)
+        send_message(lights[i]->clientSock, message, strlen(message));
+    pthread_mutex_unlock(&conn_mutex);
 }
 
-int recv_image(TrafficLight* tl, char* message) {
-    FILE *fp;
-    char cmd_line[BUFSIZE];
-    int recvsum = 0;
-    char filename[BUFSIZE];
-    int filesize = 0;
+/* 이미지 조각을 MTUSIZE 단위로 모은다. TCP가 조각을 나누어 보내도 NOK 없이 이어 받는다.
+ * 반환값: 1 이미지 완료, 0 수신 중, -1 오류 */
+int recv_image(Connection* c) {
+    int chunk_size = c->image_size - c->image_recv;
+    int msg_size;
 
-    // recv the file info
-    if (recv_message(tl->clientSock, message) == 0) //trans seq:3
-        return -1;
-    sscanf(message, "%s %d", cmd_line, &filesize);
-    if (strstr(cmd_line, "NOK")) {
-        printf("[%s] 이미지 전송 실패\n", tl->name);
+    if (chunk_size > MTUSIZE)
+        chunk_size = MTUSIZE;
+
+    // recv from client
+    msg_size = recv(c->handler.fd, c->frame->data + c->image_recv + c->chunk_recv,
+            chunk_size - c->chunk_recv, 0); //trans seq:5
+    if (msg_size == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
         return -1;
     }
+    if (msg_size == 0)
+        return -1;
 
-    // create a file
-    pthread_mutex_lock(&tl->mutex);
-    tl->name_subfix = time(NULL);
-    sprintf(filename, "%s/%s/%s%d.jpg", FILE_DIR, SERVER_ID, tl->name, tl->name_subfix);
-    if ((fp = fopen(filename, "wb")) == NULL) {
-        pthread_mutex_unlock(&tl->mutex);
-        printf("[%s] 파일 쓰기 실패\n", tl->name);
+    c->chunk_recv += msg_size;
+    if (c->chunk_recv < chunk_size)
+        return 0;
+
+    c->image_recv += chunk_size;
+    c->chunk_recv = 0;
+    conn_send(c, "OK", 2); //trans seq:6 OK
+    if (c->image_recv < c->image_size)
+        return 0;
+
+    c->state = CONN_IDLE;
+    if (publish_frame(c) == -1)
         return -1;
-    }
 
-    // send ok sign
-    send_message(tl->clientSock, "OK", 2); //trans seq:4
+    return 1;
+}
 
-    // recv the file fragments
-    while (recvsum < filesize) {
-        int msg_size = 0, recv_size = MTUSIZE;
-        int left_size = filesize - recvsum;
+/* v2 : 헤더를 받은 뒤 payload 전체를 한 번에 스트리밍으로 받는다.
+ * 반환값: 1 이미지 완료, 0 수신 중, -1 오류 또는 MSG_EXIT */
+int recv_frame_v2(Connection* c) {
+    int msg_size;
 
-        if (left_size < MTUSIZE)
-            recv_size = left_size;
+    if (c->state == CONN_V2_HEADER) {
+        // 헤더 뒤에 바로 붙어 오는 payload를 읽지 않도록 헤더 크기만큼만 읽는다
+        msg_size = recv(c->handler.fd, c->header + c->header_recv,
+                STLC_HEADER_SIZE - c->header_recv, 0);
+        if (msg_size == -1)
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        if (msg_size == 0)
+            return -1;
+
+        c->header_recv += msg_size;
+        if (c->header_recv < STLC_HEADER_SIZE)
+            return 0;
+        c->header_recv = 0;
+
+        if (unpack_frame_header(c->header, &c->header_info) == -1
+                || c->header_info.light_id != (uint32_t) c->tl->id) {
+            printf("[%s] 잘못된 v2 헤더\n", c->tl->tag);
+            return -1;
+        }
 
-        // recv from client
-        while (1) {
-            msg_size = recv_message(tl->clientSock, message); //trans seq:5
-            if (msg_size == 0) {
-                fclose(fp);
-                pthread_mutex_unlock(&tl->mutex);
+        switch (c->header_info.type) {
+            case MSG_FRAME:
+                if (c->header_info.payload_len == 0 || c->header_info.payload_len > MAX_IMAGE_SIZE) {
+                    printf("[%s] 이미지 크기 오류 (%u bytes)\n", c->tl->tag, c->header_info.payload_len);
+                    return -1;
+                }
+                c->frame = tbuf_write_begin(&c->tl->frames, c->header_info.payload_len);
+                c->image_size = c->header_info.payload_len;
+                c->image_recv = 0;
+                c->state = CONN_V2_PAYLOAD;
+                return 0;
+            case MSG_GET_LED:
+                return send_led_v2(c, c->header_info.seq);
+            default:
                 return -1;
-            }
-            if (msg_size == recv_size) {
-                send_message(tl->clientSock, "OK", 2); //trans seq:6 OK
-                break;
-            }
-            send_message(tl->clientSock, "NOK", 3); //trans seq:6 NOK
         }
+    }
 
-        // write to fp
-        msg_size = fwrite(message, 1, msg_size, fp);
+    msg_size = recv(c->handler.fd, c->frame->data + c->image_recv,
+            c->image_size - c->image_recv, 0);
+    if (msg_size == -1)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    if (msg_size == 0)
+        return -1;
 
-        recvsum += recv_size;
-    }
-    fclose(fp);
-    printf("[%s] %s.jpg 다운로드 완료 (%5d/%5d bytes)\n", tl->name, tl->name, recvsum, filesize);
-    pthread_mutex_unlock(&tl->mutex);
+    c->image_recv += msg_size;
+    if (c->image_recv < c->image_size)
+        return 0;
 
-    return 0;
+    c->state = CONN_V2_HEADER;
+    c->frame->seq = c->header_info.seq;
+    if (publish_frame(c) == -1)
+        return -1;
+    send_led_v2(c, c->header_info.seq);
+
+    return 1;
 }
 
-void error_handler(char * message) {
-    perror(message);
-    exit(0);
+/* v2 : 프레임 수신 확인 겸 LED 상태 전달 */
+int send_led_v2(Connection* c, uint32_t seq) {
+    unsigned char buf[STLC_HEADER_SIZE + NUM_OF_LED];
+    FrameHeader h;
+    int i;
+
+    h.magic = STLC_MAGIC;
+    h.version = STLC_VERSION;
+    h.type = MSG_LED;
+    h.light_id = c->tl->id;
+    h.seq = seq;
+    h.timestamp = (uint64_t) time(NULL) * 1000;
+    h.payload_len = NUM_OF_LED;
+    pack_frame_header(buf, &h);
+    for (i = 0; i < NUM_OF_LED; i++)
+        buf[STLC_HEADER_SIZE + i] = (unsigned char) c->tl->leds[i];
+
+    conn_send(c, (char*) buf, sizeof (buf));
+    return c->out_len == -1 ? -1 : 0;
 }
 
-/* HTTP using CURL */
-int upload_file(char* filename) {
-    CURL* curl;
-    CURLcode res;
-    struct curl_httppost* formpost = NULL;
-    struct curl_httppost* lastptr = NULL;
-    struct curl_slist* headerList = NULL;
-    static const char buf[] = "Expect:";
-    char url[BUFSIZE];
-    
-    curl_global_init(CURL_GLOBAL_ALL);
+/* 다 받은 writer 버퍼를 ready로 올린다. 분석 쓰레드를 기다리지 않으며, 디스크에는 쓰지 않고
+ * -archive 옵션이 있을 때만 보관 쓰레드가 비동기로 파일에 남긴다. */
+int publish_frame(Connection* c) {
+    char filename[BUFSIZE];
+    TrafficLight* tl = c->tl;
 
-    // post body
-    curl_formadd(&formpost, &lastptr,
-            CURLFORM_COPYNAME, "file",
-            CURLFORM_FILE, filename,
-            CURLFORM_END);
-    
-    if (!(curl = curl_easy_init()))
-        return -1;
+    c->frame->size = c->image_size;
+    c->frame->timestamp = time(NULL);
+
+    if (archiver_enabled() && snprintf(filename, sizeof (filename), "%s/%s/%s%d.jpg", FILE_DIR, tl->intersection->id,
+            tl->name, (int) c->frame->timestamp) < (int) sizeof (filename))
+        archive_frame(filename, c->frame);
+
+    printf("[%s] %s.jpg 다운로드 완료 (%5d/%5d bytes)\n", tl->tag, tl->name, c->image_recv, c->image_size);
+    tbuf_publish(&tl->frames);
+    c->frame = NULL;
 
-    // add header
-    headerList = curl_slist_append(headerList, buf);
-    
-    // setopt
-    sprintf(url, "%s/%s", WEB_URL, SERVER_ID);
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList);
-    curl_easy_setopt(curl, CURLOPT_HTTPPOST, formpost);
-    
-    res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        fprintf(stderr, "[DETECTOR] 파일 업로드 실패 (%s)\n", curl_easy_strerror(res));
-        return -1;
-    }
-    curl_easy_cleanup(curl);
-    curl_formfree(formpost);
-    curl_slist_free_all(headerList);
-    
     return 0;
-}
\ No newline at end of file
+}
+
+void error_handler(char * message) {
+    perror(message);
+    exit(0);
+}
@@ -2,11 +2,20 @@
 #define SERVER_H
 
 #include <pthread.h>
+#include <netinet/in.h>
 #include "traffic.h"
+#include "reactor.h"
+#include "protocol.h"
+#include "frame_pool.h"
+#include "triple_buffer.h"
+#include "preprocess.h"
 
 #define BUFSIZE 513 //메세지 버퍼크기
 #define MTUSIZE 512 //메세지 전송단위
-#define NUM_OF_CLI 4
+#define NUM_OF_CLI 4 //교차로 하나의 신호등 수, 한 번에 분석하는 최대 배치
+#define INTERSECTION_ID_SIZE 64
+#define NUM_OF_IO_THREADS 2 //epoll I/O 쓰레드 수
+#define MAX_IMAGE_SIZE (4 * 1024 * 1024) //수신 가능한 최대 이미지 크기
 #define PORT "50000"
 #define WEB_URL "http://13.209.193.98:8080/STLC/upload"
 //#define WEB_URL "http://localhost:8080/STLC/upload"
@@ -14,31 +23,73 @@
 #define STREAM_FPS 1
 
 /* TRAFFIC LIGHT */
+struct __Intersection;
+
 typedef struct __TrafficLight {
+    int id;                 // 프로세스 안에서 유일 (v2 light_id)
     int clientSock;
-    char name[BUFSIZE];
+    int connected;
+    char name[BUFSIZE];     // 방향 이름 (east, west, south, north)
+    char tag[INTERSECTION_ID_SIZE + 16]; // "<교차로>/<방향>" (로그, 업로드 key)
+    struct __Intersection* intersection;
+    int approach;           // EAST..NORTH
     time_t name_subfix;
     int front, back, side, accident;
     int leds[NUM_OF_LED];
-    pthread_mutex_t mutex;
+    TripleBuffer frames; // 받은 이미지 (writer: I/O 쓰레드, reader: 분석 쓰레드)
+    unsigned char thumb[THUMB_SIZE * THUMB_SIZE]; // 마지막으로 분석한 프레임의 밝기 thumbnail (분석 쓰레드)
+    int thumb_valid;
+    int skipped;            // 그 뒤로 변화가 없어 건너뛴 프레임 수
+    struct __LightRoi* roi; // 관심 영역 (roi.h, NULL이면 전체 화면). 다시 연결해도 유지
 } TrafficLight;
 
 void init_traffic_light(TrafficLight* tl, char* name);
-TrafficLight* createTrafficLight(char* name, int sock);
+/* 교차로 id와 방향으로 신호등을 찾아 (교차로가 없으면 만든다) 연결 상태로 만든다. conn_mutex를 잡고 호출 */
+TrafficLight* createTrafficLight(char* intersection, char* name, int sock);
 void destroyTrafficLight(TrafficLight* tl);
 int getBit(int bit, int bit_id);
 
+/* CONNECTION */
+typedef enum {
+    CONN_HELLO,     // 신호등 이름 수신 대기
+    CONN_IDLE,      // 명령 대기 (/send_image, /get_led, /exit)
+    CONN_IMG_INFO,  // "OK <filesize>" 수신 대기
+    CONN_IMG_DATA,  // 이미지 조각 수신 중
+    CONN_V2_HEADER, // v2 : 메세지 헤더 수신 중
+    CONN_V2_PAYLOAD // v2 : 이미지 payload 수신 중
+} ConnState;
+
+typedef struct __Connection {
+    ReactorHandler handler; // 반드시 첫 멤버
+    ConnState state;
+    int proto; // 1: 기존 stop-and-wait, 2: STLC v2
+    TrafficLight* tl;
+    char addr[INET_ADDRSTRLEN];
+    char message[BUFSIZE];
+    FrameBuf* frame; // 수신 중인 이미지 (tl->frames의 writer 버퍼)
+    int image_size;
+    int image_recv;
+    int chunk_recv;
+    unsigned char header[STLC_HEADER_SIZE];
+    int header_recv;
+    FrameHeader header_info;
+    char out[BUFSIZE];
+    int out_len;
+} Connection;
+
 /* SOCKET */
-void run_server(char* port);
+void run_server(char* port, int io_threads, char* intersection_file, char* roi_file);
 void* listen_clnt(void *arg);
-void* clnt_connection(void * arg);
+void clnt_connection(ReactorHandler* h, unsigned int events);
+void close_connection(Connection* c);
 void send_message(int clnt_sock, char * message, int msg_size);
-int recv_message(int clnt_sock, char* message);
+void conn_send(Connection* c, char* message, int msg_size);
+int recv_message(Connection* c);
 void broadcast_message(char* message);
-int recv_image(TrafficLight* tl, char* message);
+int recv_image(Connection* c);
+int recv_frame_v2(Connection* c);
+int send_led_v2(Connection* c, uint32_t seq);
+int publish_frame(Connection* c);
 void error_handler(char * message);
 
-/* HTTP using CURL */
-int upload_file(char* filename);
-
 #endif /* SERVER_H */
@@ -0,0 +1,88 @@
+#include "status.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+void status_snapshot(StatusSnapshot* s, Intersection* x, int remain_time, int total_time) {
+    struct timeval tv;
+    int i, j;
+
+    gettimeofday(&tv, NULL);
+    memset(s, 0, sizeof (StatusSnapshot));
+    s->version = STATUS_VERSION;
+    strcpy(s->intersection, x->id);
+    s->seq = ++x->status_seq;
+    s->time_ms = (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    s->remain_time = remain_time;
+    s->total_time = total_time;
+
+    for (i = 0; i < NUM_OF_APPROACH; i++) {
+        TrafficLight* tl = &x->lights[i];
+        LightStatus* ls;
+
+        if (!tl->connected)
+            continue;
+        ls = &s->lights[s->num_lights++];
+
+        ls->id = tl->id;
+        strcpy(ls->name, tl->name);
+        ls->frame_time = tl->name_subfix;
+        ls->front = tl->front;
+        ls->back = tl->back;
+        ls->side = tl->side;
+        ls->accident = tl->accident;
+        for (j = 0; j < NUM_OF_LED; j++)
+            ls->leds[j] = tl->leds[j];
+        ls->received = tl->frames.published;
+        ls->dropped = tl->frames.dropped;
+        if (ls->accident)
+            s->accident = 1;
+    }
+}
+
+// 신호등 이름은 PI가 보내온 문자열이므로 따옴표와 제어문자는 JSON에 맞게 바꾼다
+static int json_string(char* buf, int size, const char* str) {
+    int len = 0;
+
+    if (len < size)
+        buf[len++] = '"';
+    for (; *str && len < size - 7; str++) {
+        if (*str == '"' || *str == '\\')
+            len += sprintf(buf + len, "\\%c", *str);
+        else if ((unsigned char) *str < 0x20)
+            len += sprintf(buf + len, "\\u%04x", *str);
+        else
+            buf[len++] = *str;
+    }
+    if (len < size)
+        buf[len++] = '"';
+    return len;
+}
+
+int status_to_json(const StatusSnapshot* s, char* buf, int size) {
+    int i, len;
+
+    len = snprintf(buf, size, "{\"v\":%d,\"seq\":%u,\"server\":", s->version, s->seq);
+    len += json_string(buf + len, size - len, s->intersection);
+    len += snprintf(buf + len, size - len,
+            ",\"time\":%llu,\"accident\":%d,\"remain\":%d,\"total\":%d,\"lights\":[",
+            (unsigned long long) s->time_ms, s->accident, s->remain_time, s->total_time);
+
+    for (i = 0; i < s->num_lights && len < size; i++) {
+        const LightStatus* ls = &s->lights[i];
+
+        len += snprintf(buf + len, size - len, "%s{\"id\":%d,\"name\":", i ? "," : "", ls->id);
+        if (len >= size)
+            break;
+        len += json_string(buf + len, size - len, ls->name);
+        len += snprintf(buf + len, size - len,
+                ",\"frame\":%ld,\"front\":%d,\"back\":%d,\"side\":%d,\"accident\":%d,"
+                "\"leds\":[%d,%d,%d,%d],\"received\":%u,\"dropped\":%u}",
+                (long) ls->frame_time, ls->front, ls->back, ls->side, ls->accident,
+                ls->leds[0], ls->leds[1], ls->leds[2], ls->leds[3],
+                ls->received, ls->dropped);
+    }
+    if (len < size)
+        len += snprintf(buf + len, size - len, "]}");
+    return len < size ? len : -1;
+}
@@ -0,0 +1,40 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdint.h>
+#include "registry.h"
+
+#define STATUS_VERSION 1
+#define STATUS_JSON_SIZE 4096
+
+/* 한 주기의 교차로 상태 스냅샷
+ * 분석 결과와 신호 상태를 한 번에 복사해 두고, 웹 서버에는 JSON 메세지 하나로 올린다.
+ * 필드를 바꾸면 STATUS_VERSION을 올린다. */
+typedef struct __LightStatus {
+    int id;
+    char name[BUFSIZE];
+    time_t frame_time;      // 분석한 프레임의 수신 시각 (name_subfix)
+    int front, back, side;
+    int accident;
+    int leds[NUM_OF_LED];
+    unsigned int received;  // 받은 프레임 수
+    unsigned int dropped;   // 분석 전에 덮어쓴 프레임 수
+} LightStatus;
+
+typedef struct __StatusSnapshot {
+    int version;
+    char intersection[INTERSECTION_ID_SIZE]; // JSON의 "server"
+    unsigned int seq;       // 교차로별
+    uint64_t time_ms;
+    int accident;           // 하나라도 사고면 1
+    int remain_time, total_time;
+    int num_lights;
+    LightStatus lights[NUM_OF_APPROACH];
+} StatusSnapshot;
+
+/* 교차로의 연결된 신호등들의 현재 값을 복사한다 (conn_mutex를 잡고 호출) */
+void status_snapshot(StatusSnapshot* s, Intersection* x, int remain_time, int total_time);
+/* 공백 없는 JSON으로 직렬화. 반환값: 길이, 버퍼가 모자라면 -1 */
+int status_to_json(const StatusSnapshot* s, char* buf, int size);
+
+#endif /* STATUS_H */
@@ -0,0 +1,184 @@
+#include "thread_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    ThreadPool* pool;
+    int id;
+} WorkerArg;
+
+// 작업 안에서 다시 thread_pool_run을 부르면 (run_mutex에 막히지 않게) 그 자리에서 순서대로 실행
+static __thread int inside_task = 0;
+
+static void run_tasks(ThreadPool* p, int id) {
+    int task;
+
+    inside_task = 1;
+    while ((task = __sync_fetch_and_add(&p->next_task, 1)) < p->num_tasks)
+        p->func(p->arg, task, id);
+    inside_task = 0;
+}
+
+static void* worker_loop(void* arg) {
+    WorkerArg* w = (WorkerArg*) arg;
+    ThreadPool* p = w->pool;
+    int id = w->id;
+    int seen = 0;
+
+    free(w);
+    pthread_mutex_lock(&p->mutex);
+    while (1) {
+        while (p->generation == seen)
+            pthread_cond_wait(&p->start, &p->mutex);
+        seen = p->generation;
+        if (p->stop)
+            break;
+        pthread_mutex_unlock(&p->mutex);
+
+        run_tasks(p, id);
+
+        pthread_mutex_lock(&p->mutex);
+        if (--p->active == 0)
+            pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->mutex);
+    return 0;
+}
+
+int num_cpu_cores() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+}
+
+ThreadPool* thread_pool_create(int num_threads) {
+    ThreadPool* p = calloc(1, sizeof (ThreadPool));
+    int i;
+
+    if (num_threads <= 0)
+        num_threads = num_cpu_cores();
+    p->num_threads = num_threads;
+    p->threads = calloc(num_threads, sizeof (pthread_t));
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_mutex_init(&p->run_mutex, NULL);
+    pthread_cond_init(&p->start, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    // 0번은 호출 쓰레드
+    for (i = 1; i < num_threads; i++) {
+        WorkerArg* w = malloc(sizeof (WorkerArg));
+        w->pool = p;
+        w->id = i;
+        if (pthread_create(&p->threads[i], NULL, worker_loop, w)) {
+            fprintf(stderr, "thread pool: pthread_create failed\n");
+            free(w);
+            p->num_threads = i;
+            break;
+        }
+    }
+    return p;
+}
+
+void thread_pool_free(ThreadPool* p) {
+    int i;
+
+    if (p == NULL)
+        return;
+    pthread_mutex_lock(&p->mutex);
+    p->stop = 1;
+    p->generation++;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->mutex);
+    for (i = 1; i < p->num_threads; i++)
+        pthread_join(p->threads[i], NULL);
+    pthread_mutex_destroy(&p->mutex);
+    pthread_mutex_destroy(&p->run_mutex);
+    pthread_cond_destroy(&p->start);
+    pthread_cond_destroy(&p->done);
+    free(p->threads);
+    free(p);
+}
+
+void thread_pool_run(ThreadPool* p, pool_func func, void* arg, int num_tasks) {
+    int i;
+
+    if (p == NULL || p->num_threads == 1 || num_tasks == 1 || inside_task) {
+        for (i = 0; i < num_tasks; i++)
+            func(arg, i, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&p->run_mutex);
+    pthread_mutex_lock(&p->mutex);
+    p->func = func;
+    p->arg = arg;
+    p->num_tasks = num_tasks;
+    p->next_task = 0;
+    p->active = p->num_threads - 1;
+    p->generation++;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->mutex);
+
+    run_tasks(p, 0);
+
+    pthread_mutex_lock(&p->mutex);
+    while (p->active > 0)
+        pthread_cond_wait(&p->done, &p->mutex);
+    pthread_mutex_unlock(&p->mutex);
+    pthread_mutex_unlock(&p->run_mutex);
+}
+
+int thread_pool_size(ThreadPool* p) {
+    return p ? p->num_threads : 1;
+}
+
+static __thread ThreadPool* current_pool = NULL;
+
+ThreadPool* thread_pool_set_current(ThreadPool* p) {
+    ThreadPool* prev = current_pool;
+
+    current_pool = p;
+    return prev;
+}
+
+ThreadPool* thread_pool_current() {
+    return current_pool;
+}
+
+typedef struct {
+    range_func func;
+    void* arg;
+    int n;
+    int tasks;
+} RangeJob;
+
+static void range_task(void* arg, int task, int thread) {
+    RangeJob* r = (RangeJob*) arg;
+    int begin = (int) ((long long) r->n * task / r->tasks);
+    int end = (int) ((long long) r->n * (task + 1) / r->tasks);
+
+    if (begin < end)
+        r->func(r->arg, begin, end);
+}
+
+void parallel_for(int n, int grain, range_func func, void* arg) {
+    ThreadPool* p = current_pool;
+    int threads = thread_pool_size(p);
+    RangeJob r;
+
+    if (grain < 1)
+        grain = 1;
+    // 쓰레드당 몇 조각씩 나눠서 늦게 끝나는 쓰레드가 나머지를 기다리게 하지 않는다
+    r.tasks = threads * 4;
+    if (r.tasks > n / grain)
+        r.tasks = n / grain;
+    if (threads == 1 || r.tasks <= 1) {
+        if (n > 0)
+            func(arg, 0, n);
+        return;
+    }
+    r.func = func;
+    r.arg = arg;
+    r.n = n;
+    thread_pool_run(p, range_task, &r, r.tasks);
+}
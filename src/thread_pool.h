@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+
+/* 고정 크기 작업자 쓰레드 풀 (CPU 커널 병렬화용)
+ * thread_pool_run은 task 0..num_tasks-1을 작업자와 호출 쓰레드가 나누어 실행하고,
+ * 모두 끝나면 돌아온다. 쓰레드는 한 번 만들어 두고 계속 재사용한다. */
+typedef void (*pool_func)(void* arg, int task, int thread);
+
+typedef struct __ThreadPool {
+    int num_threads;        // 호출 쓰레드 포함
+    pthread_t* threads;
+    pthread_mutex_t mutex;
+    pthread_mutex_t run_mutex; // thread_pool_run을 한 번에 하나만
+    pthread_cond_t start;
+    pthread_cond_t done;
+    pool_func func;
+    void* arg;
+    int num_tasks;
+    int next_task;
+    int generation;
+    int active;
+    int stop;
+} ThreadPool;
+
+/* parallel_for의 작업 함수: [begin, end) 구간을 처리 */
+typedef void (*range_func)(void* arg, int begin, int end);
+
+/* num_threads <= 0 이면 CPU 코어 수 */
+ThreadPool* thread_pool_create(int num_threads);
+void thread_pool_run(ThreadPool* p, pool_func func, void* arg, int num_tasks);
+int thread_pool_size(ThreadPool* p);
+/* 작업자 쓰레드를 끝내고 해제 (실행 중인 thread_pool_run이 없을 때) */
+void thread_pool_free(ThreadPool* p);
+int num_cpu_cores();
+
+/* 호출 쓰레드의 현재 풀. forward_network가 네트워크의 풀로 바꿔 두고 CPU 커널들은 이 풀을 쓴다.
+ * 이전 풀을 반환한다 */
+ThreadPool* thread_pool_set_current(ThreadPool* p);
+ThreadPool* thread_pool_current();
+
+/* [0, n)을 grain 이상인 구간들로 나눠 현재 풀에서 func를 실행한다.
+ * 현재 풀이 없거나 (작업자 쓰레드 안 포함) n이 작으면 호출 쓰레드에서 func(arg, 0, n) 한 번 */
+void parallel_for(int n, int grain, range_func func, void* arg);
+
+/* 쓰레드 하나에 넘길 최소 작업량 (원소 수). 이보다 작으면 깨우는 비용이 더 크다 */
+#define PARALLEL_MIN_WORK 16384
+/* 단위 하나가 원소 size개일 때 parallel_for의 grain */
+#define PARALLEL_GRAIN(size) (PARALLEL_MIN_WORK / ((size) > 0 ? (size) : 1) + 1)
+
+#endif /* THREAD_POOL_H */
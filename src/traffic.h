@@ -5,4 +5,10 @@
 
 enum { EAST, WEST, SOUTH, NORTH };
 
+struct __TrafficLight;
+void green_light(struct __TrafficLight* tls);
+void orange_light(struct __TrafficLight* tls);
+void red_light(struct __TrafficLight* tls);
+void green_left_light(struct __TrafficLight* tls);
+
 #endif /* TRAFFICCONTROLLER_H */
@@ -0,0 +1,91 @@
+#include "triple_buffer.h"
+#include <errno.h>
+#include <time.h>
+#include <semaphore.h>
+
+// 새 프레임 알림. sem_post는 락을 잡지 않으므로 I/O 쓰레드가 막히지 않는다
+static sem_t frame_ready;
+
+void tbuf_init(TripleBuffer* tb) {
+    int i;
+
+    for (i = 0; i < 3; i++)
+        tb->bufs[i] = NULL;
+    tb->writer = 0;
+    tb->ready = 1;
+    tb->reader = 2;
+    tb->published = 0;
+    tb->dropped = 0;
+}
+
+FrameBuf* tbuf_write_begin(TripleBuffer* tb, int size) {
+    FrameBuf* f = tb->bufs[tb->writer];
+
+    if (f == NULL || f->cap < size || __atomic_load_n(&f->refcount, __ATOMIC_ACQUIRE) > 1) {
+        frame_release(f);
+        f = frame_pool_get(size);
+        tb->bufs[tb->writer] = f;
+    }
+    f->size = 0;
+    return f;
+}
+
+void tbuf_publish(TripleBuffer* tb) {
+    int old = __atomic_exchange_n(&tb->ready, tb->writer | TBUF_FRESH, __ATOMIC_ACQ_REL);
+
+    // 분석 쓰레드가 가져가기 전에 최신 프레임으로 대체됨
+    if (old & TBUF_FRESH)
+        __sync_fetch_and_add(&tb->dropped, 1);
+    __sync_fetch_and_add(&tb->published, 1);
+    tb->writer = old & TBUF_INDEX;
+    sem_post(&frame_ready);
+}
+
+FrameBuf* tbuf_read(TripleBuffer* tb) {
+    int old;
+
+    if (!(__atomic_load_n(&tb->ready, __ATOMIC_ACQUIRE) & TBUF_FRESH))
+        return NULL;
+    old = __atomic_exchange_n(&tb->ready, tb->reader, __ATOMIC_ACQ_REL);
+    tb->reader = old & TBUF_INDEX;
+    return tb->bufs[tb->reader];
+}
+
+void tbuf_clear(TripleBuffer* tb) {
+    __atomic_fetch_and(&tb->ready, TBUF_INDEX, __ATOMIC_ACQ_REL);
+}
+
+void tbuf_wait_init() {
+    sem_init(&frame_ready, 0, 0);
+}
+
+int tbuf_wait(double timeout) {
+    struct timespec ts;
+    int ret;
+
+    if (timeout < 0) {
+        while ((ret = sem_wait(&frame_ready)) == -1 && errno == EINTR)
+            ;
+    } else {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += (time_t) timeout;
+        ts.tv_nsec += (long) ((timeout - (time_t) timeout) * 1e9);
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        while ((ret = sem_timedwait(&frame_ready, &ts)) == -1 && errno == EINTR)
+            ;
+    }
+    if (ret == -1)
+        return 0;
+
+    // 한 번에 여러 프레임이 쌓였어도 분석은 한 번이면 된다
+    while (sem_trywait(&frame_ready) == 0)
+        ;
+    return 1;
+}
+
+void tbuf_wake() {
+    sem_post(&frame_ready);
+}
@@ -0,0 +1,42 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include "frame_pool.h"
+
+#define TBUF_INDEX 3
+#define TBUF_FRESH 4 // ready 슬롯에 아직 읽지 않은 프레임이 있음
+
+/* 신호등별 triple buffer (writer / ready / reader)
+ * I/O 쓰레드는 writer 버퍼에 바로 받은 뒤 ready와 index를 원자적으로 맞바꾸고,
+ * 분석 쓰레드는 새 프레임이 있을 때만 reader와 ready를 맞바꾼다.
+ * 양쪽 모두 락 없이 동작하고 버퍼는 재사용된다. 분석 전에 덮어쓴 프레임은 dropped로 센다.
+ * writer는 연결 하나, reader는 분석 쓰레드 하나만 사용해야 한다. */
+typedef struct __TripleBuffer {
+    FrameBuf* bufs[3];
+    int writer;  // I/O 쓰레드 전용
+    int reader;  // 분석 쓰레드 전용
+    int ready;   // index | TBUF_FRESH, 원자적으로 교환
+    unsigned int published;
+    unsigned int dropped;
+} TripleBuffer;
+
+void tbuf_init(TripleBuffer* tb);
+
+/* writer : size 바이트를 받을 버퍼. 다른 곳(archiver)이 아직 참조 중이면 새 버퍼로 바꾼다 */
+FrameBuf* tbuf_write_begin(TripleBuffer* tb, int size);
+/* writer : 다 받은 버퍼를 ready로 올린다 */
+void tbuf_publish(TripleBuffer* tb);
+
+/* reader : 새 프레임이 없으면 NULL. 반환된 버퍼는 다음 tbuf_read 전까지 유효하다 */
+FrameBuf* tbuf_read(TripleBuffer* tb);
+/* 읽지 않은 프레임을 버린다 (연결 종료 시) */
+void tbuf_clear(TripleBuffer* tb);
+
+/* 어느 버퍼에든 새 프레임이 올라오거나 (tbuf_wake 포함) timeout 초가 지날 때까지 대기. timeout < 0이면 계속 기다린다
+ * 반환값: 1 깨어남, 0 timeout */
+void tbuf_wait_init();
+int tbuf_wait(double timeout);
+/* 프레임 없이 대기를 깨운다 (모델 교체 등). signal handler에서 불러도 된다 */
+void tbuf_wake();
+
+#endif /* TRIPLE_BUFFER_H */
@@ -9,6 +9,8 @@
 #include "unistd.h"
 #else
 #include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 #endif
 #include "utils.h"
 
@@ -472,6 +474,18 @@ float dist_array(float *a, float *b, int n, int sub)
     return sqrt(sum);
 }
 
+float max_rel_diff(float *x, float *y, int size)
+{
+    int i;
+    float max_val = 0, max_diff = 0;
+    for(i = 0; i < size; ++i){
+        float d = fabsf(x[i] - y[i]);
+        if(fabsf(x[i]) > max_val) max_val = fabsf(x[i]);
+        if(d > max_diff) max_diff = d;
+    }
+    return max_val > 0 ? max_diff / max_val : max_diff;
+}
+
 float mse_array(float *a, int n)
 {
     int i;
@@ -685,3 +699,55 @@ int kbhit(void) {
 
     return 0;
 }
+
+/* 벤치마크용 wall-clock 시간 (초). clock()은 모든 쓰레드의 CPU 시간을 더하므로 쓰지 않는다 */
+double what_time_is_it_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec*1e-9;
+}
+
+/* 런타임 CPU 기능 확인 (SIMD 커널 선택용) */
+int cpu_supports_avx2()
+{
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    return 0;
+#endif
+}
+
+int run_in_child(void (*fn)(void *arg, double *result), void *arg, double *result, int n, double *peak_rss)
+{
+    double *buf = calloc(n + 1, sizeof(double));
+    size_t size = (n + 1)*sizeof(double);
+    int fd[2], status, ok;
+    pid_t pid;
+
+    if(pipe(fd) < 0) error("pipe");
+    fflush(stdout);
+    pid = fork();
+    if(pid < 0) error("fork");
+    if(pid == 0){
+        struct rusage usage;
+        close(fd[0]);
+        if(!freopen("/dev/null", "w", stderr)) {}
+        if(!freopen("/dev/null", "w", stdout)) {}
+        fn(arg, buf);
+        getrusage(RUSAGE_SELF, &usage);
+        buf[n] = usage.ru_maxrss*1024.;
+        if(write(fd[1], buf, size) != (ssize_t)size) _exit(1);
+        _exit(0);
+    }
+    close(fd[1]);
+    ok = read(fd[0], buf, size) == (ssize_t)size;
+    close(fd[0]);
+    waitpid(pid, &status, 0);
+    if(ok){
+        memcpy(result, buf, n*sizeof(double));
+        if(peak_rss) *peak_rss = buf[n];
+    }
+    free(buf);
+    return ok;
+}
@@ -57,6 +57,8 @@ void mean_arrays(float **a, int n, int els, float *avg);
 float variance_array(float *a, int n);
 float mag_array(float *a, int n);
 float dist_array(float *a, float *b, int n, int sub);
+/* max|x - y| / max|x| (x가 기준, 모두 0이면 max|x - y|). 벤치마크의 결과 비교용 */
+float max_rel_diff(float *x, float *y, int size);
 float **one_hot_encode(float *a, int n, int k);
 float sec(clock_t clocks);
 int find_int_arg(int argc, char **argv, char *arg, int def);
@@ -69,6 +71,12 @@ unsigned int random_gen();
 float random_float();
 float rand_uniform_strong(float min, float max);
 int kbhit(void);
+double what_time_is_it_now();
+int cpu_supports_avx2();
+/* fn(arg, result)를 자식 프로세스에서 돌리고 result[n]과 자식의 peak RSS (bytes)를 받는다.
+ * peak RSS는 한 프로세스에서 줄지 않으므로 측정마다 새 프로세스를 쓴다 (bench_memory, bench_startup).
+ * 자식의 stdout, stderr는 버린다. fn은 실패하면 _exit(1). 반환값: 결과를 받으면 1, 실패하면 0 */
+int run_in_child(void (*fn)(void *arg, double *result), void *arg, double *result, int n, double *peak_rss);
 
 #endif
 
@@ -0,0 +1,241 @@
+#include "winograd.h"
+#include "gemm.h"
+#include "thread_pool.h"
+#include <string.h>
+
+/*
+ * F(2x2,3x3) 변환 행렬
+ *   B^T = | 1  0 -1  0 |   G = | 1    0    0  |   A^T = | 1  1  1  0 |
+ *         | 0  1  1  0 |       | 1/2  1/2  1/2|         | 0  1 -1 -1 |
+ *         | 0 -1  1  0 |       | 1/2 -1/2  1/2|
+ *         | 0  1  0 -1 |       | 0    0    1  |
+ *   Y = A^T [ (G g G^T) .* (B^T d B) ] A
+ */
+
+// 타일 위치 16개의 블록 간격이 4KB 배수가 되면 16개 스트림이 같은 캐시 세트에 몰리므로 조금 띄운다
+#define WINOGRAD_SKEW 16
+
+static int tiles(int out)
+{
+    return (out + 1) / 2;
+}
+
+size_t winograd_weights_size(int n, int c)
+{
+    return (size_t)WINOGRAD_TILE*n*c;
+}
+
+size_t winograd_workspace_size(int h, int w, int c, int n, int pad)
+{
+    size_t t = (size_t)tiles(h + 2*pad - 2) * tiles(w + 2*pad - 2);
+    // V [16][c][t] + M [16][n][t] (+ 블록 간격)
+    return (WINOGRAD_TILE*(t*(c + n) + 2*WINOGRAD_SKEW))*sizeof(float);
+}
+
+void winograd_transform_weights(float *weights, int n, int c, float *out)
+{
+    int i, j, k;
+    size_t stride = (size_t)n*c;
+    for(i = 0; i < n; ++i){
+        for(j = 0; j < c; ++j){
+            float *g = weights + ((size_t)i*c + j)*9;
+            float *u = out + (size_t)i*c + j;
+            float t[12];
+            // G g (4x3)
+            for(k = 0; k < 3; ++k){
+                t[k]   = g[k];
+                t[3+k] = .5f*(g[k] + g[3+k] + g[6+k]);
+                t[6+k] = .5f*(g[k] - g[3+k] + g[6+k]);
+                t[9+k] = g[6+k];
+            }
+            // (G g) G^T (4x4)
+            for(k = 0; k < 4; ++k){
+                float *r = t + k*3;
+                u[(k*4 + 0)*stride] = r[0];
+                u[(k*4 + 1)*stride] = .5f*(r[0] + r[1] + r[2]);
+                u[(k*4 + 2)*stride] = .5f*(r[0] - r[1] + r[2]);
+                u[(k*4 + 3)*stride] = r[2];
+            }
+        }
+    }
+}
+
+/* 4x4 입력 타일 d를 B^T d B로 변환 */
+static inline void transform_tile(const float *d, float *v, size_t stride, int t)
+{
+    int i, j;
+    float r[16];
+    // B^T d
+    for(j = 0; j < 4; ++j){
+        r[0*4+j] = d[0*4+j] - d[2*4+j];
+        r[1*4+j] = d[1*4+j] + d[2*4+j];
+        r[2*4+j] = d[2*4+j] - d[1*4+j];
+        r[3*4+j] = d[1*4+j] - d[3*4+j];
+    }
+    // (B^T d) B
+    for(i = 0; i < 4; ++i){
+        float *s = r + i*4;
+        v[(i*4 + 0)*stride + t] = s[0] - s[2];
+        v[(i*4 + 1)*stride + t] = s[1] + s[2];
+        v[(i*4 + 2)*stride + t] = s[2] - s[1];
+        v[(i*4 + 3)*stride + t] = s[1] - s[3];
+    }
+}
+
+/* 채널 하나의 모든 4x4 입력 타일을 변환해 v[16][..][t]에 (stride 간격으로) 넣는다 */
+static void transform_input(float *im, int h, int w, int pad, int tiles_h, int tiles_w,
+        float *v, size_t stride)
+{
+    int ty, tx, i, j;
+    float d[16];
+    // 경계 검사가 필요 없는 타일 범위 (가로)
+    int tx_lo = (pad + 1) / 2;
+    int tx_hi = (w + pad - 4) / 2 + 1;
+    if(tx_hi > tiles_w) tx_hi = tiles_w;
+    if(tx_hi < tx_lo) tx_hi = tx_lo;
+
+    for(ty = 0; ty < tiles_h; ++ty){
+        int y0 = ty*2 - pad;
+        int interior = y0 >= 0 && y0 + 4 <= h;
+        for(tx = 0; tx < tiles_w; ++tx){
+            int x0 = tx*2 - pad;
+            if(interior && tx == tx_lo){
+                // 안쪽 타일은 행 4개를 바로 읽는다 (타일 방향으로 벡터화됨)
+                float *r0 = im + y0*w - pad, *r1 = r0 + w, *r2 = r1 + w, *r3 = r2 + w;
+                float *out = v + ty*tiles_w;
+                for(; tx < tx_hi; ++tx){
+                    int x = tx*2;
+                    float a0 = r0[x] - r2[x], a1 = r0[x+1] - r2[x+1], a2 = r0[x+2] - r2[x+2], a3 = r0[x+3] - r2[x+3];
+                    float b0 = r1[x] + r2[x], b1 = r1[x+1] + r2[x+1], b2 = r1[x+2] + r2[x+2], b3 = r1[x+3] + r2[x+3];
+                    float c0 = r2[x] - r1[x], c1 = r2[x+1] - r1[x+1], c2 = r2[x+2] - r1[x+2], c3 = r2[x+3] - r1[x+3];
+                    float e0 = r1[x] - r3[x], e1 = r1[x+1] - r3[x+1], e2 = r1[x+2] - r3[x+2], e3 = r1[x+3] - r3[x+3];
+                    out[ 0*stride + tx] = a0 - a2; out[ 1*stride + tx] = a1 + a2;
+                    out[ 2*stride + tx] = a2 - a1; out[ 3*stride + tx] = a1 - a3;
+                    out[ 4*stride + tx] = b0 - b2; out[ 5*stride + tx] = b1 + b2;
+                    out[ 6*stride + tx] = b2 - b1; out[ 7*stride + tx] = b1 - b3;
+                    out[ 8*stride + tx] = c0 - c2; out[ 9*stride + tx] = c1 + c2;
+                    out[10*stride + tx] = c2 - c1; out[11*stride + tx] = c1 - c3;
+                    out[12*stride + tx] = e0 - e2; out[13*stride + tx] = e1 + e2;
+                    out[14*stride + tx] = e2 - e1; out[15*stride + tx] = e1 - e3;
+                }
+                if(tx >= tiles_w) break;
+                x0 = tx*2 - pad;
+            }
+            // 경계 타일은 zero padding
+            for(i = 0; i < 4; ++i){
+                for(j = 0; j < 4; ++j){
+                    int y = y0 + i, x = x0 + j;
+                    d[i*4+j] = (y < 0 || x < 0 || y >= h || x >= w) ? 0 : im[y*w + x];
+                }
+            }
+            transform_tile(d, v, stride, ty*tiles_w + tx);
+        }
+    }
+}
+
+static inline float epilogue(float v, float bias, int leaky)
+{
+    v += bias;
+    return (leaky && v < 0) ? .1f*v : v;
+}
+
+/* 필터 하나의 m[16][..][t]를 A^T m A로 되돌려 2x2 출력 타일에 쓴다 */
+static void transform_output(float *m, size_t stride, int tiles_h, int tiles_w,
+        float *out, int out_h, int out_w, float bias, int leaky)
+{
+    int ty, tx;
+    // 오른쪽 끝 타일이 출력 밖으로 나가면 따로 처리
+    int full_w = out_w / 2;
+    for(ty = 0; ty < tiles_h; ++ty){
+        float *x = m + ty*tiles_w;
+        float *o0 = out + ty*2*out_w;
+        float *o1 = o0 + out_w;
+        int two_rows = ty*2 + 1 < out_h;
+        for(tx = 0; tx < tiles_w; ++tx){
+            // A^T x
+            float r0 = x[ 0*stride + tx] + x[ 4*stride + tx] + x[ 8*stride + tx];
+            float r1 = x[ 1*stride + tx] + x[ 5*stride + tx] + x[ 9*stride + tx];
+            float r2 = x[ 2*stride + tx] + x[ 6*stride + tx] + x[10*stride + tx];
+            float r3 = x[ 3*stride + tx] + x[ 7*stride + tx] + x[11*stride + tx];
+            float s0 = x[ 4*stride + tx] - x[ 8*stride + tx] - x[12*stride + tx];
+            float s1 = x[ 5*stride + tx] - x[ 9*stride + tx] - x[13*stride + tx];
+            float s2 = x[ 6*stride + tx] - x[10*stride + tx] - x[14*stride + tx];
+            float s3 = x[ 7*stride + tx] - x[11*stride + tx] - x[15*stride + tx];
+            // (A^T x) A
+            o0[tx*2] = epilogue(r0 + r1 + r2, bias, leaky);
+            if(tx < full_w) o0[tx*2 + 1] = epilogue(r1 - r2 - r3, bias, leaky);
+            if(two_rows){
+                o1[tx*2] = epilogue(s0 + s1 + s2, bias, leaky);
+                if(tx < full_w) o1[tx*2 + 1] = epilogue(s1 - s2 - s3, bias, leaky);
+            }
+        }
+    }
+}
+
+typedef struct {
+    float *input, *output, *v, *m;
+    int h, w, pad, out_h, out_w, tiles_h, tiles_w;
+    size_t v_stride, m_stride;
+    const float *biases;
+    ACTIVATION act;
+} WinogradJob;
+
+/* 입력 채널 [begin, end) */
+static void transform_input_range(void *arg, int begin, int end)
+{
+    WinogradJob *g = (WinogradJob*)arg;
+    int t = g->tiles_h*g->tiles_w;
+    int i;
+    for(i = begin; i < end; ++i){
+        transform_input(g->input + (size_t)i*g->h*g->w, g->h, g->w, g->pad, g->tiles_h, g->tiles_w,
+                g->v + (size_t)i*t, g->v_stride);
+    }
+}
+
+/* 필터 [begin, end) */
+static void transform_output_range(void *arg, int begin, int end)
+{
+    WinogradJob *g = (WinogradJob*)arg;
+    int t = g->tiles_h*g->tiles_w;
+    int i;
+    for(i = begin; i < end; ++i){
+        transform_output(g->m + (size_t)i*t, g->m_stride, g->tiles_h, g->tiles_w,
+                g->output + (size_t)i*g->out_h*g->out_w, g->out_h, g->out_w,
+                g->biases ? g->biases[i] : 0, g->act == LEAKY);
+    }
+}
+
+void winograd_convolve(float *input, int c, int h, int w, int pad,
+        float *transformed_weights, int n, float *output, float *workspace,
+        const float *biases, ACTIVATION act)
+{
+    int out_h = h + 2*pad - 2;
+    int out_w = w + 2*pad - 2;
+    int tiles_h = tiles(out_h);
+    int tiles_w = tiles(out_w);
+    int t = tiles_h*tiles_w;
+    size_t v_stride = (size_t)c*t + WINOGRAD_SKEW;
+    size_t m_stride = (size_t)n*t + WINOGRAD_SKEW;
+    float *v = workspace;
+    float *m = workspace + WINOGRAD_TILE*v_stride;
+    int i;
+    WinogradJob g;
+
+    g.input = input; g.output = output; g.v = v; g.m = m;
+    g.h = h; g.w = w; g.pad = pad; g.out_h = out_h; g.out_w = out_w;
+    g.tiles_h = tiles_h; g.tiles_w = tiles_w;
+    g.v_stride = v_stride; g.m_stride = m_stride;
+    g.biases = biases; g.act = act;
+
+    parallel_for(c, PARALLEL_GRAIN(WINOGRAD_TILE*t), transform_input_range, &g);
+
+    memset(m, 0, WINOGRAD_TILE*m_stride*sizeof(float));
+    for(i = 0; i < WINOGRAD_TILE; ++i){
+        gemm_nn_packed(n, t, c, 1,
+                transformed_weights + (size_t)i*n*c, c,
+                v + i*v_stride, t,
+                m + i*m_stride, t);
+    }
+
+    parallel_for(n, PARALLEL_GRAIN(WINOGRAD_TILE*t), transform_output_range, &g);
+}
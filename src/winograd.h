@@ -0,0 +1,29 @@
+#ifndef WINOGRAD_H
+#define WINOGRAD_H
+
+#include <stddef.h>
+#include "activations.h"
+
+/* Winograd F(2x2,3x3)
+ * 3x3 stride 1 conv를 4x4 입력 타일 -> 2x2 출력 타일 단위로 계산한다.
+ * 출력 하나당 곱셈이 9번에서 4번으로 줄고, im2col처럼 입력을 9배로 펼치지 않는다.
+ * 변환된 weight는 [16][n][c], 타일 16개 위치마다 (n x c) * (c x 타일 수) gemm 한 번 */
+
+#define WINOGRAD_TILE 16
+
+/* 변환된 weight 크기 (float 수) */
+size_t winograd_weights_size(int n, int c);
+/* winograd_convolve가 쓰는 workspace 크기 (byte) */
+size_t winograd_workspace_size(int h, int w, int c, int n, int pad);
+
+/* weights [n][c][3][3] -> out [16][n][c] */
+void winograd_transform_weights(float *weights, int n, int c, float *out);
+
+/* 이미지 한 장 (c x h x w)에 대해 output (n x out_h x out_w) = conv(input, weights)
+ * out_h = h + 2*pad - 2, out_w = w + 2*pad - 2
+ * biases가 있으면 출력 변환 단계에서 act(conv + bias)로 쓴다 (act는 LINEAR, LEAKY만) */
+void winograd_convolve(float *input, int c, int h, int w, int pad,
+        float *transformed_weights, int n, float *output, float *workspace,
+        const float *biases, ACTIVATION act);
+
+#endif
@@ -0,0 +1,347 @@
+#include "xnor_gemm.h"
+#include "gemm.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+/*
+ * popcount gemm은 MR x NR = 4 x 4 (출력 채널 4개 x 출력 위치 4개) 타일 단위로 계산한다.
+ * AVX2에는 popcount 명령이 없으므로 4bit 단위 표(pshufb)로 byte별 1의 수를 구해 byte 그대로 더하다가
+ * (byte 하나에 최대 8씩, 31번까지는 넘치지 않음) sad로 word별 합을 낸다.
+ * AVX2가 없으면 popcnt 명령, 그것도 없으면 __builtin_popcountll (C 구현).
+ */
+#define XNOR_MR 4
+#define XNOR_NR 4
+#define XNOR_BYTE_ITERS 31
+
+static int xnor_kernel = -1;    // 0: C, 1: popcnt, 2: AVX2
+
+int xnor_words(int c)
+{
+    return (c + 63) / 64;
+}
+
+size_t xnor_weights_size(int n, int c, int size)
+{
+    return (size_t)n*xnor_words(c)*size*size;
+}
+
+size_t xnor_workspace_size(int h, int w, int c, int size, int out_h, int out_w)
+{
+    int cw = xnor_words(c);
+    // pack한 입력 [cw][h][w] + im2col [cw*size*size][out_h*out_w]
+    return ((size_t)cw*h*w + (size_t)cw*size*size*out_h*out_w)*sizeof(uint64_t);
+}
+
+void xnor_pack_weights(const float *weights, int n, int c, int size, uint64_t *packed, float *alpha, int *tap_pop)
+{
+    int cw = xnor_words(c);
+    int taps = size*size;
+    int i, j, t;
+    memset(packed, 0, xnor_weights_size(n, c, size)*sizeof(uint64_t));
+    for(i = 0; i < n; ++i){
+        const float *wi = weights + (size_t)i*c*taps;
+        uint64_t *pi = packed + (size_t)i*cw*taps;
+        float mean = 0;
+        for(j = 0; j < c*taps; ++j) mean += fabsf(wi[j]);
+        alpha[i] = mean / (c*taps);
+        for(t = 0; t < taps; ++t) tap_pop[i*taps + t] = 0;
+        for(j = 0; j < c; ++j){
+            for(t = 0; t < taps; ++t){
+                if(wi[j*taps + t] > 0){
+                    pi[(j/64)*taps + t] |= (uint64_t)1 << (j%64);
+                    ++tap_pop[i*taps + t];
+                }
+            }
+        }
+    }
+}
+
+/* x [c][h*w] -> [cw][h*w], x > 0 이면 1 */
+static void xnor_pack_input(const float *x, int c, int spatial, uint64_t *packed)
+{
+    int ch, p;
+    memset(packed, 0, (size_t)xnor_words(c)*spatial*sizeof(uint64_t));
+    for(ch = 0; ch < c; ++ch){
+        const float *xc = x + (size_t)ch*spatial;
+        uint64_t *pc = packed + (size_t)(ch/64)*spatial;
+        int bit = ch%64;
+        for(p = 0; p < spatial; ++p){
+            pc[p] |= (uint64_t)(xc[p] > 0) << bit;
+        }
+    }
+}
+
+typedef struct {
+    const uint64_t *im;
+    uint64_t *col;
+    int h, w, size, stride, pad;
+} XnorIm2colJob;
+
+/* im2col_cpu의 word 버전 (결과 행 [begin, end)). 패딩 자리는 0 (weight bit 그대로 xor되므로 epilogue에서 빼 준다) */
+static void xnor_im2col_range(void *arg, int begin, int end)
+{
+    XnorIm2colJob *g = (XnorIm2colJob*)arg;
+    const uint64_t *im = g->im;
+    uint64_t *col = g->col;
+    int h = g->h, w = g->w, size = g->size, stride = g->stride, pad = g->pad;
+    int out_h = (h + 2*pad - size) / stride + 1;
+    int out_w = (w + 2*pad - size) / stride + 1;
+    int k, y, x;
+    for(k = begin; k < end; ++k){
+        int kx = k % size;
+        int ky = (k / size) % size;
+        int word = k / size / size;
+        const uint64_t *src = im + (size_t)word*h*w;
+        uint64_t *dst = col + (size_t)k*out_h*out_w;
+        for(y = 0; y < out_h; ++y){
+            int iy = y*stride + ky - pad;
+            if(iy < 0 || iy >= h){
+                memset(dst + y*out_w, 0, out_w*sizeof(uint64_t));
+                continue;
+            }
+            for(x = 0; x < out_w; ++x){
+                int ix = x*stride + kx - pad;
+                dst[y*out_w + x] = (ix < 0 || ix >= w) ? 0 : src[iy*w + ix];
+            }
+        }
+    }
+}
+
+static void xnor_im2col(const uint64_t *im, int cw, int h, int w, int size, int stride, int pad, uint64_t *col)
+{
+    XnorIm2colJob g;
+    int out_h = (h + 2*pad - size) / stride + 1;
+    int out_w = (w + 2*pad - size) / stride + 1;
+    g.im = im; g.col = col;
+    g.h = h; g.w = w; g.size = size; g.stride = stride; g.pad = pad;
+    parallel_for(cw*size*size, PARALLEL_GRAIN(out_h*out_w), xnor_im2col_range, &g);
+}
+
+static void kernel_xnor_c(int K, const uint64_t *a, int lda, const uint64_t *b, int ldb, int *c, int ldc, int mr, int nr)
+{
+    int i, j, k;
+    for(i = 0; i < mr; ++i){
+        for(j = 0; j < nr; ++j){
+            int sum = 0;
+            for(k = 0; k < K; ++k) sum += __builtin_popcountll(a[i*lda + k] ^ b[(size_t)k*ldb + j]);
+            c[i*ldc + j] = sum;
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+__attribute__((target("popcnt")))
+static void kernel_xnor_popcnt(int K, const uint64_t *a, int lda, const uint64_t *b, int ldb, int *c, int ldc, int mr, int nr)
+{
+    int i, j, k;
+    if(mr == XNOR_MR && nr == XNOR_NR){
+        int acc[XNOR_MR][XNOR_NR] = {{0}};
+        for(k = 0; k < K; ++k){
+            const uint64_t *bk = b + (size_t)k*ldb;
+            for(i = 0; i < XNOR_MR; ++i){
+                uint64_t ai = a[i*lda + k];
+                acc[i][0] += __builtin_popcountll(ai ^ bk[0]);
+                acc[i][1] += __builtin_popcountll(ai ^ bk[1]);
+                acc[i][2] += __builtin_popcountll(ai ^ bk[2]);
+                acc[i][3] += __builtin_popcountll(ai ^ bk[3]);
+            }
+        }
+        for(i = 0; i < XNOR_MR; ++i){
+            for(j = 0; j < XNOR_NR; ++j) c[i*ldc + j] = acc[i][j];
+        }
+        return;
+    }
+    for(i = 0; i < mr; ++i){
+        for(j = 0; j < nr; ++j){
+            int sum = 0;
+            for(k = 0; k < K; ++k) sum += __builtin_popcountll(a[i*lda + k] ^ b[(size_t)k*ldb + j]);
+            c[i*ldc + j] = sum;
+        }
+    }
+}
+
+/* word 4개 각각의 1 bit 수를 byte별로 (word 안의 byte 8개를 더하면 word의 popcount) */
+__attribute__((target("avx2")))
+static inline __m256i popcount_bytes_avx2(__m256i v, __m256i lut, __m256i low)
+{
+    __m256i lo = _mm256_and_si256(v, low);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+    return _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+}
+
+__attribute__((target("avx2")))
+static void kernel_xnor_avx2(int K, const uint64_t *a, int lda, const uint64_t *b, int ldb, int *c, int ldc)
+{
+    const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4, 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    // 64bit 합 4개 -> int 4개
+    const __m256i idx = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    __m256i s0 = zero, s1 = zero, s2 = zero, s3 = zero;
+    int k = 0;
+
+    while(k < K){
+        int end = (K - k < XNOR_BYTE_ITERS) ? K : k + XNOR_BYTE_ITERS;
+        __m256i c0 = zero, c1 = zero, c2 = zero, c3 = zero;
+        for(; k < end; ++k){
+            __m256i bk = _mm256_loadu_si256((const __m256i*)(b + (size_t)k*ldb));
+            c0 = _mm256_add_epi8(c0, popcount_bytes_avx2(_mm256_xor_si256(bk, _mm256_set1_epi64x(a[0*lda + k])), lut, low));
+            c1 = _mm256_add_epi8(c1, popcount_bytes_avx2(_mm256_xor_si256(bk, _mm256_set1_epi64x(a[1*lda + k])), lut, low));
+            c2 = _mm256_add_epi8(c2, popcount_bytes_avx2(_mm256_xor_si256(bk, _mm256_set1_epi64x(a[2*lda + k])), lut, low));
+            c3 = _mm256_add_epi8(c3, popcount_bytes_avx2(_mm256_xor_si256(bk, _mm256_set1_epi64x(a[3*lda + k])), lut, low));
+        }
+        s0 = _mm256_add_epi64(s0, _mm256_sad_epu8(c0, zero));
+        s1 = _mm256_add_epi64(s1, _mm256_sad_epu8(c1, zero));
+        s2 = _mm256_add_epi64(s2, _mm256_sad_epu8(c2, zero));
+        s3 = _mm256_add_epi64(s3, _mm256_sad_epu8(c3, zero));
+    }
+    _mm_storeu_si128((__m128i*)(c + 0*ldc), _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(s0, idx)));
+    _mm_storeu_si128((__m128i*)(c + 1*ldc), _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(s1, idx)));
+    _mm_storeu_si128((__m128i*)(c + 2*ldc), _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(s2, idx)));
+    _mm_storeu_si128((__m128i*)(c + 3*ldc), _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(s3, idx)));
+}
+#endif
+
+static void kernel_xnor(int K, const uint64_t *a, int lda, const uint64_t *b, int ldb, int *c, int ldc, int mr, int nr)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if(xnor_kernel == 2 && mr == XNOR_MR && nr == XNOR_NR){
+        kernel_xnor_avx2(K, a, lda, b, ldb, c, ldc);
+        return;
+    }
+    if(xnor_kernel >= 1){
+        kernel_xnor_popcnt(K, a, lda, b, ldb, c, ldc, mr, nr);
+        return;
+    }
+#endif
+    kernel_xnor_c(K, a, lda, b, ldb, c, ldc, mr, nr);
+}
+
+static int select_xnor_kernel()
+{
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    if(cpu_supports_avx2()) return 2;
+    if(__builtin_cpu_supports("popcnt")) return 1;
+#endif
+    return 0;
+}
+
+typedef struct {
+    int M, N, K;
+    const uint64_t *A;
+    const uint64_t *B; int ldb;
+    int *C; int ldc;
+    int per;
+} XnorJob;
+
+static void xnor_task(void *arg, int task, int thread)
+{
+    XnorJob *g = (XnorJob*)arg;
+    int j0 = task*g->per;
+    int j1 = (j0 + g->per < g->N) ? j0 + g->per : g->N;
+    int i, j;
+    for(j = j0; j < j1; j += XNOR_NR){
+        int nr = (j1 - j < XNOR_NR) ? j1 - j : XNOR_NR;
+        for(i = 0; i < g->M; i += XNOR_MR){
+            int mr = (g->M - i < XNOR_MR) ? g->M - i : XNOR_MR;
+            kernel_xnor(g->K, g->A + (size_t)i*g->K, g->K, g->B + j, g->ldb, g->C + (size_t)i*g->ldc + j, g->ldc, mr, nr);
+        }
+    }
+}
+
+void gemm_xnor(int M, int N, int K, const uint64_t *A, const uint64_t *B, int ldb, int *C, int ldc)
+{
+    XnorJob g;
+    ThreadPool *pool = gemm_thread_pool();
+    int threads = thread_pool_size(pool);
+    int tasks;
+
+    if(xnor_kernel < 0) xnor_kernel = select_xnor_kernel();
+    // word 하나가 곱셈 64번이므로 작은 레이어는 나누지 않는다
+    if(64.0*M*N*K < 2e7) threads = 1;
+
+    g.M = M; g.N = N; g.K = K;
+    g.A = A; g.B = B; g.ldb = ldb; g.C = C; g.ldc = ldc;
+    // 출력 위치를 NR 배수로 쓰레드 수의 두 배만큼 나눈다
+    tasks = threads*2;
+    g.per = ((N + tasks - 1) / tasks + XNOR_NR - 1) / XNOR_NR * XNOR_NR;
+    tasks = (N + g.per - 1) / g.per;
+    if(threads == 1 || tasks <= 1){
+        g.per = N;
+        xnor_task(&g, 0, 0);
+    } else {
+        thread_pool_run(pool, xnor_task, &g, tasks);
+    }
+}
+
+void xnor_convolve(const float *input, int c, int h, int w, int size, int stride, int pad,
+        const uint64_t *packed_weights, const float *alpha, const int *tap_pop, int n,
+        float *output, void *workspace)
+{
+    int out_h = (h + 2*pad - size) / stride + 1;
+    int out_w = (w + 2*pad - size) / stride + 1;
+    int N = out_h*out_w;
+    int cw = xnor_words(c);
+    int taps = size*size;
+    int K = cw*taps;
+    uint64_t *im = (uint64_t*)workspace;
+    uint64_t *col = im + (size_t)cw*h*w;
+    const uint64_t *B = im;
+    int *counts = (int*)output;
+    int i, y, x, ky, kx, x_lo, x_hi;
+
+    xnor_pack_input(input, c, h*w, im);
+    if(!(size == 1 && stride == 1 && pad == 0)){
+        xnor_im2col(im, cw, h, w, size, stride, pad, col);
+        B = col;
+    }
+    // popcount는 출력 버퍼 자리에 int로 두었다가 float로 바꾼다
+    gemm_xnor(n, N, K, packed_weights, B, N, counts, N);
+
+    // 커널이 입력 안에 다 들어가는 출력 열 범위 [x_lo, x_hi)
+    x_lo = (pad + stride - 1) / stride;
+    x_hi = (w + pad - size) / stride + 1;
+    if(x_hi > out_w) x_hi = out_w;
+    if(x_hi < x_lo) x_hi = x_lo;
+
+    for(i = 0; i < n; ++i){
+        const int *pop = tap_pop + i*taps;
+        const float full = (float)taps*c;
+        float a = alpha[i];
+        float *out = output + (size_t)i*N;
+        int *cnt = counts + (size_t)i*N;
+        for(y = 0; y < out_h; ++y){
+            int ky0 = 0, ky1 = size;
+            while(y*stride + ky0 - pad < 0) ++ky0;
+            while(y*stride + ky1 - 1 - pad >= h) --ky1;
+            for(x = 0; x < out_w; ++x){
+                int kx0 = 0, kx1 = size;
+                int j = y*out_w + x;
+                int v;
+                if(ky0 == 0 && ky1 == size && x == x_lo){
+                    for(; x < x_hi; ++x){
+                        j = y*out_w + x;
+                        out[j] = a*(full - 2*cnt[j]);
+                    }
+                    if(x >= out_w) break;
+                    j = y*out_w + x;
+                }
+                v = cnt[j];
+                while(x*stride + kx0 - pad < 0) ++kx0;
+                while(x*stride + kx1 - 1 - pad >= w) --kx1;
+                // 패딩 자리(입력 bit 0)에서 xor된 weight bit는 세지 않는다
+                for(ky = 0; ky < size; ++ky){
+                    for(kx = 0; kx < size; ++kx){
+                        if(ky < ky0 || ky >= ky1 || kx < kx0 || kx >= kx1) v -= pop[ky*size + kx];
+                    }
+                }
+                out[j] = a*((float)(ky1 - ky0)*(kx1 - kx0)*c - 2*v);
+            }
+        }
+    }
+}
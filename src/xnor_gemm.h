@@ -0,0 +1,32 @@
+#ifndef XNOR_GEMM_H
+#define XNOR_GEMM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* XNOR conv (CPU 추론)
+ * 입력과 weight의 부호만 bit로 pack해서 (채널 64개 = uint64_t 하나) XNOR + popcount gemm으로 계산한다.
+ *   x > 0 -> 1 (+1), 아니면 0 (-1)        w > 0 -> 1 (+alpha), 아니면 0 (-alpha), alpha = mean|w|
+ *   dot = (유효 bit 수) - 2*popcount(w ^ x)
+ * 결과는 binarize_weights + binarize_cpu + im2col + gemm과 같다 (패딩 자리는 0으로 기여).
+ * weight는 [n][채널 word][size][size], im2col 결과는 [채널 word][size][size][출력 위치] */
+
+/* 채널 c개를 담는 word 수 */
+int xnor_words(int c);
+/* pack한 weight의 word 수 */
+size_t xnor_weights_size(int n, int c, int size);
+/* xnor_convolve가 쓰는 workspace 크기 (byte) */
+size_t xnor_workspace_size(int h, int w, int c, int size, int out_h, int out_w);
+
+/* weights [n][c][size][size] -> packed, alpha[n] = mean|w|, tap_pop[n][size*size] = 커널 위치별 1 bit 수 */
+void xnor_pack_weights(const float *weights, int n, int c, int size, uint64_t *packed, float *alpha, int *tap_pop);
+
+/* C[i][j] = popcount(A[i][:] ^ B[:][j]), A는 M x K word (row major), B는 K x N word */
+void gemm_xnor(int M, int N, int K, const uint64_t *A, const uint64_t *B, int ldb, int *C, int ldc);
+
+/* 이미지 한 장: output[n][out_h*out_w] = alpha * dot(sign(w), sign(x)) */
+void xnor_convolve(const float *input, int c, int h, int w, int size, int stride, int pad,
+        const uint64_t *packed_weights, const float *alpha, const int *tap_pop, int n,
+        float *output, void *workspace);
+
+#endif